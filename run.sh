@@ -1,2 +1,2 @@
 meson compile -C build
-cd src && ../build/tiro
+./build/tiro
@@ -0,0 +1,315 @@
+#define _DEFAULT_SOURCE
+#define GL_GLEXT_PROTOTYPES
+#include <GLFW/glfw3.h>
+#include <GL/gl.h>
+#include <GL/glext.h>
+
+#include "common/defines.h"
+#include "common/timer.h"
+#include "model/model.h"
+#include "model/model_pack.h"
+#include <math.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <sys/resource.h>
+#include <sys/stat.h>
+
+// =============================================================
+// OBJ import benchmark
+// =============================================================
+// Writes a synthetic .obj file in the working directory: a rippled grid with two
+// triangles per quad. The file is kept and used again by the next runs with the same
+// options. Then it is imported a few times, and the phases of the fastest run are
+// printed with the file throughput, the faces per second and the peak RSS.
+// `meson test -C build --benchmark` runs a few sizes. Run it directly for other sizes:
+//   bench_obj --faces 50M --attributes vtvn --eol crlf --whitespace mixed --runs 3
+
+typedef struct {
+    u64 faces;
+    int has_uv;
+    int has_normal;
+    int crlf;           // "\r\n" line endings instead of "\n"
+    int mixed_spaces;   // tabs, runs of spaces and trailing spaces between the values
+    u32 runs;
+    u32 threads;        // 0 means one per core
+} BenchOptions;
+
+// Output buffer of the generator, numbers are formatted by hand because printf is
+// slower than the loader for the biggest files
+typedef struct {
+    FILE* fp;
+    char data[1 << 16];
+    size_t size;
+} BenchWriter;
+
+static void writer_flush(BenchWriter* w) {
+    fwrite(w->data, 1, w->size, w->fp);
+    w->size = 0;
+}
+
+static void writer_text(BenchWriter* w, const char* text) {
+    size_t length = strlen(text);
+    if (w->size + length > sizeof(w->data)) writer_flush(w);
+    memcpy(w->data + w->size, text, length);
+    w->size += length;
+}
+
+static void writer_u64(BenchWriter* w, u64 value) {
+    char digits[20];
+    int count = 0;
+    do {
+        digits[count++] = (char)('0' + value % 10);
+        value /= 10;
+    } while (value);
+    if (w->size + (size_t)count > sizeof(w->data)) writer_flush(w);
+    while (count) w->data[w->size++] = digits[--count];
+}
+
+// Fixed point with 6 decimals, like "%.6f"
+static void writer_f32(BenchWriter* w, f32 value) {
+    if (value < 0.0f) {
+        writer_text(w, "-");
+        value = -value;
+    }
+    u64 micro = (u64)((f64)value * 1e6 + 0.5);
+    writer_u64(w, micro / 1000000);
+    char fraction[8] = ".000000";
+    for (int i = 6, rest = (int)(micro % 1000000); i > 0; i--, rest /= 10) fraction[i] = (char)('0' + rest % 10);
+    writer_text(w, fraction);
+}
+
+// Separator before the n-th value of a line
+static const char* bench_separator(const BenchOptions* o, u64 line, int n) {
+    static const char* const MIXED[] = { " ", "\t", "  ", " \t" };
+    return o->mixed_spaces ? MIXED[(line + (u64)n) % 4] : " ";
+}
+
+static void bench_end_line(BenchWriter* w, const BenchOptions* o) {
+    if (o->mixed_spaces) writer_text(w, " ");
+    writer_text(w, o->crlf ? "\r\n" : "\n");
+}
+
+static void bench_values(BenchWriter* w, const BenchOptions* o, const char* keyword, u64 line, const f32* values, int count) {
+    writer_text(w, keyword);
+    for (int i = 0; i < count; i++) {
+        writer_text(w, bench_separator(o, line, i));
+        writer_f32(w, values[i]);
+    }
+    bench_end_line(w, o);
+}
+
+static void bench_corner(BenchWriter* w, const BenchOptions* o, u64 index) {
+    writer_u64(w, index);
+    if (o->has_uv || o->has_normal) writer_text(w, "/");
+    if (o->has_uv) writer_u64(w, index);
+    if (o->has_normal) {
+        writer_text(w, "/");
+        writer_u64(w, index);
+    }
+}
+
+static int bench_generate(const BenchOptions* o, const char* path) {
+    char temporary[272];
+    snprintf(temporary, sizeof(temporary), "%s.tmp", path);
+    FILE* fp = fopen(temporary, "wb");
+    if (!fp) return 0;
+    BenchWriter* w = malloc(sizeof(BenchWriter));
+    if (!w) {
+        fclose(fp);
+        return 0;
+    }
+    w->fp = fp;
+    w->size = 0;
+
+    u64 quads = (o->faces + 1) / 2;
+    u64 columns = (u64)ceil(sqrt((f64)quads));
+    u64 rows = (quads + columns - 1) / columns;
+    writer_text(w, "# synthetic grid written by bench_obj");
+    bench_end_line(w, o);
+    u64 line = 0;
+    for (u64 j = 0; j <= rows; j++) {
+        for (u64 i = 0; i <= columns; i++, line++) {
+            f32 x = (f32)i / (f32)columns, z = (f32)j / (f32)rows;
+            f32 position[3] = { x, 0.05f * sinf(x * 20.0f) * cosf(z * 20.0f), z };
+            bench_values(w, o, "v", line, position, 3);
+            if (o->has_uv) {
+                f32 uv[2] = { x, z };
+                bench_values(w, o, "vt", line, uv, 2);
+            }
+            if (o->has_normal) {
+                f32 dx = cosf(x * 20.0f) * cosf(z * 20.0f), dz = -sinf(x * 20.0f) * sinf(z * 20.0f);
+                f32 length = sqrtf(dx * dx + 1.0f + dz * dz);
+                f32 normal[3] = { -dx / length, 1.0f / length, -dz / length };
+                bench_values(w, o, "vn", line, normal, 3);
+            }
+        }
+    }
+    for (u64 face = 0; face < o->faces; face++, line++) {
+        u64 quad = face / 2;
+        u64 a = (quad / columns) * (columns + 1) + quad % columns + 1;
+        u64 corners[2][3] = { { a, a + columns + 1, a + 1 }, { a + 1, a + columns + 1, a + columns + 2 } };
+        writer_text(w, "f");
+        for (int c = 0; c < 3; c++) {
+            writer_text(w, bench_separator(o, line, c));
+            bench_corner(w, o, corners[face % 2][c]);
+        }
+        bench_end_line(w, o);
+    }
+    writer_flush(w);
+    free(w);
+    int ok = !ferror(fp);
+    ok = fclose(fp) == 0 && ok;
+    // renamed only once complete, an interrupted run doesn't leave a truncated file behind
+    return ok && rename(temporary, path) == 0;
+}
+
+// A hidden window for its OpenGL context, NULL when there is no display
+static GLFWwindow* bench_gl_context(void) {
+    if (!glfwInit()) return NULL;
+    glfwWindowHint(GLFW_VISIBLE, GLFW_FALSE);
+    glfwWindowHint(GLFW_CONTEXT_VERSION_MAJOR, GL_VERSION_MAJOR);
+    glfwWindowHint(GLFW_CONTEXT_VERSION_MINOR, GL_VERSION_MINOR);
+    glfwWindowHint(GLFW_OPENGL_PROFILE, GLFW_OPENGL_CORE_PROFILE);
+    GLFWwindow* window = glfwCreateWindow(64, 64, "bench_obj", NULL, NULL);
+    if (!window) {
+        glfwTerminate();
+        return NULL;
+    }
+    glfwMakeContextCurrent(window);
+    return window;
+}
+
+// Same buffers as main.c, and wait for the driver to be done with them
+static void bench_gl_upload(const PackedMesh* mesh) {
+    u32 buffers[2];
+    glGenBuffers(2, buffers);
+    glBindBuffer(GL_ARRAY_BUFFER, buffers[0]);
+    glBufferStorage(GL_ARRAY_BUFFER, mesh->vertex_count * sizeof(PackedVertex), mesh->verts, 0);
+    glBindBuffer(GL_ELEMENT_ARRAY_BUFFER, buffers[1]);
+    glBufferStorage(GL_ELEMENT_ARRAY_BUFFER, mesh->index_count * mesh->index_size, mesh->indices, 0);
+    glFinish();
+    glDeleteBuffers(2, buffers);
+}
+
+// "10000", "10k", "1.5M"
+static int bench_parse_count(const char* text, u64* out) {
+    char* end;
+    f64 value = strtod(text, &end);
+    if (end == text) return 0;
+    if (*end == 'k' || *end == 'K') {
+        value *= 1e3;
+        end++;
+    } else if (*end == 'm' || *end == 'M') {
+        value *= 1e6;
+        end++;
+    }
+    if (*end != '\0' || value < 0.0) return 0;
+    *out = (u64)value;
+    return 1;
+}
+
+static int bench_parse_options(int argc, char** argv, BenchOptions* o) {
+    for (int i = 1; i < argc; i++) {
+        const char* value = i + 1 < argc ? argv[i + 1] : "";
+        u64 number = 0;
+        if (strcmp(argv[i], "--faces") == 0 && bench_parse_count(value, &number) && number > 0) o->faces = number;
+        else if (strcmp(argv[i], "--runs") == 0 && bench_parse_count(value, &number) && number > 0) o->runs = (u32)number;
+        else if (strcmp(argv[i], "--threads") == 0 && bench_parse_count(value, &number)) o->threads = (u32)number;
+        else if (strcmp(argv[i], "--attributes") == 0 && (strcmp(value, "v") == 0 || strcmp(value, "vt") == 0 ||
+                                                         strcmp(value, "vn") == 0 || strcmp(value, "vtvn") == 0)) {
+            o->has_uv = strstr(value, "vt") != NULL;
+            o->has_normal = strstr(value, "vn") != NULL;
+        }
+        else if (strcmp(argv[i], "--eol") == 0 && (strcmp(value, "lf") == 0 || strcmp(value, "crlf") == 0)) o->crlf = value[0] == 'c';
+        else if (strcmp(argv[i], "--whitespace") == 0 && (strcmp(value, "single") == 0 || strcmp(value, "mixed") == 0)) {
+            o->mixed_spaces = value[0] == 'm';
+        }
+        else return 0;
+        i++;
+    }
+    return 1;
+}
+
+static void bench_print_phase(const char* name, f64 seconds, f64 megabytes) {
+    printf("  %-8s %10.2f ms %10.1f MB/s\n", name, seconds * 1e3, seconds > 0.0 ? megabytes / seconds : 0.0);
+}
+
+int main(int argc, char** argv) {
+    BenchOptions o = { .faces = 1000000, .has_uv = 1, .has_normal = 1, .runs = 3 };
+    if (!bench_parse_options(argc, argv, &o)) {
+        fprintf(stderr, "usage: %s [--faces N] [--attributes v|vt|vn|vtvn] [--eol lf|crlf] "
+                        "[--whitespace single|mixed] [--runs N] [--threads N]\n", argv[0]);
+        return 2;
+    }
+
+    const char* attributes = o.has_uv ? (o.has_normal ? "vtvn" : "vt") : (o.has_normal ? "vn" : "v");
+    char path[256];
+    snprintf(path, sizeof(path), "bench_%llu_%s_%s_%s.obj", (unsigned long long)o.faces, attributes,
+             o.crlf ? "crlf" : "lf", o.mixed_spaces ? "mixed" : "single");
+    struct stat st;
+    if (stat(path, &st) != 0) {
+        printf("Generating %s\n", path);
+        if (!bench_generate(&o, path) || stat(path, &st) != 0) {
+            fprintf(stderr, "ERROR: could not write %s\n", path);
+            return 1;
+        }
+    }
+    f64 megabytes = (f64)st.st_size / (1024.0 * 1024.0);
+    GLFWwindow* window = bench_gl_context();
+
+    ObjImportTimings best = {0};
+    f64 best_import = INFINITY, best_pack = 0.0, best_gpu = 0.0;
+    for (u32 r = 0; r < o.runs; r++) {
+        Model m = {0};
+        ObjImportTimings timings;
+        if (model_from_obj_timed(path, &m, o.threads, &timings) != IO_SUCCESS) {
+            fprintf(stderr, "ERROR: could not import %s\n", path);
+            return 1;
+        }
+        if (m.lods[0].index_count / 3 != o.faces) {
+            fprintf(stderr, "ERROR: %s has %llu faces, %u were imported\n", path,
+                    (unsigned long long)o.faces, m.lods[0].index_count / 3);
+            model_free(&m);
+            return 1;
+        }
+
+        // upload: quantization, then the copy to the GPU when there is a context
+        f64 start = timer_now();
+        PackedMesh mesh;
+        IOStatus status = model_pack(&m, &mesh);
+        model_free(&m);
+        if (status != IO_SUCCESS) {
+            fprintf(stderr, "ERROR: could not pack %s\n", path);
+            return 1;
+        }
+        f64 packed = timer_now();
+        if (window) bench_gl_upload(&mesh);
+        f64 uploaded = timer_now();
+        packed_mesh_free(&mesh);
+
+        f64 import = timings.read + timings.scan + timings.parse + timings.index;
+        if (import < best_import) {
+            best = timings;
+            best_import = import;
+            best_pack = packed - start;
+            best_gpu = uploaded - packed;
+        }
+    }
+
+    struct rusage usage;
+    getrusage(RUSAGE_SELF, &usage);
+    printf("%s: %llu faces, %.1f MB, best of %u runs\n", path, (unsigned long long)o.faces, megabytes, o.runs);
+    bench_print_phase("read", best.read, megabytes);
+    bench_print_phase("scan", best.scan, megabytes);
+    bench_print_phase("parse", best.parse, megabytes);
+    bench_print_phase("index", best.index, megabytes);
+    bench_print_phase("pack", best_pack, megabytes);
+    if (window) bench_print_phase("gpu", best_gpu, megabytes);
+    else printf("  gpu      skipped, no OpenGL context\n");
+    bench_print_phase("import", best_import, megabytes);
+    printf("  %.2f M faces/s, peak RSS %.1f MB\n", (f64)o.faces / best_import * 1e-6, (f64)usage.ru_maxrss / 1024.0);
+
+    if (window) glfwTerminate();
+    return 0;
+}
@@ -0,0 +1,399 @@
+#define _DEFAULT_SOURCE
+#include "aio.h"
+#include <errno.h>
+#include <fcntl.h>
+#include <pthread.h>
+#include <stdint.h>
+#include <stdlib.h>
+#include <string.h>
+#include <sys/stat.h>
+#include <unistd.h>
+#ifdef HAVE_IO_URING
+#include <linux/io_uring.h>
+#include <sys/mman.h>
+#include <sys/syscall.h>
+#include <sys/uio.h>
+#endif
+
+// Threads of the fallback, reading is bound by the disk more than by the CPU
+#define AIO_THREAD_COUNT 4
+// Reads in flight at once in the io_uring, the next ones wait for a free slot
+#define AIO_RING_ENTRIES 64
+// Largest single read, Linux never reads more than about 2 GB at once anyway
+#define AIO_MAX_READ (1u << 30)
+
+// A file being read
+typedef struct {
+    char* path;
+    void* user;
+    int fd;
+    char* buffer;
+    size_t size;
+    size_t done;
+} AioFile;
+
+typedef DARRAY(AioFile) aio_file_darray;
+typedef DARRAY(AioCompletion) aio_completion_darray;
+
+#ifdef HAVE_IO_URING
+typedef struct {
+    int fd;
+    void* sq_mapping;
+    size_t sq_mapping_size;
+    void* cq_mapping;           // same as sq_mapping when the kernel maps both rings at once
+    size_t cq_mapping_size;
+    struct io_uring_sqe* sqes;
+    size_t sqes_size;
+    u32* sq_head;
+    u32* sq_tail;
+    u32* sq_mask;
+    u32* sq_array;
+    u32* cq_head;
+    u32* cq_tail;
+    u32* cq_mask;
+    struct io_uring_cqe* cqes;
+    AioFile slots[AIO_RING_ENTRIES];        // reads in flight, user_data of an sqe is its slot
+    struct iovec iovecs[AIO_RING_ENTRIES];  // buffer of the current read of every slot
+    u32 free_slots[AIO_RING_ENTRIES];
+    u32 free_count;
+} AioRing;
+#endif
+
+struct AioQueue {
+    aio_file_darray waiting;        // submitted and not started, from waiting_next on
+    size_t waiting_next;
+    aio_completion_darray done;     // finished and not collected, room for all the pending reads
+    u32 pending;                    // submitted and not collected
+#ifdef HAVE_IO_URING
+    AioRing* ring;                  // NULL when the thread pool is used
+#endif
+    pthread_t threads[AIO_THREAD_COUNT];
+    u32 thread_count;
+    pthread_mutex_t lock;           // waiting and done, shared with the threads
+    pthread_cond_t wake_workers;
+    pthread_cond_t wake_owner;
+    int stopping;
+};
+
+#ifdef HAVE_IO_URING
+#define AIO_HAS_RING(q) ((q)->ring != NULL)
+#else
+#define AIO_HAS_RING(q) 0
+#endif
+
+// Open the file and allocate its buffer, the first half of every read
+static IOStatus aio_file_open(AioFile* file) {
+    if (!file->path) return IO_ERROR_MEMORY;
+    file->fd = open(file->path, O_RDONLY);
+    if (file->fd < 0) return IO_ERROR_OPEN;
+    struct stat st;
+    if (fstat(file->fd, &st) != 0) return IO_ERROR_READ;
+    if (st.st_size == 0) return IO_ERROR_EMPTY;
+    if ((u64)st.st_size >= SIZE_MAX) return IO_ERROR_MEMORY;
+    file->size = (size_t)st.st_size;
+    file->buffer = malloc(file->size + 1);
+    return file->buffer ? IO_SUCCESS : IO_ERROR_MEMORY;
+}
+
+// Turn a finished read into a completion, with the lock held if there are threads
+static void aio_file_finish(AioQueue* q, AioFile* file, IOStatus status) {
+    if (file->fd >= 0) close(file->fd);
+    AioCompletion completion = { .user = file->user, .status = status };
+    if (status == IO_SUCCESS) {
+        file->buffer[file->size] = '\0';
+        completion.data = (string_t){ file->buffer, file->size };
+    } else {
+        free(file->buffer);
+    }
+    free(file->path);
+    // reserved by aio_submit
+    q->done.items[q->done.count++] = completion;
+}
+
+static IOStatus aio_file_read_blocking(AioFile* file) {
+    IOStatus status = aio_file_open(file);
+    while (status == IO_SUCCESS && file->done < file->size) {
+        size_t rest = file->size - file->done;
+        ssize_t read = pread(file->fd, file->buffer + file->done, rest < AIO_MAX_READ ? rest : AIO_MAX_READ, (off_t)file->done);
+        if (read < 0 && errno == EINTR) continue;
+        // 0 means the file got shorter since it was opened
+        if (read <= 0) status = IO_ERROR_READ;
+        else file->done += (size_t)read;
+    }
+    return status;
+}
+
+static void* aio_worker(void* arg) {
+    AioQueue* q = arg;
+    pthread_mutex_lock(&q->lock);
+    while (!q->stopping) {
+        if (q->waiting_next == q->waiting.count) {
+            pthread_cond_wait(&q->wake_workers, &q->lock);
+            continue;
+        }
+        AioFile file = q->waiting.items[q->waiting_next++];
+        pthread_mutex_unlock(&q->lock);
+        IOStatus status = aio_file_read_blocking(&file);
+        pthread_mutex_lock(&q->lock);
+        aio_file_finish(q, &file, status);
+        pthread_cond_signal(&q->wake_owner);
+    }
+    pthread_mutex_unlock(&q->lock);
+    return NULL;
+}
+
+// =============================================================
+// io_uring backend
+// =============================================================
+// Used without liburing: the rings are mapped by hand. Only the owner thread touches
+// them, the files are opened when they get a slot and read with IORING_OP_READV
+// (Linux 5.1), short reads are submitted again for the rest of the file.
+
+#ifdef HAVE_IO_URING
+static void aio_ring_close(AioRing* ring) {
+    if (ring->sqes) munmap(ring->sqes, ring->sqes_size);
+    if (ring->cq_mapping && ring->cq_mapping != ring->sq_mapping) munmap(ring->cq_mapping, ring->cq_mapping_size);
+    if (ring->sq_mapping) munmap(ring->sq_mapping, ring->sq_mapping_size);
+    close(ring->fd);
+}
+
+static int aio_ring_setup(AioRing* ring) {
+    struct io_uring_params params;
+    memset(&params, 0, sizeof(params));
+    // fails with ENOSYS on old kernels and EPERM where it's disabled (containers, sysctl)
+    ring->fd = (int)syscall(__NR_io_uring_setup, AIO_RING_ENTRIES, &params);
+    if (ring->fd < 0) return 0;
+
+    ring->sq_mapping_size = params.sq_off.array + params.sq_entries * sizeof(u32);
+    ring->cq_mapping_size = params.cq_off.cqes + params.cq_entries * sizeof(struct io_uring_cqe);
+    int single_mapping = (params.features & IORING_FEAT_SINGLE_MMAP) != 0;
+    if (single_mapping && ring->cq_mapping_size > ring->sq_mapping_size) ring->sq_mapping_size = ring->cq_mapping_size;
+    ring->sq_mapping = mmap(NULL, ring->sq_mapping_size, PROT_READ | PROT_WRITE, MAP_SHARED | MAP_POPULATE, ring->fd, IORING_OFF_SQ_RING);
+    if (ring->sq_mapping == MAP_FAILED) ring->sq_mapping = NULL;
+    ring->cq_mapping = single_mapping ? ring->sq_mapping :
+        mmap(NULL, ring->cq_mapping_size, PROT_READ | PROT_WRITE, MAP_SHARED | MAP_POPULATE, ring->fd, IORING_OFF_CQ_RING);
+    if (ring->cq_mapping == MAP_FAILED) ring->cq_mapping = NULL;
+    ring->sqes_size = params.sq_entries * sizeof(struct io_uring_sqe);
+    ring->sqes = mmap(NULL, ring->sqes_size, PROT_READ | PROT_WRITE, MAP_SHARED | MAP_POPULATE, ring->fd, IORING_OFF_SQES);
+    if (ring->sqes == MAP_FAILED) ring->sqes = NULL;
+    if (!ring->sq_mapping || !ring->cq_mapping || !ring->sqes) {
+        aio_ring_close(ring);
+        return 0;
+    }
+
+    u8* sq = ring->sq_mapping;
+    u8* cq = ring->cq_mapping;
+    ring->sq_head = (u32*)(sq + params.sq_off.head);
+    ring->sq_tail = (u32*)(sq + params.sq_off.tail);
+    ring->sq_mask = (u32*)(sq + params.sq_off.ring_mask);
+    ring->sq_array = (u32*)(sq + params.sq_off.array);
+    ring->cq_head = (u32*)(cq + params.cq_off.head);
+    ring->cq_tail = (u32*)(cq + params.cq_off.tail);
+    ring->cq_mask = (u32*)(cq + params.cq_off.ring_mask);
+    ring->cqes = (struct io_uring_cqe*)(cq + params.cq_off.cqes);
+    for (u32 i = 0; i < AIO_RING_ENTRIES; i++) ring->free_slots[i] = AIO_RING_ENTRIES - 1 - i;
+    ring->free_count = AIO_RING_ENTRIES;
+    return 1;
+}
+
+// Write the sqe reading the rest of the file of a slot (at most AIO_MAX_READ bytes)
+static void aio_ring_queue_read(AioRing* ring, u32 slot) {
+    AioFile* file = &ring->slots[slot];
+    u32 tail = *ring->sq_tail;
+    u32 index = tail & *ring->sq_mask;
+    size_t rest = file->size - file->done;
+    ring->iovecs[slot] = (struct iovec){ file->buffer + file->done, rest < AIO_MAX_READ ? rest : AIO_MAX_READ };
+
+    struct io_uring_sqe* sqe = &ring->sqes[index];
+    memset(sqe, 0, sizeof(*sqe));
+    sqe->opcode = IORING_OP_READV;
+    sqe->fd = file->fd;
+    sqe->addr = (u64)(uintptr_t)&ring->iovecs[slot];
+    sqe->len = 1;
+    sqe->off = file->done;
+    sqe->user_data = slot;
+    ring->sq_array[index] = index;
+    // the kernel must see the sqe before the new tail
+    __atomic_store_n(ring->sq_tail, tail + 1, __ATOMIC_RELEASE);
+}
+
+// Submit everything the kernel hasn't taken yet and optionally wait for a completion
+static void aio_ring_enter(AioRing* ring, int wait) {
+    u32 unsubmitted = *ring->sq_tail - __atomic_load_n(ring->sq_head, __ATOMIC_ACQUIRE);
+    if (unsubmitted == 0 && !wait) return;
+    // an error (EINTR, EBUSY, ...) leaves the sqes in the ring for the next call
+    syscall(__NR_io_uring_enter, ring->fd, unsubmitted, wait ? 1 : 0, wait ? IORING_ENTER_GETEVENTS : 0, NULL, 0);
+}
+
+// Give the free slots to the waiting files and submit their reads
+static void aio_ring_start(AioQueue* q) {
+    AioRing* ring = q->ring;
+    while (ring->free_count > 0 && q->waiting_next < q->waiting.count) {
+        AioFile file = q->waiting.items[q->waiting_next++];
+        IOStatus status = aio_file_open(&file);
+        if (status != IO_SUCCESS) {
+            aio_file_finish(q, &file, status);
+            continue;
+        }
+        u32 slot = ring->free_slots[--ring->free_count];
+        ring->slots[slot] = file;
+        aio_ring_queue_read(ring, slot);
+    }
+    aio_ring_enter(ring, 0);
+}
+
+// Handle the completions the kernel posted, waiting for one first if asked to
+static void aio_ring_reap(AioQueue* q, int wait) {
+    AioRing* ring = q->ring;
+    if (wait) aio_ring_enter(ring, 1);
+    u32 head = *ring->cq_head;
+    u32 tail = __atomic_load_n(ring->cq_tail, __ATOMIC_ACQUIRE);
+    for (; head != tail; head++) {
+        const struct io_uring_cqe* cqe = &ring->cqes[head & *ring->cq_mask];
+        u32 slot = (u32)cqe->user_data;
+        AioFile* file = &ring->slots[slot];
+        if (cqe->res == -EINTR || cqe->res == -EAGAIN) {
+            aio_ring_queue_read(ring, slot);
+            continue;
+        }
+        if (cqe->res > 0) file->done += (size_t)cqe->res;
+        if (cqe->res > 0 && file->done < file->size) {
+            aio_ring_queue_read(ring, slot);
+            continue;
+        }
+        aio_file_finish(q, file, cqe->res > 0 ? IO_SUCCESS : IO_ERROR_READ);
+        ring->free_slots[ring->free_count++] = slot;
+    }
+    __atomic_store_n(ring->cq_head, head, __ATOMIC_RELEASE);
+    aio_ring_start(q);
+}
+#endif
+
+// =============================================================
+// Queue
+// =============================================================
+
+AioQueue* aio_create(u32 flags) {
+    AioQueue* q = calloc(1, sizeof(AioQueue));
+    if (!q) return NULL;
+    pthread_mutex_init(&q->lock, NULL);
+    pthread_cond_init(&q->wake_workers, NULL);
+    pthread_cond_init(&q->wake_owner, NULL);
+#ifdef HAVE_IO_URING
+    if (!(flags & AIO_NO_URING)) {
+        q->ring = calloc(1, sizeof(AioRing));
+        if (q->ring && aio_ring_setup(q->ring)) return q;
+        free(q->ring);
+        q->ring = NULL;
+    }
+#else
+    (void)flags;
+#endif
+    // without any thread aio_submit reads the files itself
+    for (u32 i = 0; i < AIO_THREAD_COUNT; i++) {
+        if (pthread_create(&q->threads[q->thread_count], NULL, aio_worker, q) == 0) q->thread_count++;
+    }
+    return q;
+}
+
+IOStatus aio_submit(AioQueue* q, const AioRequest* requests, u32 count) {
+    pthread_mutex_lock(&q->lock);
+    if (q->waiting_next == q->waiting.count) {
+        q->waiting.count = 0;
+        q->waiting_next = 0;
+    }
+    if (!da_reserve(q->waiting, q->waiting.count + count) || !da_reserve(q->done, (size_t)q->pending + count)) {
+        pthread_mutex_unlock(&q->lock);
+        return IO_ERROR_MEMORY;
+    }
+    for (u32 i = 0; i < count; i++) {
+        // a path that can't be copied completes with IO_ERROR_MEMORY
+        AioFile file = { .path = strdup(requests[i].path), .user = requests[i].user, .fd = -1 };
+        if (q->thread_count > 0 || AIO_HAS_RING(q)) {
+            q->waiting.items[q->waiting.count++] = file;
+        } else {
+            aio_file_finish(q, &file, aio_file_read_blocking(&file));
+        }
+    }
+    q->pending += count;
+    pthread_cond_broadcast(&q->wake_workers);
+    pthread_mutex_unlock(&q->lock);
+#ifdef HAVE_IO_URING
+    if (q->ring) aio_ring_start(q);
+#endif
+    return IO_SUCCESS;
+}
+
+// Move up to max completions to out, with the lock held
+static u32 aio_collect(AioQueue* q, AioCompletion* out, u32 max) {
+    u32 count = q->done.count < max ? (u32)q->done.count : max;
+    memcpy(out, q->done.items, count * sizeof(AioCompletion));
+    memmove(q->done.items, q->done.items + count, (q->done.count - count) * sizeof(AioCompletion));
+    q->done.count -= count;
+    q->pending -= count;
+    return count;
+}
+
+u32 aio_poll(AioQueue* q, AioCompletion* out, u32 max) {
+#ifdef HAVE_IO_URING
+    if (q->ring) {
+        aio_ring_reap(q, 0);
+        return aio_collect(q, out, max);
+    }
+#endif
+    pthread_mutex_lock(&q->lock);
+    u32 count = aio_collect(q, out, max);
+    pthread_mutex_unlock(&q->lock);
+    return count;
+}
+
+u32 aio_wait(AioQueue* q, AioCompletion* out, u32 max) {
+    if (q->pending == 0 || max == 0) return 0;
+#ifdef HAVE_IO_URING
+    if (q->ring) {
+        aio_ring_reap(q, 0);
+        while (q->done.count == 0) aio_ring_reap(q, 1);
+        return aio_collect(q, out, max);
+    }
+#endif
+    pthread_mutex_lock(&q->lock);
+    while (q->done.count == 0) pthread_cond_wait(&q->wake_owner, &q->lock);
+    u32 count = aio_collect(q, out, max);
+    pthread_mutex_unlock(&q->lock);
+    return count;
+}
+
+u32 aio_pending(const AioQueue* q) {
+    return q->pending;
+}
+
+const char* aio_backend(const AioQueue* q) {
+    return AIO_HAS_RING(q) ? "io_uring" : "threads";
+}
+
+void aio_destroy(AioQueue* q) {
+    if (!q) return;
+    pthread_mutex_lock(&q->lock);
+    // the reads that didn't start are dropped, the ones in progress have to finish
+    for (size_t i = q->waiting_next; i < q->waiting.count; i++) free(q->waiting.items[i].path);
+    q->waiting_next = q->waiting.count;
+    q->stopping = 1;
+    pthread_cond_broadcast(&q->wake_workers);
+    pthread_mutex_unlock(&q->lock);
+    for (u32 i = 0; i < q->thread_count; i++) pthread_join(q->threads[i], NULL);
+#ifdef HAVE_IO_URING
+    if (q->ring) {
+        while (q->ring->free_count < AIO_RING_ENTRIES) aio_ring_reap(q, 1);
+        aio_ring_close(q->ring);
+        free(q->ring);
+    }
+#endif
+
+    for (size_t i = 0; i < q->done.count; i++) free(q->done.items[i].data.data);
+    da_free(q->waiting);
+    da_free(q->done);
+    pthread_mutex_destroy(&q->lock);
+    pthread_cond_destroy(&q->wake_workers);
+    pthread_cond_destroy(&q->wake_owner);
+    free(q);
+}
@@ -0,0 +1,93 @@
+#pragma once
+#include "common/defines.h"
+#include "common/files.h"
+
+// =============================================================
+// Asynchronous file reads
+// =============================================================
+// Whole files are read in the background while the main loop keeps running. Requests
+// are submitted in batches and their completions are collected with aio_poll, usually
+// once per frame, in the order the reads finish. On Linux the reads go through io_uring
+// when the kernel allows it. Otherwise a few threads do blocking reads with pread.
+// A queue is used by a single thread: the one that created it.
+
+typedef struct AioQueue AioQueue;
+
+// aio_create flags
+#define AIO_NO_URING 0x1    // always use the thread pool
+
+typedef struct {
+    const char* path;   // copied, it doesn't have to outlive the call
+    void* user;         // returned as is in the completion
+} AioRequest;
+
+typedef struct {
+    void* user;
+    IOStatus status;    // IO_SUCCESS, IO_ERROR_OPEN/READ/EMPTY/MEMORY like file_read_all
+    string_t data;      // whole file with a NUL after it, release it with free (NULL on error)
+} AioCompletion;
+
+/*
+* @brief Create a queue, with an io_uring if possible and a thread pool otherwise.
+*
+* @param flags AIO_* flags.
+* @return The queue, or NULL if out of memory.
+*/
+AioQueue* aio_create(u32 flags);
+
+/*
+* @brief Queue reads of whole files. They start right away, as many at once as the
+*   backend allows.
+*
+* @param q The queue.
+* @param requests The files to read.
+* @param count Number of requests.
+* @return IO_SUCCESS, or IO_ERROR_MEMORY if they couldn't be queued (none of them is).
+*   Errors of the reads themselves come with their completions.
+*/
+IOStatus aio_submit(AioQueue* q, const AioRequest* requests, u32 count);
+
+/*
+* @brief Collect the reads that are done, without waiting.
+*
+* @param q The queue.
+* @param out Where to store the completions.
+* @param max Size of out.
+* @return The number of completions stored in out.
+*/
+u32 aio_poll(AioQueue* q, AioCompletion* out, u32 max);
+
+/*
+* @brief Same as aio_poll, but waits for at least one completion if any read is pending.
+*
+* @param q The queue.
+* @param out Where to store the completions.
+* @param max Size of out.
+* @return The number of completions stored in out, 0 only when nothing is pending.
+*/
+u32 aio_wait(AioQueue* q, AioCompletion* out, u32 max);
+
+/*
+* @brief Number of submitted reads whose completion wasn't collected yet.
+*
+* @param q The queue.
+* @return The number of reads.
+*/
+u32 aio_pending(const AioQueue* q);
+
+/*
+* @brief Name of the backend in use, for logs.
+*
+* @param q The queue.
+* @return "io_uring" or "threads".
+*/
+const char* aio_backend(const AioQueue* q);
+
+/*
+* @brief Wait for the reads in progress, drop the completions that weren't collected
+*   and release the queue.
+*
+* @param q The queue, can be NULL.
+* @return void
+*/
+void aio_destroy(AioQueue* q);
@@ -0,0 +1,43 @@
+#pragma once
+#include <stddef.h>
+#include <stdlib.h>
+
+// =============================================================
+// Allocators
+// =============================================================
+// Where a container gets its memory from. A container stores a pointer to its allocator,
+// NULL standing for the C heap, so that the arrays built with malloc/realloc keep working
+// as they are. Arenas provide one (see common/arena.h).
+
+typedef struct {
+    /*
+    * @brief Allocate, grow, shrink or release a block, like realloc.
+    *
+    * @param context Allocator.context.
+    * @param memory The block, NULL to allocate a new one.
+    * @param old_size Size of the block, 0 if memory is NULL.
+    * @param new_size Size wanted, 0 to release the block.
+    * @return The block, moved or not, or NULL if it can't be allocated (the old block is then
+    *   untouched) or it was released.
+    */
+    void* (*resize)(void* context, void* memory, size_t old_size, size_t new_size);
+    void* context;
+} Allocator;
+
+/*
+* @brief Resize a block with an allocator, see Allocator.resize.
+*
+* @param allocator The allocator, NULL for the heap.
+* @param memory The block, or NULL.
+* @param old_size Size of the block.
+* @param new_size Size wanted, 0 to release it.
+* @return The block, or NULL if it can't be allocated or was released.
+*/
+static inline void* allocator_resize(const Allocator* allocator, void* memory, size_t old_size, size_t new_size) {
+    if (allocator) return allocator->resize(allocator->context, memory, old_size, new_size);
+    if (new_size == 0) {
+        free(memory);
+        return NULL;
+    }
+    return realloc(memory, new_size);
+}
@@ -0,0 +1,111 @@
+#define _DEFAULT_SOURCE
+#include "arena.h"
+#include <pthread.h>
+#include <stddef.h>
+#include <stdint.h>
+#include <stdlib.h>
+#include <string.h>
+#include <sys/mman.h>
+
+static pthread_key_t arena_scratch_key;
+static pthread_once_t arena_scratch_once = PTHREAD_ONCE_INIT;
+static int arena_scratch_ready;
+
+// Allocator.resize of an arena, only the last block can be given back
+static void* arena_resize(void* context, void* memory, size_t old_size, size_t new_size) {
+    Arena* arena = context;
+    u8* block = memory;
+    int last = block && block + old_size == arena->base + arena->used;
+    if (last && new_size <= old_size) {
+        arena->used -= old_size - new_size;
+        return new_size ? memory : NULL;
+    }
+    if (new_size == 0) return NULL;
+    // the last block grows where it is
+    if (last) return arena_alloc(arena, new_size - old_size, 1) ? memory : NULL;
+    if (block && new_size <= old_size) return memory;
+    void* moved = arena_alloc(arena, new_size, _Alignof(max_align_t));
+    if (moved && block) memcpy(moved, block, old_size);
+    return moved;
+}
+
+IOStatus arena_create(Arena* arena, size_t reserve) {
+    *arena = (Arena){0};
+    if (reserve == 0) reserve = ARENA_DEFAULT_RESERVE;
+    reserve = align_up(reserve, ARENA_COMMIT_SIZE);
+    // no access and no swap accounted until committed
+    void* base = mmap(NULL, reserve, PROT_NONE, MAP_PRIVATE | MAP_ANONYMOUS | MAP_NORESERVE, -1, 0);
+    if (base == MAP_FAILED) return IO_ERROR_MEMORY;
+    arena->base = base;
+    arena->reserved = reserve;
+    arena->allocator = (Allocator){ .resize = arena_resize, .context = arena };
+    return IO_SUCCESS;
+}
+
+void* arena_alloc(Arena* arena, size_t size, size_t alignment) {
+    size_t start = align_up(arena->used, alignment);
+    if (start < arena->used || start > arena->reserved || size > arena->reserved - start) return NULL;
+    size_t end = start + size;
+    if (end > arena->committed) {
+        // at least double, so that a growing arena commits in few steps
+        size_t commit = align_up(end, ARENA_COMMIT_SIZE);
+        if (commit < arena->committed * 2) commit = arena->committed * 2;
+        if (commit > arena->reserved) commit = arena->reserved;
+        if (mprotect(arena->base + arena->committed, commit - arena->committed, PROT_READ | PROT_WRITE) != 0) return NULL;
+        arena->committed = commit;
+    }
+    arena->used = end;
+    return arena->base + start;
+}
+
+void* arena_alloc_array(Arena* arena, size_t count, size_t size, size_t alignment, int zero) {
+    if (size != 0 && count > SIZE_MAX / size) return NULL;
+    void* memory = arena_alloc(arena, count * size, alignment);
+    if (memory && zero) memset(memory, 0, count * size);
+    return memory;
+}
+
+void arena_reset_to(Arena* arena, ArenaMark mark) {
+    if (mark > arena->used) return;
+    arena->used = mark;
+    size_t keep = align_up(mark > ARENA_RETAIN_SIZE ? mark : ARENA_RETAIN_SIZE, ARENA_COMMIT_SIZE);
+    if (arena->committed > keep) {
+        // the pages are dropped, committing them again gives zeroed ones
+        madvise(arena->base + keep, arena->committed - keep, MADV_DONTNEED);
+        mprotect(arena->base + keep, arena->committed - keep, PROT_NONE);
+        arena->committed = keep;
+    }
+}
+
+void arena_reset(Arena* arena) {
+    arena_reset_to(arena, 0);
+}
+
+void arena_destroy(Arena* arena) {
+    if (arena->base) munmap(arena->base, arena->reserved);
+    *arena = (Arena){0};
+}
+
+static void arena_scratch_free(void* data) {
+    arena_destroy(data);
+    free(data);
+}
+
+static void arena_scratch_init(void) {
+    arena_scratch_ready = pthread_key_create(&arena_scratch_key, arena_scratch_free) == 0;
+}
+
+Arena* arena_scratch(void) {
+    pthread_once(&arena_scratch_once, arena_scratch_init);
+    if (!arena_scratch_ready) return NULL;
+    Arena* arena = pthread_getspecific(arena_scratch_key);
+    if (arena) return arena;
+    arena = malloc(sizeof(Arena));
+    if (!arena) return NULL;
+    if (arena_create(arena, 0) != IO_SUCCESS || pthread_setspecific(arena_scratch_key, arena) != 0) {
+        arena_destroy(arena);
+        free(arena);
+        return NULL;
+    }
+    return arena;
+}
@@ -0,0 +1,120 @@
+#pragma once
+#include "common/allocator.h"
+#include "common/defines.h"
+#include "common/files.h"
+
+// =============================================================
+// Arena allocators
+// =============================================================
+// Linear allocators for memory that dies all at once: an allocation is a pointer bump, and
+// everything allocated after a mark is released together by going back to the mark. A
+// large range of address space is reserved up front and committed as the arena grows, so
+// an arena never moves its allocations and never copies. Each arena is used by a single
+// thread.
+//
+// Two arenas are ready to use:
+//   - arena_scratch(): one per thread, for the temporary buffers of a function, which takes
+//     a mark on entry and goes back to it before returning. Nothing allocated there can be
+//     returned to the caller.
+//   - the frame arena of main.c, reset at the start of every frame, for per-frame data.
+//
+// Dynamic arrays can allocate from an arena through its allocator: the array allocated last
+// grows and shrinks in place, the others move to the top and leave their old block behind
+// until the arena is reset.
+
+// Address space reserved by default, it costs nothing until it is committed
+#define ARENA_DEFAULT_RESERVE ((size_t)1 << 34)     // 16 GB
+// Memory is committed in steps of at least this much
+#define ARENA_COMMIT_SIZE ((size_t)1 << 16)         // 64 KB
+// Committed memory kept when an arena shrinks, so a reset doesn't cost a system call per frame
+#define ARENA_RETAIN_SIZE ((size_t)1 << 23)         // 8 MB
+
+typedef struct {
+    u8* base;           // start of the reserved range
+    size_t reserved;
+    size_t committed;   // readable and writable from base
+    size_t used;
+    Allocator allocator;    // for darrays (see common/darray.h), points back here so an arena is never moved
+} Arena;
+
+// Position in an arena, see arena_mark
+typedef size_t ArenaMark;
+
+/*
+* @brief Reserve the address space of an arena, nothing is committed yet.
+*
+* @param arena The arena to create.
+* @param reserve Most bytes it can hold, 0 for ARENA_DEFAULT_RESERVE.
+* @return IO_SUCCESS, or IO_ERROR_MEMORY if the range can't be reserved.
+*/
+IOStatus arena_create(Arena* arena, size_t reserve);
+
+/*
+* @brief Allocate from an arena, the memory is not cleared.
+*
+* @param arena The arena.
+* @param size Number of bytes.
+* @param alignment A power of two.
+* @return The memory, or NULL if the arena is full or it can't be committed.
+*/
+void* arena_alloc(Arena* arena, size_t size, size_t alignment);
+
+/*
+* @brief Allocate an array from an arena, checking count * size for overflow.
+*
+* @param arena The arena.
+* @param count Number of elements.
+* @param size Size of an element.
+* @param alignment A power of two.
+* @param zero 1 to clear the memory.
+* @return The array, or NULL if it doesn't fit.
+*/
+void* arena_alloc_array(Arena* arena, size_t count, size_t size, size_t alignment, int zero);
+
+// Allocate count elements of type from an arena, uninitialized or cleared
+#define arena_push(arena, type, count) ((type*)arena_alloc_array((arena), (count), sizeof(type), _Alignof(type), 0))
+#define arena_push_zero(arena, type, count) ((type*)arena_alloc_array((arena), (count), sizeof(type), _Alignof(type), 1))
+
+/*
+* @brief Current position of an arena, to go back to it with arena_reset_to.
+*
+* @param arena The arena.
+* @return The mark.
+*/
+static inline ArenaMark arena_mark(const Arena* arena) {
+    return arena->used;
+}
+
+/*
+* @brief Release everything allocated since a mark. Committed memory beyond
+*   ARENA_RETAIN_SIZE is given back to the system.
+*
+* @param arena The arena.
+* @param mark A mark taken on this arena, before the allocations to release.
+* @return void
+*/
+void arena_reset_to(Arena* arena, ArenaMark mark);
+
+/*
+* @brief Release everything allocated from an arena.
+*
+* @param arena The arena.
+* @return void
+*/
+void arena_reset(Arena* arena);
+
+/*
+* @brief Release the address space of an arena.
+*
+* @param arena The arena, can be one that was never created (all zeros).
+* @return void
+*/
+void arena_destroy(Arena* arena);
+
+/*
+* @brief The scratch arena of the calling thread, created the first time and destroyed
+*   when the thread exits.
+*
+* @return The arena, or NULL if it can't be created.
+*/
+Arena* arena_scratch(void);
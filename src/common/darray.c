@@ -0,0 +1,17 @@
+#include "darray.h"
+#include <stdint.h>
+
+void* darray_set_capacity(void* items, size_t count, size_t* capacity, size_t element_size,
+                          const Allocator* allocator, size_t new_capacity) {
+    if (new_capacity == *capacity || new_capacity < count) return items;
+    if (element_size != 0 && new_capacity > SIZE_MAX / element_size) return items;
+    if (new_capacity == 0) {
+        allocator_resize(allocator, items, *capacity * element_size, 0);
+        *capacity = 0;
+        return NULL;
+    }
+    void* moved = allocator_resize(allocator, items, *capacity * element_size, new_capacity * element_size);
+    if (!moved) return items;
+    *capacity = new_capacity;
+    return moved;
+}
@@ -0,0 +1,121 @@
+#pragma once
+#include "common/allocator.h"
+#include <stddef.h>
+#include <string.h>
+
+// =============================================================
+// Dynamic arrays
+// =============================================================
+// Growable arrays of any type: DARRAY(type) is a struct of items, count and capacity, plus
+// the allocator the items come from (NULL for the heap, so {0} is an empty heap array).
+// The da_* macros below work on any of them. Every macro that allocates returns 1 on
+// success, or 0 with the array left as it was, so running out of memory is reported
+// instead of crashing. They evaluate their array argument several times.
+//
+// Arrays that alias memory they don't own (a mapped file...) have a capacity of 0, they
+// are read only and must not be grown or freed.
+
+#define DARRAY(type)\
+    struct {\
+        type* items;\
+        size_t count;\
+        size_t capacity;\
+        const Allocator* allocator;\
+    }
+
+// Growth of da_grow and everything built on it: the capacity is multiplied by
+// DARRAY_GROWTH_NUM / DARRAY_GROWTH_DEN, starting from DARRAY_MIN_CAPACITY. They can be
+// defined before this header is included to change the growth of a whole file, or
+// da_reserve can be used to size an array exactly.
+#ifndef DARRAY_MIN_CAPACITY
+#define DARRAY_MIN_CAPACITY 16
+#endif
+#ifndef DARRAY_GROWTH_NUM
+#define DARRAY_GROWTH_NUM 2
+#endif
+#ifndef DARRAY_GROWTH_DEN
+#define DARRAY_GROWTH_DEN 1
+#endif
+
+/*
+* @brief Move the items of an array to a block of another capacity. Used by the macros.
+*
+* @param items The items, can be NULL.
+* @param count Number of items to keep, at most new_capacity.
+* @param capacity Capacity of items, set to new_capacity on success.
+* @param element_size Size of an item.
+* @param allocator Allocator of the array, NULL for the heap.
+* @param new_capacity Capacity wanted, 0 releases the items.
+* @return The items at their new place, or the old items if they couldn't be moved.
+*/
+void* darray_set_capacity(void* items, size_t count, size_t* capacity, size_t element_size,
+                          const Allocator* allocator, size_t new_capacity);
+
+// Capacity da_grow moves to for at least needed items
+static inline size_t darray_grown_capacity(size_t capacity, size_t needed) {
+    size_t grown = capacity / DARRAY_GROWTH_DEN * DARRAY_GROWTH_NUM;
+    if (grown < capacity) grown = needed;   // overflow, the allocation fails anyway
+    if (grown < DARRAY_MIN_CAPACITY) grown = DARRAY_MIN_CAPACITY;
+    return grown > needed ? grown : needed;
+}
+
+// Room for needed items, exactly or with the growth policy
+static inline void* darray_reserve(void* items, size_t count, size_t* capacity, size_t element_size,
+                                   const Allocator* allocator, size_t needed, int grow) {
+    if (needed <= *capacity) return items;
+    size_t new_capacity = grow ? darray_grown_capacity(*capacity, needed) : needed;
+    return darray_set_capacity(items, count, capacity, element_size, allocator, new_capacity);
+}
+
+// Macro helpers, as functions so that the macros can be used as statements without warnings
+static inline int darray_fits(size_t capacity, size_t needed) {
+    return capacity >= needed;
+}
+
+static inline void darray_copy(void* destination, const void* source, size_t size) {
+    if (size > 0) memcpy(destination, source, size);
+}
+
+static inline void darray_clear(void* items, size_t from, size_t to, size_t element_size) {
+    if (to > from) memset((char*)items + from * element_size, 0, (to - from) * element_size);
+}
+
+// Grow the capacity to exactly n items, if it is below. Returns 0 if it can't.
+#define da_reserve(xs, n)\
+    ((xs).items = darray_reserve((xs).items, (xs).count, &(xs).capacity, sizeof(*(xs).items), (xs).allocator, (size_t)(n), 0),\
+     darray_fits((xs).capacity, (size_t)(n)))
+
+// Grow the capacity to at least n items with the growth policy, so that
+// appending one item at a time is O(1) amortized. Returns 0 if it can't.
+#define da_grow(xs, n)\
+    ((xs).items = darray_reserve((xs).items, (xs).count, &(xs).capacity, sizeof(*(xs).items), (xs).allocator, (size_t)(n), 1),\
+     darray_fits((xs).capacity, (size_t)(n)))
+
+// Append one item. Returns 0 if the array can't grow.
+#define da_append(xs, x)\
+    (((xs).count < (xs).capacity || da_grow((xs), (xs).count + 1)) ? ((xs).items[(xs).count++] = (x), 1) : 0)
+
+// Append n items copied from span, an array of the same type that is not inside xs.
+// Returns 0 if the array can't grow.
+#define da_append_n(xs, span, n)\
+    (da_grow((xs), (xs).count + (size_t)(n)) ?\
+        (darray_copy((xs).items + (xs).count, (span), (size_t)(n) * sizeof(*(xs).items)), (xs).count += (size_t)(n), 1) : 0)
+
+// Set the number of items to n, the new ones are cleared to 0. Returns 0 if the array can't grow.
+#define da_resize(xs, n)\
+    (da_reserve((xs), (n)) ?\
+        (darray_clear((xs).items, (xs).count, (size_t)(n), sizeof(*(xs).items)), (xs).count = (size_t)(n), 1) : 0)
+
+// Give back the capacity beyond count, an empty array releases its items.
+// Returns 0 if the items couldn't be moved, the array is still valid then.
+#define da_shrink_to_fit(xs)\
+    ((xs).items = darray_set_capacity((xs).items, (xs).count, &(xs).capacity, sizeof(*(xs).items), (xs).allocator, (xs).count),\
+     darray_fits((xs).count, (xs).capacity))
+
+// Release the items, the array stays usable with the same allocator
+#define da_free(xs)\
+    do {\
+        (xs).items = darray_set_capacity((xs).items, 0, &(xs).capacity, sizeof(*(xs).items), (xs).allocator, 0);\
+        (xs).items = NULL;\
+        (xs).count = 0;\
+    } while (0)
@@ -1,5 +1,6 @@
 #pragma once
 
+#include "common/darray.h"
 #include <sys/types.h>
 
 // OpenGL default version
@@ -29,38 +30,12 @@ typedef struct {
     size_t size;
 } string_t;
 
+// Round value up to a multiple of alignment, a power of two
+static inline u64 align_up(u64 value, u64 alignment) {
+    return (value + alignment - 1) & ~(alignment - 1);
+}
 
-// Dynamic array types
-typedef struct {
-    f32* items;
-    size_t count;
-    size_t capacity;
-} f32_darray;
-
-typedef struct {
-    u32* items;
-    size_t count;
-    size_t capacity;
-} u32_darray;
-
-
-// Dynamic array macros
-#define da_append(xs, x)\
-    do {\
-        if(xs.count >= xs.capacity) {\
-            if(xs.capacity == 0) xs.capacity = 256;\
-            else xs.capacity *= 2;\
-            xs.items = realloc(xs.items, xs.capacity * sizeof(*xs.items));\
-        }\
-        xs.items[xs.count++] = x;\
-    }while(0)
 
-#define da_free(xs) \
-    do { \
-        if ((xs).items != NULL) { \
-            free((xs).items); \
-        } \
-        (xs).items = NULL; \
-        (xs).count = 0; \
-        (xs).capacity = 0; \
-    } while (0)
+// Dynamic arrays (see common/darray.h)
+typedef DARRAY(f32) f32_darray;
+typedef DARRAY(u32) u32_darray;
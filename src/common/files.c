@@ -1,6 +1,14 @@
+#define _DEFAULT_SOURCE
 #include "files.h"
+#include "common/pak.h"
+#include <fcntl.h>
+#include <stdint.h>
 #include <stdio.h>
 #include <stdlib.h>
+#include <string.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
 
 IOStatus file_read_buffer(char* buffer, const char* fpath, u32 max_buffer_len){
     FILE *fp = fopen(fpath, "r");
@@ -25,14 +33,20 @@ IOStatus file_read_buffer(char* buffer, const char* fpath, u32 max_buffer_len){
 IOStatus file_read_all(string_t* buffer, const char* fpath) {
     if (!buffer) return IO_ERROR_MEMORY;
 
-    FILE* fp = fopen(fpath, "r");
+    FILE* fp = fopen(fpath, "rb");
     if(fp == NULL) {
         return IO_ERROR_OPEN;
     }
 
-    fseek(fp, 0, SEEK_END);
-    u32 length = ftell(fp);
-    fseek(fp, 0, SEEK_SET);
+    // off_t, not long: files over 4 GB have to fit
+    fseeko(fp, 0, SEEK_END);
+    off_t end = ftello(fp);
+    fseeko(fp, 0, SEEK_SET);
+    if (end < 0 || (u64)end >= SIZE_MAX) {
+        fclose(fp);
+        return end < 0 ? IO_ERROR_READ : IO_ERROR_MEMORY;
+    }
+    size_t length = (size_t)end;
     if (length == 0) {
         fclose(fp);
         return IO_ERROR_EMPTY;
@@ -45,6 +59,7 @@ IOStatus file_read_all(string_t* buffer, const char* fpath) {
     }
 
     size_t read_size = fread(buffer->data, 1, length, fp);
+    fclose(fp);
     buffer->data[read_size] = '\0';
     buffer->size = read_size;
     if (read_size != length) {
@@ -53,3 +68,123 @@ IOStatus file_read_all(string_t* buffer, const char* fpath) {
 
     return IO_SUCCESS;
 }
+
+IOStatus file_map(string_t* view, const char* fpath, u32 flags) {
+    // the mounted archive has it already mapped
+    if (pak_mounted_find(fpath, view) == IO_SUCCESS) {
+        if (view->size > 0) return IO_SUCCESS;
+        *view = (string_t){0};
+        return IO_ERROR_EMPTY;
+    }
+    int fd = open(fpath, O_RDONLY);
+    if (fd < 0) return IO_ERROR_OPEN;
+    struct stat st;
+    if (fstat(fd, &st) != 0) {
+        close(fd);
+        return IO_ERROR_READ;
+    }
+    if (st.st_size == 0) {
+        close(fd);
+        return IO_ERROR_EMPTY;
+    }
+    if ((u64)st.st_size > SIZE_MAX) {
+        close(fd);
+        return IO_ERROR_MEMORY;
+    }
+
+    size_t size = (size_t)st.st_size;
+    int map_flags = MAP_PRIVATE;
+#ifdef MAP_POPULATE
+    if (flags & FILE_MAP_POPULATE) map_flags |= MAP_POPULATE;
+#else
+    (void)flags;
+#endif
+    void* mapping = mmap(NULL, size, PROT_READ, map_flags, fd, 0);
+    close(fd);
+    if (mapping == MAP_FAILED) return IO_ERROR_READ;
+    // bigger read-ahead and pages dropped behind, then start reading now
+    madvise(mapping, size, MADV_SEQUENTIAL);
+    madvise(mapping, size, MADV_WILLNEED);
+
+    view->data = mapping;
+    view->size = size;
+    return IO_SUCCESS;
+}
+
+void file_unmap(string_t* view) {
+    if (view->data && !pak_mounted_contains(view->data)) munmap(view->data, view->size);
+    view->data = NULL;
+    view->size = 0;
+}
+
+IOStatus file_write_atomic(const char* fpath, FileWriter write, void* context) {
+    size_t length = strlen(fpath);
+    char* tmp_path = malloc(length + sizeof(".tmp"));
+    if (!tmp_path) return IO_ERROR_MEMORY;
+    memcpy(tmp_path, fpath, length);
+    memcpy(tmp_path + length, ".tmp", sizeof(".tmp"));
+
+    FILE* fp = fopen(tmp_path, "wb");
+    if (!fp) {
+        free(tmp_path);
+        return IO_ERROR_OPEN;
+    }
+    int ok = write(fp, context) && !ferror(fp);
+    if (fclose(fp) != 0) ok = 0;
+    if (ok && rename(tmp_path, fpath) != 0) ok = 0;
+    if (!ok) remove(tmp_path);
+    free(tmp_path);
+    return ok ? IO_SUCCESS : IO_ERROR_WRITE;
+}
+
+int file_write_at(FILE* fp, u64 offset, const void* data, u64 size) {
+    static const u8 zeros[64] = {0};
+    off_t position = ftello(fp);
+    if (position < 0 || (u64)position > offset) return 0;
+    for (u64 padding = offset - (u64)position; padding > 0;) {
+        size_t chunk = padding < sizeof(zeros) ? (size_t)padding : sizeof(zeros);
+        if (fwrite(zeros, 1, chunk, fp) != chunk) return 0;
+        padding -= chunk;
+    }
+    // empty arrays can have a NULL data pointer
+    return size == 0 || fwrite(data, 1, size, fp) == size;
+}
+
+IOStatus file_executable_path(char* out, u32 out_size) {
+    ssize_t length = readlink("/proc/self/exe", out, out_size - 1);
+    if (length < 0) return IO_ERROR_OPEN;
+    // it may have been cut to fit
+    if ((size_t)length >= out_size - 1) return IO_ERROR_MEMORY;
+    out[length] = '\0';
+    return IO_SUCCESS;
+}
+
+IOStatus file_sibling_path(char* out, u32 out_size, const char* fpath, const char* name) {
+    size_t dir_len = 0;
+    if (name[0] != '/') {
+        const char* slash = strrchr(fpath, '/');
+        if (slash) dir_len = (size_t)(slash - fpath) + 1;
+    }
+    size_t name_len = strlen(name);
+    if (dir_len + name_len + 1 > out_size) return IO_ERROR_MEMORY;
+    memcpy(out, fpath, dir_len);
+    memcpy(out + dir_len, name, name_len + 1);
+    return IO_SUCCESS;
+}
+
+IOStatus path_darray_add(path_darray* paths, const char* path) {
+    for (size_t i = 0; i < paths->count; i++) {
+        if (strcmp(paths->items[i], path) == 0) return IO_SUCCESS;
+    }
+    char* copy = strdup(path);
+    if (!copy || !da_append(*paths, copy)) {
+        free(copy);
+        return IO_ERROR_MEMORY;
+    }
+    return IO_SUCCESS;
+}
+
+void path_darray_free(path_darray* paths) {
+    for (size_t i = 0; i < paths->count; i++) free(paths->items[i]);
+    da_free(*paths);
+}
@@ -8,6 +8,9 @@ typedef enum {
     IO_ERROR_READ   = -2,
     IO_ERROR_MEMORY = -3,
     IO_ERROR_EMPTY  = -4,
+    IO_ERROR_PARSE  = -5,
+    IO_ERROR_WRITE  = -6,
+    IO_ERROR_STALE  = -7,
 } IOStatus;
 
 // If 'call' is not SUCCESS, print error and return the error code.
@@ -25,3 +28,48 @@ IOStatus file_read_buffer(char* buffer, const char* fpath, u32 max_buffer_len);
 
 /* read the whole content of a file and return a new string_t with the content */
 IOStatus file_read_all(string_t* buffer, const char* fpath);
+
+// file_map flags
+#define FILE_MAP_POPULATE 0x1   // read the whole file in before returning
+
+/* map a whole file read only and return a view of it: the data is not NUL-terminated and
+   must not be written to. The kernel is told that it will be read front to back and starts
+   reading it ahead right away, with FILE_MAP_POPULATE all of it is read in before returning
+   so the pages never have to be faulted in one by one. Names found in the mounted content
+   archive (see common/pak.h) are served from it without touching the file system.
+   Release it with file_unmap */
+IOStatus file_map(string_t* view, const char* fpath, u32 flags);
+
+/* release a view returned by file_map */
+void file_unmap(string_t* view);
+
+/* writes the content of a file to fp, returns 0 if it couldn't */
+typedef int (*FileWriter)(FILE* fp, void* context);
+
+/* write a file with write under "<fpath>.tmp" and rename it to fpath once it is complete,
+   so that a reader sees either the old file or the whole new one, never a half written
+   one. Returns IO_ERROR_OPEN, IO_ERROR_MEMORY, or IO_ERROR_WRITE if write or closing the
+   file failed (the temporary file is removed) */
+IOStatus file_write_atomic(const char* fpath, FileWriter write, void* context);
+
+/* write size bytes of data at offset in fp, the bytes from the current position up to
+   offset are zeros. Returns 0 if writing failed or fp is already past offset */
+int file_write_at(FILE* fp, u64 offset, const void* data, u64 size);
+
+/* path of the running executable, to find the files built next to it whatever the
+   working directory is */
+IOStatus file_executable_path(char* out, u32 out_size);
+
+/* path of name relative to the directory of fpath (name itself if it's absolute),
+   returns IO_ERROR_MEMORY if it doesn't fit in out_size bytes */
+IOStatus file_sibling_path(char* out, u32 out_size, const char* fpath, const char* name);
+
+// A list of paths, each one allocated with malloc
+typedef DARRAY(char*) path_darray;
+
+/* append a copy of path to paths unless it is already there, returns IO_ERROR_MEMORY if
+   it couldn't */
+IOStatus path_darray_add(path_darray* paths, const char* path);
+
+/* free the paths of a list and the list itself */
+void path_darray_free(path_darray* paths);
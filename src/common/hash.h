@@ -0,0 +1,51 @@
+#pragma once
+#include "common/defines.h"
+#include <string.h>
+
+// =============================================================
+// Non-cryptographic hashing
+// =============================================================
+
+static inline u64 hash_mix(u64 h) {
+    h ^= h >> 33;
+    h *= 0xFF51AFD7ED558CCDull;
+    h ^= h >> 33;
+    h *= 0xC4CEB9FE1A85EC53ull;
+    h ^= h >> 33;
+    return h;
+}
+
+/*
+* @brief Hash a block of memory, 8 bytes at a time.
+*   Good to detect changes in a file, not meant to resist collisions on purpose.
+*
+* @param data The bytes to hash.
+* @param size Number of bytes.
+* @param seed Starting value, lets callers chain several blocks.
+* @return A 64 bit hash of the bytes.
+*/
+static inline u64 hash_bytes(const void* data, size_t size, u64 seed) {
+    const u8* p = data;
+    u64 h = seed ^ (size * 0x9E3779B97F4A7C15ull);
+    while (size >= 8) {
+        u64 word;
+        memcpy(&word, p, sizeof(word));
+        h = (h ^ hash_mix(word)) * 0x9E3779B97F4A7C15ull;
+        h = (h << 31) | (h >> 33);
+        p += 8;
+        size -= 8;
+    }
+    u64 tail = 0;
+    memcpy(&tail, p, size);
+    return hash_mix(h ^ tail);
+}
+
+/*
+* @brief Hash a NUL-terminated string.
+*
+* @param str The string to hash.
+* @return A 64 bit hash of the characters (the terminator excluded).
+*/
+static inline u64 hash_string(const char* str) {
+    return hash_bytes(str, strlen(str), 0);
+}
@@ -0,0 +1,50 @@
+#include "jobs.h"
+#include <pthread.h>
+#include <stdlib.h>
+#include <unistd.h>
+
+typedef struct {
+    job_fn fn;
+    void* data;
+} JobThread;
+
+static void* jobs_thread_main(void* arg) {
+    JobThread* job = arg;
+    job->fn(job->data);
+    return NULL;
+}
+
+u32 jobs_core_count(void) {
+    long count = sysconf(_SC_NPROCESSORS_ONLN);
+    return count > 0 ? (u32)count : 1;
+}
+
+void jobs_run(job_fn fn, void* data, size_t stride, u32 count) {
+    if (count == 0) return;
+
+    pthread_t* threads = malloc(count * sizeof(pthread_t));
+    JobThread* jobs = malloc(count * sizeof(JobThread));
+    u8* started = calloc(count, sizeof(u8));
+    if (!threads || !jobs || !started) {
+        free(threads);
+        free(jobs);
+        free(started);
+        for (u32 i = 0; i < count; i++) fn((u8*)data + i * stride);
+        return;
+    }
+
+    for (u32 i = 1; i < count; i++) {
+        jobs[i] = (JobThread){ fn, (u8*)data + i * stride };
+        started[i] = pthread_create(&threads[i], NULL, jobs_thread_main, &jobs[i]) == 0;
+    }
+
+    fn(data);
+    for (u32 i = 1; i < count; i++) {
+        if (started[i]) pthread_join(threads[i], NULL);
+        else fn(jobs[i].data);
+    }
+
+    free(threads);
+    free(jobs);
+    free(started);
+}
@@ -0,0 +1,31 @@
+#pragma once
+#include "common/defines.h"
+
+// =============================================================
+// Parallel jobs
+// =============================================================
+// Minimal fork/join helpers used by the asset loaders to split work across cores.
+
+// A job receives a pointer to its own element of the data array passed to jobs_run
+typedef void (*job_fn)(void* data);
+
+/*
+* @brief Number of cores currently online (at least 1).
+*
+* @param void
+* @return The number of threads worth running in parallel.
+*/
+u32 jobs_core_count(void);
+
+/*
+* @brief Run count jobs in parallel and wait for all of them to finish.
+*   Job i is called with data + i * stride, the calling thread runs job 0 itself.
+*   If a thread can't be created its job runs on the calling thread instead.
+*
+* @param fn The function to run.
+* @param data Array of count elements, one per job.
+* @param stride Size in bytes of one element of data.
+* @param count Number of jobs to run.
+* @return void
+*/
+void jobs_run(job_fn fn, void* data, size_t stride, u32 count);
@@ -0,0 +1,252 @@
+#define _DEFAULT_SOURCE
+#include "pak.h"
+#include "common/hash.h"
+#include <stdint.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <sys/mman.h>
+
+// Longest name pak_find accepts, longer ones are never in an archive
+#define PAK_NAME_MAX 1024
+
+// The archive file_map serves names from, see pak_mount
+static const Pak* pak_mounted;
+
+// Resolve ".", ".." and repeated slashes of a relative name into out (out_size bytes at
+// least), returns the length or 0 if the name is absolute, empty or goes above the root
+static size_t pak_normalize(char* out, size_t out_size, const char* name) {
+    if (name[0] == '/') return 0;
+    size_t length = 0;
+    const char* p = name;
+    while (*p) {
+        while (*p == '/') p++;
+        const char* part = p;
+        while (*p && *p != '/') p++;
+        size_t part_length = (size_t)(p - part);
+        if (part_length == 0 || (part_length == 1 && part[0] == '.')) continue;
+        if (part_length == 2 && part[0] == '.' && part[1] == '.') {
+            if (length == 0) return 0;
+            while (length > 0 && out[length - 1] != '/') length--;
+            if (length > 0) length--;
+            continue;
+        }
+        if (length + (length > 0) + part_length + 1 > out_size) return 0;
+        if (length > 0) out[length++] = '/';
+        memcpy(out + length, part, part_length);
+        length += part_length;
+    }
+    if (length > 0) out[length] = '\0';
+    return length;
+}
+
+u64 pak_hash(const char* name, size_t length) {
+    u64 hash = hash_bytes(name, length, 0);
+    return hash ? hash : 1;
+}
+
+IOStatus pak_open(Pak* pak, const char* path) {
+    *pak = (Pak){0};
+    IO_CHECK(file_map(&pak->file, path, 0));
+    // the entries are read in any order, unlike what file_map tells the kernel
+    madvise(pak->file.data, pak->file.size, MADV_NORMAL);
+
+    const u8* base = (const u8*)pak->file.data;
+    u64 size = pak->file.size;
+    const PakHeader* header = (const PakHeader*)base;
+    int valid = size >= sizeof(PakHeader);
+    u64 directory_end = valid ? sizeof(PakHeader) + (u64)header->slot_count * sizeof(PakEntry) : 0;
+    valid = valid && header->magic == PAK_MAGIC && header->version == PAK_VERSION &&
+            header->file_size == size && header->slot_count > 0 &&
+            (header->slot_count & (header->slot_count - 1)) == 0 && header->entry_count < header->slot_count &&
+            header->names_offset >= directory_end && header->names_size <= size &&
+            header->names_offset <= size - header->names_size &&
+            header->data_offset >= header->names_offset + header->names_size && header->data_offset <= size;
+    if (valid) {
+        const PakEntry* slots = (const PakEntry*)(base + sizeof(PakHeader));
+        const char* names = (const char*)base + header->names_offset;
+        u32 entry_count = 0;
+        for (u32 i = 0; i < header->slot_count && valid; i++) {
+            const PakEntry* entry = &slots[i];
+            if (entry->hash == 0) continue;
+            entry_count++;
+            valid = (u64)entry->name_offset + entry->name_length < header->names_size &&
+                    names[entry->name_offset + entry->name_length] == '\0' &&
+                    entry->offset >= header->data_offset && entry->offset % PAK_ALIGNMENT == 0 &&
+                    entry->size <= size && entry->offset <= size - entry->size;
+        }
+        valid = valid && entry_count == header->entry_count;
+        pak->slots = slots;
+        pak->names = names;
+    }
+    if (!valid) {
+        file_unmap(&pak->file);
+        *pak = (Pak){0};
+        return IO_ERROR_PARSE;
+    }
+    pak->header = header;
+    return IO_SUCCESS;
+}
+
+IOStatus pak_find(const Pak* pak, const char* name, string_t* view) {
+    char normalized[PAK_NAME_MAX];
+    size_t length = pak_normalize(normalized, sizeof(normalized), name);
+    if (length == 0 || !pak->header) return IO_ERROR_OPEN;
+
+    u64 hash = pak_hash(normalized, length);
+    u32 mask = pak->header->slot_count - 1;
+    // there is always an empty slot, the probe ends
+    for (u32 i = (u32)hash & mask;; i = (i + 1) & mask) {
+        const PakEntry* entry = &pak->slots[i];
+        if (entry->hash == 0) return IO_ERROR_OPEN;
+        if (entry->hash == hash && entry->name_length == length &&
+            memcmp(pak->names + entry->name_offset, normalized, length) == 0) {
+            view->data = pak->file.data + entry->offset;
+            view->size = entry->size;
+            return IO_SUCCESS;
+        }
+    }
+}
+
+void pak_close(Pak* pak) {
+    if (pak_mounted == pak) pak_mounted = NULL;
+    file_unmap(&pak->file);
+    *pak = (Pak){0};
+}
+
+void pak_mount(const Pak* pak) {
+    pak_mounted = pak;
+}
+
+IOStatus pak_mounted_find(const char* name, string_t* view) {
+    if (!pak_mounted) return IO_ERROR_OPEN;
+    return pak_find(pak_mounted, name, view);
+}
+
+int pak_mounted_contains(const void* data) {
+    if (!pak_mounted) return 0;
+    const char* p = data;
+    return p >= pak_mounted->file.data && p < pak_mounted->file.data + pak_mounted->file.size;
+}
+
+// =============================================================
+// Writing
+// =============================================================
+
+// Write size bytes then zeros up to padded_size
+static int pak_write_padded(FILE* fp, const void* data, u64 size, u64 padded_size) {
+    static const u8 zeros[PAK_ALIGNMENT] = {0};
+    if (size > 0 && fwrite(data, 1, size, fp) != size) return 0;
+    u64 padding = padded_size - size;
+    return padding == 0 || fwrite(zeros, 1, padding, fp) == padding;
+}
+
+// What pak_write puts in the file
+typedef struct {
+    const PakHeader* header;
+    const PakEntry* slots;
+    const char* names;
+    const string_t* contents;
+    u32 count;
+} PakContents;
+
+// the header and the directory are followed by the names, padded up to the data
+static int pak_write_contents(FILE* fp, void* context) {
+    const PakContents* pak = context;
+    const PakHeader* header = pak->header;
+    int ok = fwrite(header, sizeof(*header), 1, fp) == 1 &&
+             fwrite(pak->slots, sizeof(PakEntry), header->slot_count, fp) == header->slot_count &&
+             pak_write_padded(fp, pak->names, header->names_size, header->data_offset - header->names_offset);
+    for (u32 i = 0; i < pak->count && ok; i++) {
+        ok = pak_write_padded(fp, pak->contents[i].data, pak->contents[i].size, align_up(pak->contents[i].size, PAK_ALIGNMENT));
+    }
+    return ok;
+}
+
+IOStatus pak_write(const char* pak_path, const PakSource* sources, u32 count) {
+    // at most half full, so probes stay short and there is always an empty slot
+    u32 slot_count = 1;
+    while (slot_count <= count * 2) slot_count *= 2;
+    u64 names_size = 0;
+    for (u32 i = 0; i < count; i++) names_size += strlen(sources[i].name) + 1;
+    if (names_size > UINT32_MAX) return IO_ERROR_PARSE;
+
+    PakEntry* slots = calloc(slot_count, sizeof(PakEntry));
+    char* names = malloc(names_size + 1);
+    string_t* contents = calloc(count + 1, sizeof(string_t));
+    if (!slots || !names || !contents) {
+        free(slots);
+        free(names);
+        free(contents);
+        return IO_ERROR_MEMORY;
+    }
+
+    PakHeader header = {
+        .magic = PAK_MAGIC,
+        .version = PAK_VERSION,
+        .entry_count = count,
+        .slot_count = slot_count,
+        .names_offset = sizeof(PakHeader) + (u64)slot_count * sizeof(PakEntry),
+    };
+    IOStatus status = IO_SUCCESS;
+    u32 names_used = 0;
+    u32 mapped = 0;
+    u64 offset = 0;
+    for (u32 i = 0; i < count && status == IO_SUCCESS; i++) {
+        // stored normalized, that's what pak_find looks for
+        size_t capacity = strlen(sources[i].name) + 1;
+        size_t length = pak_normalize(names + names_used, capacity, sources[i].name);
+        if (length == 0) {
+            fprintf(stderr, "[PAK] Invalid name \"%s\"\n", sources[i].name);
+            status = IO_ERROR_PARSE;
+            break;
+        }
+        u64 hash = pak_hash(names + names_used, length);
+        u32 slot = (u32)hash & (slot_count - 1);
+        for (; slots[slot].hash != 0; slot = (slot + 1) & (slot_count - 1)) {
+            if (slots[slot].hash == hash && slots[slot].name_length == length &&
+                memcmp(names + slots[slot].name_offset, names + names_used, length) == 0) {
+                fprintf(stderr, "[PAK] Duplicate name \"%s\"\n", sources[i].name);
+                status = IO_ERROR_PARSE;
+                break;
+            }
+        }
+        if (status != IO_SUCCESS) break;
+
+        // empty files are kept, as empty entries
+        status = file_map(&contents[i], sources[i].path, 0);
+        if (status == IO_ERROR_EMPTY) status = IO_SUCCESS;
+        if (status != IO_SUCCESS) {
+            fprintf(stderr, "[PAK] Could not read %s (code %d)\n", sources[i].path, status);
+            break;
+        }
+        mapped = i + 1;
+        slots[slot] = (PakEntry){
+            .hash = hash,
+            .offset = offset,
+            .size = contents[i].size,
+            .name_offset = names_used,
+            .name_length = (u32)length,
+        };
+        names_used += (u32)length + 1;
+        offset = align_up(offset + contents[i].size, PAK_ALIGNMENT);
+    }
+
+    if (status == IO_SUCCESS) {
+        header.names_size = names_used;
+        header.data_offset = align_up(header.names_offset + names_used, PAK_ALIGNMENT);
+        header.file_size = header.data_offset + offset;
+        for (u32 i = 0; i < slot_count; i++) {
+            if (slots[i].hash != 0) slots[i].offset += header.data_offset;
+        }
+
+        PakContents pak = { &header, slots, names, contents, count };
+        status = file_write_atomic(pak_path, pak_write_contents, &pak);
+    }
+
+    for (u32 i = 0; i < mapped; i++) file_unmap(&contents[i]);
+    free(slots);
+    free(names);
+    free(contents);
+    return status;
+}
@@ -0,0 +1,133 @@
+#pragma once
+#include "common/defines.h"
+#include "common/files.h"
+
+// =============================================================
+// Content archive
+// =============================================================
+// All the assets of src/content packed in one file, content.pak, cooked and built next to
+// the executables by meson (see tools/tiro_cook.c). It is mapped once and every asset is a
+// view into the mapping: no open, stat or copy per file, and no dependence on the working
+// directory. Assets are named by their path relative to src/content, "shaders/vertex.glsl",
+// cooked meshes and textures get an extension on top: "models/diablo3_pose.obj.mesh".
+//
+// Layout, little endian:
+//   PakHeader
+//   PakEntry[slot_count]   hash table of the names, linear probing, empty slots have hash 0
+//   names                  NUL-terminated, referenced by the entries
+//   data                   every file at a PAK_ALIGNMENT offset, zero padded
+//
+// Once an archive is mounted with pak_mount, file_map serves the names it contains from it
+// before looking at the file system, so the loaders work on it unchanged.
+
+#define PAK_MAGIC     0x4B415054u   // "TPAK"
+#define PAK_VERSION   1
+#define PAK_ALIGNMENT 64            // files start on a cache line, like the blobs of a .tmesh
+
+typedef struct {
+    u32 magic;
+    u32 version;
+    u32 entry_count;
+    u32 slot_count;         // size of the directory, a power of two
+    u64 names_offset;
+    u64 names_size;
+    u64 data_offset;
+    u64 file_size;          // to tell a truncated archive
+} PakHeader;
+
+typedef struct {
+    u64 hash;               // pak_hash of the name, 0 for an empty slot
+    u64 offset;             // of the data, from the start of the archive
+    u64 size;
+    u32 name_offset;        // from names_offset
+    u32 name_length;
+} PakEntry;
+
+typedef struct {
+    string_t file;          // the whole mapping
+    const PakHeader* header;
+    const PakEntry* slots;
+    const char* names;
+} Pak;
+
+// A file to put in an archive: its name in the archive and where it is now
+typedef struct {
+    const char* name;
+    const char* path;
+} PakSource;
+
+/*
+* @brief Hash of a name in the directory, never 0.
+*
+* @param name The name.
+* @param length Its number of characters.
+* @return The hash.
+*/
+u64 pak_hash(const char* name, size_t length);
+
+/*
+* @brief Map an archive and check that its directory is consistent.
+*
+* @param pak The archive to open.
+* @param path Path of the .pak file.
+* @return IO_SUCCESS, IO_ERROR_OPEN/READ/EMPTY, or IO_ERROR_PARSE if it is not an archive
+*   of this version or is truncated.
+*/
+IOStatus pak_open(Pak* pak, const char* path);
+
+/*
+* @brief Find a file in an archive. "." and ".." in the name are resolved first, so
+*   paths made by file_sibling_path ("models/../textures/wall.jpg") work.
+*
+* @param pak The archive.
+* @param name Name of the file, relative to the content root.
+* @param view Set to the content of the file, valid until the archive is closed.
+* @return IO_SUCCESS, or IO_ERROR_OPEN if the archive doesn't have it.
+*/
+IOStatus pak_find(const Pak* pak, const char* name, string_t* view);
+
+/*
+* @brief Release an archive, unmounting it if needed. The views into it become invalid.
+*
+* @param pak The archive.
+* @return void
+*/
+void pak_close(Pak* pak);
+
+/*
+* @brief Serve the files of an archive through file_map, it must stay open while it is
+*   mounted. Mount before starting threads that read files.
+*
+* @param pak The archive, NULL to unmount.
+* @return void
+*/
+void pak_mount(const Pak* pak);
+
+/*
+* @brief Find a file in the mounted archive, used by file_map.
+*
+* @param name Name of the file.
+* @param view Set to the content of the file.
+* @return IO_SUCCESS, or IO_ERROR_OPEN if nothing is mounted or the archive doesn't have it.
+*/
+IOStatus pak_mounted_find(const char* name, string_t* view);
+
+/*
+* @brief Whether memory is part of the mounted archive, used by file_unmap.
+*
+* @param data Start of a view.
+* @return 1 if it is inside the mounted archive, 0 otherwise.
+*/
+int pak_mounted_contains(const void* data);
+
+/*
+* @brief Write an archive with the given files, through a temporary file renamed at the
+*   end so a failed build never leaves a partial archive behind.
+*
+* @param pak_path Path of the archive to write.
+* @param sources The files to pack, their names must be unique.
+* @param count Number of files.
+* @return IO_SUCCESS, IO_ERROR_OPEN/READ/MEMORY for a source, IO_ERROR_PARSE for a
+*   duplicate or empty name, IO_ERROR_WRITE if the archive couldn't be written.
+*/
+IOStatus pak_write(const char* pak_path, const PakSource* sources, u32 count);
@@ -0,0 +1,247 @@
+#include "parse.h"
+#include <locale.h>
+#include <stdlib.h>
+#include <string.h>
+
+// Exact powers of ten: every value up to 1e22 (1e10 for floats) is representable,
+// so multiplying/dividing an exact mantissa by them gives a correctly rounded result.
+static const f64 pow10_f64[] = {
+    1e0,  1e1,  1e2,  1e3,  1e4,  1e5,  1e6,  1e7,  1e8,  1e9,  1e10, 1e11,
+    1e12, 1e13, 1e14, 1e15, 1e16, 1e17, 1e18, 1e19, 1e20, 1e21, 1e22,
+};
+static const f32 pow10_f32[] = {
+    1e0f, 1e1f, 1e2f, 1e3f, 1e4f, 1e5f, 1e6f, 1e7f, 1e8f, 1e9f, 1e10f,
+};
+
+#define PARSE_MAX_DIGITS 19   // decimal digits that always fit in a u64
+
+// A decimal number split in its parts: value = mantissa * 10^exponent
+typedef struct {
+    u64 mantissa;
+    i64 exponent;
+    int negative;
+    int exact;      // 0 if some non-zero digit did not fit in the mantissa
+} DecimalNumber;
+
+static inline int is_digit(char c) { return (u8)(c - '0') < 10; }
+
+#if defined(__BYTE_ORDER__) && __BYTE_ORDER__ == __ORDER_LITTLE_ENDIAN__
+#define PARSE_SWAR 1
+// Check 8 characters at once: true only if all of them are in '0'..'9'
+static inline int swar_is_8_digits(u64 val) {
+    return (((val & 0xF0F0F0F0F0F0F0F0ull) |
+            (((val + 0x0606060606060606ull) & 0xF0F0F0F0F0F0F0F0ull) >> 4)) == 0x3333333333333333ull);
+}
+
+// Convert 8 ascii digits (first digit in the lowest byte) to their value without branches
+static inline u32 swar_parse_8_digits(u64 val) {
+    const u64 mask = 0x000000FF000000FFull;
+    const u64 mul1 = 0x000F424000000064ull;   // 100 + (1000000 << 32)
+    const u64 mul2 = 0x0000271000000001ull;   // 1 + (10000 << 32)
+    val -= 0x3030303030303030ull;
+    val = (val * 10) + (val >> 8);
+    val = (((val & mask) * mul1) + (((val >> 16) & mask) * mul2)) >> 32;
+    return (u32)val;
+}
+#else
+#define PARSE_SWAR 0
+#endif
+
+// Append a run of digits to the mantissa, 8 at a time while possible.
+// frac says if the digits come after the decimal point (so they lower the exponent).
+static const char* parse_digits(const char* p, const char* end, DecimalNumber* num, int* digits, int frac) {
+#if PARSE_SWAR
+    while (end - p >= 8 && *digits + 8 <= PARSE_MAX_DIGITS) {
+        u64 chunk;
+        memcpy(&chunk, p, sizeof(chunk));
+        if (!swar_is_8_digits(chunk)) break;
+        num->mantissa = num->mantissa * 100000000ull + swar_parse_8_digits(chunk);
+        if (frac) num->exponent -= 8;
+        *digits += 8;
+        p += 8;
+    }
+#endif
+    while (p < end && is_digit(*p)) {
+        if (*digits < PARSE_MAX_DIGITS) {
+            num->mantissa = num->mantissa * 10 + (u64)(*p - '0');
+            if (frac) num->exponent--;
+            (*digits)++;
+        } else {
+            // the digit does not fit: integer digits still scale the value,
+            // fraction digits are dropped and only matter if they are not zero
+            if (!frac) num->exponent++;
+            if (*p != '0') num->exact = 0;
+        }
+        p++;
+    }
+    return p;
+}
+
+// Read sign, digits, fraction and exponent. Returns cursor if there is no digit at all.
+static const char* parse_decimal(const char* cursor, const char* end, DecimalNumber* num) {
+    const char* p = cursor;
+    int digits = 0;
+    int any_digit = 0;
+
+    num->mantissa = 0;
+    num->exponent = 0;
+    num->negative = 0;
+    num->exact = 1;
+
+    if (p < end && (*p == '-' || *p == '+')) {
+        num->negative = (*p == '-');
+        p++;
+    }
+
+    // leading zeros carry no information, skipping them keeps all 19 digits for the rest
+    while (p < end && *p == '0') { p++; any_digit = 1; }
+    const char* start = p;
+    p = parse_digits(p, end, num, &digits, 0);
+    any_digit |= (p != start);
+
+    if (p < end && *p == '.') {
+        p++;
+        if (num->mantissa == 0) {
+            while (p < end && *p == '0') { p++; num->exponent--; any_digit = 1; }
+        }
+        start = p;
+        p = parse_digits(p, end, num, &digits, 1);
+        any_digit |= (p != start);
+    }
+    if (!any_digit) return cursor;
+
+    if (p < end && (*p == 'e' || *p == 'E')) {
+        const char* q = p + 1;
+        int exp_negative = 0;
+        if (q < end && (*q == '-' || *q == '+')) {
+            exp_negative = (*q == '-');
+            q++;
+        }
+        if (q < end && is_digit(*q)) {
+            i64 exp = 0;
+            while (q < end && is_digit(*q)) {
+                if (exp < 100000) exp = exp * 10 + (*q - '0');   // past this it's inf or 0 anyway
+                q++;
+            }
+            num->exponent += exp_negative ? -exp : exp;
+            p = q;
+        }
+    }
+    return p;
+}
+
+// Fallback for everything the fast paths can't round exactly (long mantissas, huge
+// exponents, inf/nan, ...). The token is copied and handed to strtod/strtof with the
+// '.' swapped for the decimal point of the current locale, so the result is the same
+// whatever LC_NUMERIC is set to.
+static const char* parse_slow(const char* cursor, const char* end, const char* number_end, f64* out_f64, f32* out_f32) {
+    char stack_buffer[128];
+    size_t len = number_end > cursor ? (size_t)(number_end - cursor) : (size_t)(end - cursor);
+    if (number_end <= cursor && len > 63) len = 63;   // "infinity", "nan(...)": always short
+
+    char* buffer = stack_buffer;
+    if (len + 1 > sizeof(stack_buffer)) {
+        buffer = malloc(len + 1);
+        if (!buffer) return cursor;
+    }
+    memcpy(buffer, cursor, len);
+    buffer[len] = '\0';
+
+    char decimal_point = localeconv()->decimal_point[0];
+    if (decimal_point != '.') {
+        for (size_t i = 0; i < len; i++) {
+            if (buffer[i] == '.') buffer[i] = decimal_point;
+        }
+    }
+
+    char* parsed_end;
+    f64 value_f64 = 0.0;
+    f32 value_f32 = 0.0f;
+    if (out_f32) value_f32 = strtof(buffer, &parsed_end);
+    else         value_f64 = strtod(buffer, &parsed_end);
+    size_t consumed = (size_t)(parsed_end - buffer);
+    if (consumed > 0) {
+        if (out_f32) *out_f32 = value_f32;
+        else         *out_f64 = value_f64;
+    }
+
+    if (buffer != stack_buffer) free(buffer);
+    return cursor + consumed;
+}
+
+const char* parse_i64(const char* cursor, const char* end, i64* out) {
+    const char* p = cursor;
+    int negative = 0;
+    if (p < end && (*p == '-' || *p == '+')) {
+        negative = (*p == '-');
+        p++;
+    }
+
+    const char* start = p;
+    u64 value = 0;
+    while (p < end && is_digit(*p)) {
+        value = value * 10 + (u64)(*p - '0');
+        p++;
+    }
+    if (p == start) return cursor;
+
+    *out = negative ? -(i64)value : (i64)value;
+    return p;
+}
+
+const char* parse_f64(const char* cursor, const char* end, f64* out) {
+    DecimalNumber num;
+    const char* p = parse_decimal(cursor, end, &num);
+    if (p == cursor) return parse_slow(cursor, end, cursor, out, NULL);
+
+    // Clinger's fast path: both the mantissa and 10^|exponent| are exact doubles,
+    // so a single multiplication or division is correctly rounded.
+    if (num.exact && num.mantissa <= (1ull << 53) && num.exponent >= -22 && num.exponent <= 22) {
+        f64 value = (f64)num.mantissa;
+        if (num.exponent < 0) value /= pow10_f64[-num.exponent];
+        else                  value *= pow10_f64[num.exponent];
+        *out = num.negative ? -value : value;
+        return p;
+    }
+    if (num.mantissa == 0) {
+        *out = num.negative ? -0.0 : 0.0;
+        return p;
+    }
+    return parse_slow(cursor, end, p, out, NULL);
+}
+
+const char* parse_f32(const char* cursor, const char* end, f32* out) {
+    DecimalNumber num;
+    const char* p = parse_decimal(cursor, end, &num);
+    if (p == cursor) return parse_slow(cursor, end, cursor, NULL, out);
+
+    if (num.exact && num.mantissa <= (1ull << 24) && num.exponent >= -10 && num.exponent <= 10) {
+        // same as the f64 fast path, but all in float precision
+        f32 value = (f32)num.mantissa;
+        if (num.exponent < 0) value /= pow10_f32[-num.exponent];
+        else                  value *= pow10_f32[num.exponent];
+        *out = num.negative ? -value : value;
+        return p;
+    }
+
+    if (num.exact && num.mantissa <= (1ull << 53) && num.exponent >= -22 && num.exponent <= 22) {
+        // Round to double first, then to float. This matches strtof unless the double
+        // lands exactly halfway between two floats (the 29 bits dropped by the float
+        // conversion are 100...0), where the second rounding could go the wrong way.
+        f64 value = (f64)num.mantissa;
+        if (num.exponent < 0) value /= pow10_f64[-num.exponent];
+        else                  value *= pow10_f64[num.exponent];
+
+        u64 bits;
+        memcpy(&bits, &value, sizeof(bits));
+        if ((bits & 0x1FFFFFFFull) != 0x10000000ull) {
+            *out = num.negative ? -(f32)value : (f32)value;
+            return p;
+        }
+    }
+    if (num.mantissa == 0) {
+        *out = num.negative ? -0.0f : 0.0f;
+        return p;
+    }
+    return parse_slow(cursor, end, p, NULL, out);
+}
@@ -0,0 +1,53 @@
+#pragma once
+#include "common/defines.h"
+
+// =============================================================
+// Number parsing for text assets
+// =============================================================
+// All the functions work on the [cursor, end) range, the text does not need to be
+// NUL-terminated. They return the pointer right after the parsed token, or cursor
+// itself when no number could be read (nothing is written to out in that case).
+// Parsing never depends on the current C locale: '.' is always the decimal separator.
+
+/*
+* @brief Skip spaces and tabs.
+*
+* @param cursor Start of the text.
+* @param end One past the last readable character.
+* @return The first character that is not a space or a tab (or end).
+*/
+static inline const char* parse_skip_spaces(const char* cursor, const char* end) {
+    while (cursor < end && (*cursor == ' ' || *cursor == '\t')) cursor++;
+    return cursor;
+}
+
+/*
+* @brief Parse a decimal integer with an optional sign.
+*
+* @param cursor Start of the text.
+* @param end One past the last readable character.
+* @param out Where to store the value.
+* @return The pointer after the number, or cursor if there are no digits.
+*/
+const char* parse_i64(const char* cursor, const char* end, i64* out);
+
+/*
+* @brief Parse a decimal floating point number ("-1.5", "2.", ".5e-3", "inf", "nan", ...)
+*   rounded to the nearest double, with the same result strtod would give.
+*
+* @param cursor Start of the text.
+* @param end One past the last readable character.
+* @param out Where to store the value.
+* @return The pointer after the number, or cursor if it is not a number.
+*/
+const char* parse_f64(const char* cursor, const char* end, f64* out);
+
+/*
+* @brief Same as parse_f64 but rounded to the nearest float, the same result as strtof.
+*
+* @param cursor Start of the text.
+* @param end One past the last readable character.
+* @param out Where to store the value.
+* @return The pointer after the number, or cursor if it is not a number.
+*/
+const char* parse_f32(const char* cursor, const char* end, f32* out);
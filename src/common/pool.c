@@ -0,0 +1,113 @@
+#include "pool.h"
+#include <stdint.h>
+#include <stdlib.h>
+#include <string.h>
+
+// Pool.free_head when there is no free block
+#define POOL_NO_BLOCK POOL_MAX_BLOCKS
+#define POOL_INDEX_MASK (POOL_MAX_BLOCKS - 1)
+#define POOL_GENERATION_MASK (POOL_GENERATION_COUNT - 1)
+
+static u8* pool_block(const Pool* pool, u32 index) {
+    const PoolSlab* slab = &pool->slabs.items[index >> pool->slab_shift];
+    return slab->blocks + (size_t)(index & ((1u << pool->slab_shift) - 1)) * pool->stride;
+}
+
+static u16* pool_generation(const Pool* pool, u32 index) {
+    const PoolSlab* slab = &pool->slabs.items[index >> pool->slab_shift];
+    return &slab->generations[index & ((1u << pool->slab_shift) - 1)];
+}
+
+IOStatus pool_create(Pool* pool, size_t block_size, size_t alignment) {
+    *pool = (Pool){0};
+    if (alignment == 0 || (alignment & (alignment - 1)) != 0 || alignment > POOL_SLAB_ALIGNMENT) return IO_ERROR_MEMORY;
+    if (block_size > POOL_SLAB_SIZE * (size_t)POOL_MAX_BLOCKS) return IO_ERROR_MEMORY;
+    // a free block holds the index of the next free one
+    if (alignment < _Alignof(u32)) alignment = _Alignof(u32);
+    pool->block_size = block_size;
+    pool->stride = align_up(block_size > sizeof(u32) ? block_size : sizeof(u32), alignment);
+    while (pool->slab_shift < POOL_INDEX_BITS && ((size_t)2 << pool->slab_shift) * pool->stride <= POOL_SLAB_SIZE) {
+        pool->slab_shift++;
+    }
+    pool->free_head = POOL_NO_BLOCK;
+    return IO_SUCCESS;
+}
+
+// Allocate a slab and put all its blocks on the free list
+static int pool_add_slab(Pool* pool) {
+    u32 per_slab = 1u << pool->slab_shift;
+    size_t first = pool->slabs.count << pool->slab_shift;
+    if (first + per_slab > POOL_MAX_BLOCKS) return 0;
+    if (!da_grow(pool->slabs, pool->slabs.count + 1)) return 0;
+    PoolSlab slab = {
+        .blocks = aligned_alloc(POOL_SLAB_ALIGNMENT, align_up(per_slab * pool->stride, POOL_SLAB_ALIGNMENT)),
+        .generations = calloc(per_slab, sizeof(u16)),
+    };
+    if (!slab.blocks || !slab.generations) {
+        free(slab.blocks);
+        free(slab.generations);
+        return 0;
+    }
+    // in index order, so that the first blocks allocated are next to each other
+    for (u32 i = 0; i < per_slab; i++) {
+        u32 next = i + 1 < per_slab ? (u32)first + i + 1 : pool->free_head;
+        memcpy(slab.blocks + (size_t)i * pool->stride, &next, sizeof(next));
+    }
+    pool->free_head = (u32)first;
+    pool->slabs.items[pool->slabs.count++] = slab;
+    return 1;
+}
+
+void* pool_alloc(Pool* pool, Handle* handle) {
+    *handle = HANDLE_NONE;
+    if (pool->free_head == POOL_NO_BLOCK && !pool_add_slab(pool)) return NULL;
+    u32 index = pool->free_head;
+    u8* memory = pool_block(pool, index);
+    memcpy(&pool->free_head, memory, sizeof(u32));
+    memset(memory, 0, pool->stride);
+
+    // odd while allocated, so the handles of free blocks never match
+    u16* generation = pool_generation(pool, index);
+    *generation = (u16)((*generation + 1) & POOL_GENERATION_MASK);
+    pool->count++;
+    *handle = (Handle)*generation << POOL_INDEX_BITS | index;
+    return memory;
+}
+
+void* pool_get(const Pool* pool, Handle handle) {
+    u32 index = handle & POOL_INDEX_MASK;
+    u32 generation = handle >> POOL_INDEX_BITS;
+    if (!(generation & 1) || (index >> pool->slab_shift) >= pool->slabs.count) return NULL;
+    if (*pool_generation(pool, index) != generation) return NULL;
+    return pool_block(pool, index);
+}
+
+int pool_free(Pool* pool, Handle handle) {
+    u8* memory = pool_get(pool, handle);
+    if (!memory) return 0;
+    u32 index = handle & POOL_INDEX_MASK;
+    u16* generation = pool_generation(pool, index);
+    *generation = (u16)((*generation + 1) & POOL_GENERATION_MASK);
+    memcpy(memory, &pool->free_head, sizeof(u32));
+    pool->free_head = index;
+    pool->count--;
+    return 1;
+}
+
+Handle pool_next(const Pool* pool, Handle handle) {
+    size_t end = pool->slabs.count << pool->slab_shift;
+    for (size_t index = handle == HANDLE_NONE ? 0 : (handle & POOL_INDEX_MASK) + 1; index < end; index++) {
+        u16 generation = *pool_generation(pool, (u32)index);
+        if (generation & 1) return (Handle)generation << POOL_INDEX_BITS | (u32)index;
+    }
+    return HANDLE_NONE;
+}
+
+void pool_destroy(Pool* pool) {
+    for (size_t i = 0; i < pool->slabs.count; i++) {
+        free(pool->slabs.items[i].blocks);
+        free(pool->slabs.items[i].generations);
+    }
+    da_free(pool->slabs);
+    *pool = (Pool){0};
+}
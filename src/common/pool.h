@@ -0,0 +1,104 @@
+#pragma once
+#include "common/defines.h"
+#include "common/files.h"
+
+// =============================================================
+// Block pools
+// =============================================================
+// Many objects of the same size (GL resource records, models, cameras...) allocated and
+// freed in O(1): the blocks come from slabs aligned on a cache line, and the free ones are
+// chained through their own memory. Blocks never move, so a pointer from pool_get stays
+// valid until its block is freed.
+//
+// Blocks are referred to by 32-bit handles rather than pointers: POOL_INDEX_BITS of block
+// index, and the generation of the block in the rest. The generation changes every time
+// the block is allocated or freed, so a handle to a block that was freed, and maybe reused
+// since, is detected by pool_get instead of reaching the new object. Generations wrap
+// after POOL_GENERATION_COUNT / 2 reuses of the same block, a handle kept that long is
+// not detected anymore.
+// A pool is used by a single thread.
+
+// Handle of a block, HANDLE_NONE is never a valid one
+typedef u32 Handle;
+#define HANDLE_NONE 0u
+
+#define POOL_INDEX_BITS 20
+#define POOL_MAX_BLOCKS (1u << POOL_INDEX_BITS)
+#define POOL_GENERATION_COUNT (1u << (32 - POOL_INDEX_BITS))
+// Alignment of the slabs, a cache line
+#define POOL_SLAB_ALIGNMENT 64
+// Slabs hold as many blocks as fit in this size, a power of two of them and at least one
+#define POOL_SLAB_SIZE (16 * 1024)
+
+typedef struct {
+    u8* blocks;         // blocks_per_slab blocks of stride bytes
+    u16* generations;   // of every block, odd while it is allocated
+} PoolSlab;
+
+typedef DARRAY(PoolSlab) pool_slab_darray;
+
+typedef struct {
+    size_t block_size;
+    size_t stride;          // distance between two blocks
+    u32 slab_shift;         // log2 of the blocks per slab
+    u32 free_head;          // first free block, POOL_MAX_BLOCKS if none
+    u32 count;              // allocated blocks
+    pool_slab_darray slabs;
+} Pool;
+
+/*
+* @brief Create an empty pool, the slabs are allocated as blocks are needed.
+*
+* @param pool The pool to create.
+* @param block_size Size of a block, at least the size of a u32 is used.
+* @param alignment Alignment of the blocks, a power of two up to POOL_SLAB_ALIGNMENT.
+* @return IO_SUCCESS, or IO_ERROR_MEMORY if the alignment is not supported.
+*/
+IOStatus pool_create(Pool* pool, size_t block_size, size_t alignment);
+
+// Create a pool of blocks of type
+#define pool_create_for(pool, type) pool_create((pool), sizeof(type), _Alignof(type))
+
+/*
+* @brief Allocate a block, cleared to 0.
+*
+* @param pool The pool.
+* @param handle Set to the handle of the block, HANDLE_NONE if there is none.
+* @return The block, or NULL if the pool is full or out of memory.
+*/
+void* pool_alloc(Pool* pool, Handle* handle);
+
+/*
+* @brief The block of a handle.
+*
+* @param pool The pool the handle comes from.
+* @param handle The handle, can be HANDLE_NONE.
+* @return The block, or NULL if the handle is HANDLE_NONE or its block was freed.
+*/
+void* pool_get(const Pool* pool, Handle handle);
+
+/*
+* @brief Free a block, its handle and every copy of it become invalid.
+*
+* @param pool The pool.
+* @param handle The handle of the block.
+* @return 1 if the block was freed, 0 if the handle was already invalid.
+*/
+int pool_free(Pool* pool, Handle handle);
+
+/*
+* @brief Iterate over the allocated blocks, in index order.
+*
+* @param pool The pool.
+* @param handle HANDLE_NONE to start, then the handle returned by the previous call.
+* @return The handle of the next allocated block, HANDLE_NONE after the last one.
+*/
+Handle pool_next(const Pool* pool, Handle handle);
+
+/*
+* @brief Release the slabs of a pool, all its handles become invalid.
+*
+* @param pool The pool, can be one that was never created (all zeros).
+* @return void
+*/
+void pool_destroy(Pool* pool);
@@ -0,0 +1,119 @@
+#include "scan.h"
+#include <stdint.h>
+#include <stdlib.h>
+
+// Bit i of a mask is set when byte i of the block matches
+#if defined(__AVX2__)
+#include <immintrin.h>
+#define SCAN_WIDTH 32
+
+static inline u32 scan_newline_mask(const char* block) {
+    __m256i bytes = _mm256_loadu_si256((const __m256i*)block);
+    return (u32)_mm256_movemask_epi8(_mm256_cmpeq_epi8(bytes, _mm256_set1_epi8('\n')));
+}
+
+static inline u32 scan_space_mask(const char* block) {
+    __m256i bytes = _mm256_loadu_si256((const __m256i*)block);
+    __m256i space = _mm256_or_si256(_mm256_cmpeq_epi8(bytes, _mm256_set1_epi8(' ')), _mm256_cmpeq_epi8(bytes, _mm256_set1_epi8('\t')));
+    __m256i line = _mm256_or_si256(_mm256_cmpeq_epi8(bytes, _mm256_set1_epi8('\r')), _mm256_cmpeq_epi8(bytes, _mm256_set1_epi8('\n')));
+    return (u32)_mm256_movemask_epi8(_mm256_or_si256(space, line));
+}
+#elif defined(__SSE2__) || defined(_M_X64)
+#include <emmintrin.h>
+#define SCAN_WIDTH 16
+
+static inline u32 scan_newline_mask(const char* block) {
+    __m128i bytes = _mm_loadu_si128((const __m128i*)block);
+    return (u32)_mm_movemask_epi8(_mm_cmpeq_epi8(bytes, _mm_set1_epi8('\n')));
+}
+
+static inline u32 scan_space_mask(const char* block) {
+    __m128i bytes = _mm_loadu_si128((const __m128i*)block);
+    __m128i space = _mm_or_si128(_mm_cmpeq_epi8(bytes, _mm_set1_epi8(' ')), _mm_cmpeq_epi8(bytes, _mm_set1_epi8('\t')));
+    __m128i line = _mm_or_si128(_mm_cmpeq_epi8(bytes, _mm_set1_epi8('\r')), _mm_cmpeq_epi8(bytes, _mm_set1_epi8('\n')));
+    return (u32)_mm_movemask_epi8(_mm_or_si128(space, line));
+}
+#else
+#define SCAN_WIDTH 16
+
+static inline u32 scan_newline_mask(const char* block) {
+    u32 mask = 0;
+    for (int i = 0; i < SCAN_WIDTH; i++) mask |= (u32)(block[i] == '\n') << i;
+    return mask;
+}
+
+static inline u32 scan_space_mask(const char* block) {
+    u32 mask = 0;
+    for (int i = 0; i < SCAN_WIDTH; i++) {
+        char c = block[i];
+        mask |= (u32)(c == ' ' || c == '\t' || c == '\r' || c == '\n') << i;
+    }
+    return mask;
+}
+#endif
+
+#define SCAN_FULL_MASK ((u32)(((u64)1 << SCAN_WIDTH) - 1))
+
+static inline int scan_is_space(char c) {
+    return c == ' ' || c == '\t' || c == '\r' || c == '\n';
+}
+
+const char* scan_line_end(const char* cursor, const char* end) {
+    for (; end - cursor >= SCAN_WIDTH; cursor += SCAN_WIDTH) {
+        u32 mask = scan_newline_mask(cursor);
+        if (mask) return cursor + __builtin_ctz(mask);
+    }
+    while (cursor < end && *cursor != '\n') cursor++;
+    return cursor;
+}
+
+const char* scan_token_end(const char* cursor, const char* end) {
+    for (; end - cursor >= SCAN_WIDTH; cursor += SCAN_WIDTH) {
+        u32 mask = scan_space_mask(cursor);
+        if (mask) return cursor + __builtin_ctz(mask);
+    }
+    while (cursor < end && !scan_is_space(*cursor)) cursor++;
+    return cursor;
+}
+
+size_t scan_count_tokens(const char* cursor, const char* end) {
+    // a token starts on every non-space byte that follows a space (or the start)
+    size_t tokens = 0;
+    u32 previous_space = 1;
+    for (; end - cursor >= SCAN_WIDTH; cursor += SCAN_WIDTH) {
+        u32 space = scan_space_mask(cursor);
+        u32 starts = ~space & ((space << 1) | previous_space) & SCAN_FULL_MASK;
+        tokens += (size_t)__builtin_popcount(starts);
+        previous_space = (space >> (SCAN_WIDTH - 1)) & 1;
+    }
+    for (; cursor < end; cursor++) {
+        u32 space = (u32)scan_is_space(*cursor);
+        tokens += !space && previous_space;
+        previous_space = space;
+    }
+    return tokens;
+}
+
+IOStatus scan_lines(const char* data, size_t size, u32_darray* line_starts) {
+    if (size > UINT32_MAX) return IO_ERROR_MEMORY;
+    if (size == 0) return IO_SUCCESS;
+    if (!da_append(*line_starts, 0)) return IO_ERROR_MEMORY;
+
+    size_t i = 0;
+    for (; i + SCAN_WIDTH <= size; i += SCAN_WIDTH) {
+        u32 mask = scan_newline_mask(data + i);
+        if (!mask) continue;
+        if (!da_grow(*line_starts, line_starts->count + SCAN_WIDTH)) return IO_ERROR_MEMORY;
+        u32* out = line_starts->items + line_starts->count;
+        for (; mask; mask &= mask - 1) *out++ = (u32)(i + (size_t)__builtin_ctz(mask) + 1);
+        line_starts->count = (size_t)(out - line_starts->items);
+    }
+    for (; i < size; i++) {
+        if (data[i] != '\n') continue;
+        if (!da_append(*line_starts, (u32)(i + 1))) return IO_ERROR_MEMORY;
+    }
+
+    // the newline ending the text doesn't start a line
+    if (line_starts->items[line_starts->count - 1] == size) line_starts->count--;
+    return IO_SUCCESS;
+}
@@ -0,0 +1,64 @@
+#pragma once
+#include "common/defines.h"
+#include "common/files.h"
+
+// =============================================================
+// Line and token scanning for text assets
+// =============================================================
+// Newlines and whitespace are searched a whole block at a time: 32 bytes with AVX2,
+// 16 with SSE2, and a scalar loop over the same blocks on other targets. Like the
+// parse functions, everything works on [cursor, end) and the text does not need to be
+// NUL-terminated. Whitespace means ' ', '\t', '\r' and '\n'.
+
+/*
+* @brief Find the end of the current line.
+*
+* @param cursor Start of the text.
+* @param end One past the last readable character.
+* @return The first '\n' at or after cursor, or end if there is none.
+*/
+const char* scan_line_end(const char* cursor, const char* end);
+
+/*
+* @brief Find the end of the current token.
+*
+* @param cursor Start of the text.
+* @param end One past the last readable character.
+* @return The first whitespace character at or after cursor, or end if there is none.
+*/
+const char* scan_token_end(const char* cursor, const char* end);
+
+/*
+* @brief Count the whitespace separated tokens of a range, e.g. the corners of a face.
+*
+* @param cursor Start of the text.
+* @param end One past the last readable character.
+* @return The number of tokens.
+*/
+size_t scan_count_tokens(const char* cursor, const char* end);
+
+/*
+* @brief Build the line offset table of a text in a single pass: the offset from data
+*   of the first character of every line, in order. A '\n' at the very end doesn't
+*   start a new line, so an empty text has no lines.
+*
+* @param data Start of the text.
+* @param size Number of bytes, at most UINT32_MAX.
+* @param line_starts Where to append the offsets.
+* @return IO_SUCCESS, or IO_ERROR_MEMORY if the table can't grow or size is too big.
+*/
+IOStatus scan_lines(const char* data, size_t size, u32_darray* line_starts);
+
+/*
+* @brief End of a line of a table built by scan_lines, without its '\n'.
+*
+* @param data The text given to scan_lines.
+* @param size Its size.
+* @param line_starts The table.
+* @param line Index of the line.
+* @return One past the last character of the line.
+*/
+static inline const char* scan_line_at_end(const char* data, size_t size, const u32_darray* line_starts, size_t line) {
+    if (line + 1 < line_starts->count) return data + line_starts->items[line + 1] - 1;
+    return data + size - (size > 0 && data[size - 1] == '\n');
+}
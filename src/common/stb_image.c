@@ -0,0 +1,4 @@
+// The stb_image implementation, on its own so that the tools can decode images without
+// linking the OpenGL side of texture.c
+#define STB_IMAGE_IMPLEMENTATION
+#include "common/stb_image.h"
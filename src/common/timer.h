@@ -0,0 +1,14 @@
+#pragma once
+#include "common/defines.h"
+#include <time.h>
+
+/*
+* @brief Wall clock time, for measuring how long something takes.
+*
+* @return Seconds since an arbitrary point.
+*/
+static inline f64 timer_now(void) {
+    struct timespec ts;
+    timespec_get(&ts, TIME_UTC);
+    return (f64)ts.tv_sec + (f64)ts.tv_nsec * 1e-9;
+}
@@ -0,0 +1,113 @@
+#define _DEFAULT_SOURCE
+#include "watch.h"
+#include "common/timer.h"
+#include <errno.h>
+#include <stdlib.h>
+#include <string.h>
+#include <sys/inotify.h>
+#include <unistd.h>
+
+// Written in place, or renamed over the old file
+#define WATCH_EVENTS (IN_CLOSE_WRITE | IN_MOVED_TO)
+
+typedef struct {
+    char* path;         // as given to watch_add
+    const char* name;   // last component of path
+    int wd;             // watch of its directory
+    int dirty;
+    f64 changed_at;     // time of the last event
+} WatchedFile;
+
+typedef DARRAY(WatchedFile) watched_file_darray;
+
+struct FileWatch {
+    int fd;
+    watched_file_darray files;
+};
+
+FileWatch* watch_create(void) {
+    FileWatch* w = calloc(1, sizeof(FileWatch));
+    if (!w) return NULL;
+    w->fd = inotify_init1(IN_NONBLOCK | IN_CLOEXEC);
+    if (w->fd < 0) {
+        free(w);
+        return NULL;
+    }
+    return w;
+}
+
+IOStatus watch_add(FileWatch* w, const char* path) {
+    for (size_t i = 0; i < w->files.count; i++) {
+        if (strcmp(w->files.items[i].path, path) == 0) return IO_SUCCESS;
+    }
+    char* copy = strdup(path);
+    if (!copy) return IO_ERROR_MEMORY;
+    const char* slash = strrchr(copy, '/');
+    const char* name = slash ? slash + 1 : copy;
+    int wd;
+    if (!slash) {
+        wd = inotify_add_watch(w->fd, ".", WATCH_EVENTS);
+    } else {
+        // the directory alone, "/" for files at the root
+        size_t dir_len = slash == copy ? 1 : (size_t)(slash - copy);
+        char* dir = strndup(copy, dir_len);
+        wd = dir ? inotify_add_watch(w->fd, dir, WATCH_EVENTS) : -1;
+        free(dir);
+    }
+    // the same directory under another path gets the same watch back
+    if (wd < 0) {
+        free(copy);
+        return IO_ERROR_OPEN;
+    }
+
+    if (!da_append(w->files, ((WatchedFile){ .path = copy, .name = name, .wd = wd }))) {
+        free(copy);
+        return IO_ERROR_MEMORY;
+    }
+    return IO_SUCCESS;
+}
+
+// Mark the files an event is about, all of them if events were lost
+static void watch_mark(FileWatch* w, const struct inotify_event* event, f64 now) {
+    for (size_t i = 0; i < w->files.count; i++) {
+        WatchedFile* file = &w->files.items[i];
+        int lost = (event->mask & IN_Q_OVERFLOW) != 0;
+        if (lost || (file->wd == event->wd && event->len > 0 && strcmp(file->name, event->name) == 0)) {
+            file->dirty = 1;
+            file->changed_at = now;
+        }
+    }
+}
+
+u32 watch_poll(FileWatch* w, const char** changed, u32 max) {
+    f64 now = timer_now();
+    // aligned like the events it receives
+    _Alignas(struct inotify_event) char buffer[4096];
+    for (;;) {
+        ssize_t length = read(w->fd, buffer, sizeof(buffer));
+        if (length < 0 && errno == EINTR) continue;
+        if (length <= 0) break;
+        for (char* p = buffer; p < buffer + length;) {
+            const struct inotify_event* event = (const struct inotify_event*)p;
+            watch_mark(w, event, now);
+            p += sizeof(struct inotify_event) + event->len;
+        }
+    }
+
+    u32 count = 0;
+    for (size_t i = 0; i < w->files.count && count < max; i++) {
+        WatchedFile* file = &w->files.items[i];
+        if (!file->dirty || now - file->changed_at < WATCH_SETTLE_TIME) continue;
+        file->dirty = 0;
+        changed[count++] = file->path;
+    }
+    return count;
+}
+
+void watch_destroy(FileWatch* w) {
+    if (!w) return;
+    close(w->fd);
+    for (size_t i = 0; i < w->files.count; i++) free(w->files.items[i].path);
+    da_free(w->files);
+    free(w);
+}
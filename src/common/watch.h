@@ -0,0 +1,53 @@
+#pragma once
+#include "common/defines.h"
+#include "common/files.h"
+
+// =============================================================
+// File watching
+// =============================================================
+// Reports the files that were modified, for hot reloading, on top of Linux inotify. The
+// directories of the files are watched rather than the files themselves, because most
+// editors save by writing a new file and renaming it over the old one. Saving often
+// means several events in a row (truncate, write, rename...), they are coalesced: a file
+// is reported once, after WATCH_SETTLE_TIME seconds without any new event for it.
+// A watch is used by a single thread.
+
+typedef struct FileWatch FileWatch;
+
+// Quiet time after the last event of a file before it is reported
+#define WATCH_SETTLE_TIME 0.1
+
+/*
+* @brief Create a watch without any file.
+*
+* @return The watch, or NULL if inotify is not available or out of memory.
+*/
+FileWatch* watch_create(void);
+
+/*
+* @brief Watch a file. Adding a path twice does nothing.
+*
+* @param w The watch.
+* @param path Path of the file, copied. Its directory has to exist, the file doesn't.
+* @return IO_SUCCESS, IO_ERROR_OPEN if the directory can't be watched, or IO_ERROR_MEMORY.
+*/
+IOStatus watch_add(FileWatch* w, const char* path);
+
+/*
+* @brief Collect the files changed since the last call, without waiting.
+*
+* @param w The watch.
+* @param changed Set to the paths of the changed files, as they were given to watch_add.
+*   They stay valid until the watch is destroyed.
+* @param max Size of changed, the files that don't fit are reported by the next call.
+* @return The number of paths stored in changed.
+*/
+u32 watch_poll(FileWatch* w, const char** changed, u32 max);
+
+/*
+* @brief Stop watching and release the watch.
+*
+* @param w The watch, can be NULL.
+* @return void
+*/
+void watch_destroy(FileWatch* w);
@@ -2,10 +2,26 @@
 out vec4 FragColor;
 
 in vec3 FragPos;
+in vec2 TexCoord;
+in vec3 Normal;
+
+// material of the submesh being drawn, without one the color comes from the position
+uniform bool hasMaterial;
+uniform vec3 diffuseColor;
+uniform bool hasTexture;
+uniform sampler2D diffuseTexture;
 
 void main()
 {
     // Simple shading based on position to give some visual depth
     vec3 color = normalize(FragPos) * 0.5 + 0.5;
+    if (hasMaterial) {
+        color = diffuseColor;
+        // .obj texture coordinates start at the bottom, images are loaded top row first
+        if (hasTexture) color *= texture(diffuseTexture, vec2(TexCoord.x, 1.0 - TexCoord.y)).rgb;
+    }
+    // plus a fixed directional light
+    float diffuse = max(dot(normalize(Normal), normalize(vec3(0.5, 1.0, 0.8))), 0.0);
+    color *= 0.3 + 0.7 * diffuse;
     FragColor = vec4(color, 1.0f);
 }
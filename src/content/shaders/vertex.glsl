@@ -1,14 +1,50 @@
 #version 460 core
-layout (location = 0) in vec3 aPos;
+layout (location = 0) in vec3 aPos;         // unorm16, relative to the mesh bounds
+layout (location = 1) in vec2 aTexCoord;    // half floats
+layout (location = 2) in vec2 aNormal;      // snorm16, octahedral encoding
+layout (location = 3) in uint aTangent;     // angle around the normal and bitangent sign
 
 out vec3 FragPos;
+out vec2 TexCoord;
+out vec3 Normal;
+out vec4 Tangent;                           // w is the sign of the bitangent
 
 uniform mat4 model;
 uniform mat4 view;
 uniform mat4 projection;
+// dequantization of the positions: offset + aPos * scale
+uniform vec3 positionOffset;
+uniform vec3 positionScale;
+
+vec3 decode_octahedral(vec2 e)
+{
+    vec3 n = vec3(e, 1.0 - abs(e.x) - abs(e.y));
+    float t = max(-n.z, 0.0);
+    n.x += n.x >= 0.0 ? -t : t;
+    n.y += n.y >= 0.0 ? -t : t;
+    return normalize(n);
+}
+
+// Same basis as tangent_basis in model/model_pack.c
+vec4 decode_tangent(vec3 n, uint e)
+{
+    float s = n.z >= 0.0 ? 1.0 : -1.0;
+    float a = -1.0 / (s + n.z);
+    float b = n.x * n.y * a;
+    vec3 b1 = vec3(1.0 + s * n.x * n.x * a, s * b, -s * n.x);
+    vec3 b2 = vec3(b, s + n.y * n.y * a, -n.y);
+    float angle = (float(e & 0x7FFFu) / 32767.0 - 0.5) * 6.28318531;
+    return vec4(cos(angle) * b1 + sin(angle) * b2, (e & 0x8000u) != 0u ? -1.0 : 1.0);
+}
 
 void main()
 {
-    gl_Position = projection * view * model * vec4(aPos, 1.0);
-    FragPos = aPos;
+    vec3 position = positionOffset + aPos * positionScale;
+    gl_Position = projection * view * model * vec4(position, 1.0);
+    FragPos = position;
+    TexCoord = aTexCoord;
+    vec3 normal = decode_octahedral(aNormal);
+    vec4 tangent = decode_tangent(normal, aTangent);
+    Normal = mat3(model) * normal;
+    Tangent = vec4(mat3(model) * tangent.xyz, tangent.w);
 }
@@ -1,17 +1,32 @@
 #include "shader/shader.h"
+#include <stddef.h>
+#include <stdint.h>
+#include <stdlib.h>
 #include <stdio.h>
+#include <string.h>
 
 #define GL_GLEXT_PROTOTYPES
 #include <GLFW/glfw3.h>
 #include <GL/gl.h>
 #include <GL/glext.h>
 
+#include "common/aio.h"
+#include "common/arena.h"
 #include "common/defines.h"
+#include "common/pak.h"
+#include "common/pool.h"
+#include "common/watch.h"
 #include "math/linalg.h"
 #include "math/math.h"
 //#include "camera/camera.h"
 #include "texture/texture.h"
+#include "texture/texture_cooked.h"
 #include "model/model.h"
+#include "model/model_material.h"
+#include "model/model_meshlet.h"
+#include "model/model_cache.h"
+#include "model/model_pack.h"
+#include "model/model_simplify.h"
 
 
 void processInput(GLFWwindow* window);
@@ -19,6 +34,26 @@ void framebuffer_size_callback(GLFWwindow* window, int width, int height);
 void mouse_callback(GLFWwindow* window, f64 xpos, f64 ypos);
 void scroll_callback(GLFWwindow* window, f64 xoffset, f64 yoffset);
 
+// A texture of a model, in texture_pool
+typedef struct {
+    u32 id;                     // GL texture, 0 until its image is read
+    const char* name;           // diffuse map it comes from, in the materials of its model
+} SceneTexture;
+
+// A model ready to draw: its buffers and its textures
+typedef struct {
+    PackedMesh mesh;
+    u32 VAO, VBO, EBO;
+    u32 index_type;
+    Handle* material_textures;  // diffuse texture of every material, HANDLE_NONE if it has none
+} SceneModel;
+
+IOStatus scene_model_load(SceneModel* scene, const char* path, u32 flags);
+void scene_model_free(SceneModel* scene);
+void scene_model_watch(const SceneModel* scene, const char* source_path, path_darray* libraries, FileWatch* watch);
+void shader_watch_includes(const char* const* sources, u32 count, path_darray* includes, FileWatch* watch);
+void content_source_path(char* out, size_t out_size, const char* name);
+
 vec3 cameraPos   = (vec3){{0.0f, 0.0f,  3.0f}};
 vec3 cameraFront = (vec3){{0.0f, 0.0f, -1.0f}};
 vec3 cameraUp    = (vec3){{0.0f, 1.0f,  0.0f}};
@@ -30,6 +65,30 @@ float lastX =  800.0f / 2.0;
 float lastY =  600.0 / 2.0;
 float fov   =  45.0f;
 
+// The GL objects are referenced by handle (see common/pool.h). Reloading one replaces the
+// object behind its handle, and a texture read that completes after its model was released
+// finds its handle stale instead of writing to a reused record.
+Pool texture_pool;  // SceneTexture
+Pool program_pool;  // u32 GL shader program
+Pool model_pool;    // SceneModel
+
+// textures read asynchronously: the user pointer of a request is the handle of its texture
+#define ASSET_COMPLETIONS_PER_FRAME 16
+// changed sources handled per frame, the next ones wait for the next frames
+#define ASSET_CHANGES_PER_FRAME 16
+// address space of the frame arena, where the data that only lives for one frame goes
+#define FRAME_ARENA_SIZE ((size_t)1 << 28)
+
+// where the sources of content.pak are (set by meson): they are watched, and the assets are
+// rebuilt from them when they change
+#ifndef TIRO_CONTENT_DIR
+#define TIRO_CONTENT_DIR "../src/content"
+#endif
+#define VERTEX_SHADER "shaders/vertex.glsl"
+#define FRAGMENT_SHADER "shaders/fragment.glsl"
+#define SCENE_MODEL "models/diablo3_pose.obj"
+#define SCENE_MODEL_FLAGS (MODEL_LOAD_OPTIMIZE | MODEL_LOAD_LODS | MODEL_LOAD_MESHLETS | MODEL_LOAD_TANGENTS)
+
 // timing
 float deltaTime = 0.0f;	// time between current frame and last frame
 float lastFrame = 0.0f;
@@ -57,31 +116,105 @@ int main()
     // Enable depth testing
     glEnable(GL_DEPTH_TEST);
 
-    u32 shader_id = shader_new("../src/content/shaders/vertex.glsl", "../src/content/shaders/fragment.glsl");
+    // the assets come from content.pak, built next to the executable (see common/pak.h): once
+    // it is mounted the loaders get views into it, whatever the working directory
+    char exe_path[4096];
+    char pak_path[4096] = "content.pak";
+    Pak content;
+    if (file_executable_path(exe_path, sizeof(exe_path)) != IO_SUCCESS ||
+        file_sibling_path(pak_path, sizeof(pak_path), exe_path, "content.pak") != IO_SUCCESS ||
+        pak_open(&content, pak_path) != IO_SUCCESS) {
+        printf("ERROR: Failed to open the content archive %s\n", pak_path);
+        glfwTerminate();
+        return -1;
+    }
+    pak_mount(&content);
+
+    // the program is replaced behind its handle when the shaders are reloaded
+    Handle program = HANDLE_NONE;
+    u32* program_id = NULL;
+    if (pool_create_for(&texture_pool, SceneTexture) != IO_SUCCESS || pool_create_for(&program_pool, u32) != IO_SUCCESS ||
+        pool_create_for(&model_pool, SceneModel) != IO_SUCCESS || !(program_id = pool_alloc(&program_pool, &program))) {
+        printf("ERROR: Out of memory\n");
+        pak_close(&content);
+        glfwTerminate();
+        return -1;
+    }
+    *program_id = shader_new(VERTEX_SHADER, FRAGMENT_SHADER);
+
+    // textures that aren't in the archive are read in the background and used by the
+    // render loop as they arrive (see common/aio.h)
+    AioQueue* io = aio_create(0);
+    if (!io) {
+        printf("ERROR: Out of memory\n");
+        pak_close(&content);
+        glfwTerminate();
+        return -1;
+    }
 
-    // Load model from OBJ file
-    Model model = {0};
-    if (model_from_obj("../src/content/models/diablo3_pose.obj", &model) != IO_SUCCESS) {
+    // Load model from the archive
+    Handle scene_handle;
+    SceneModel* scene = pool_alloc(&model_pool, &scene_handle);
+    if (!scene || scene_model_load(scene, SCENE_MODEL, SCENE_MODEL_FLAGS) != IO_SUCCESS) {
         printf("ERROR: Failed to load model\n");
+        aio_destroy(io);
+        pak_close(&content);
         glfwTerminate();
         return -1;
     }
-    printf("Loaded model with %zu vertices\n", model.verts.count);
 
-    u32 VAO, VBO;
-    glGenVertexArrays(1, &VAO);
-    glGenBuffers(1, &VBO);
-    // bind the Vertex Array Object first, then bind and set vertex buffer(s), and then configure vertex attributes(s).
-    glBindVertexArray(VAO);
+    AioRequest* texture_requests = malloc((scene->mesh.material_count + 1) * sizeof(AioRequest));
+    if (!texture_requests) {
+        printf("ERROR: Out of memory\n");
+        scene_model_free(scene);
+        aio_destroy(io);
+        pak_close(&content);
+        glfwTerminate();
+        return -1;
+    }
+    // the cooked textures are already in memory, the others are read in one batch and their
+    // materials are drawn with their color until the texture arrives
+    u32 texture_request_count = 0;
+    char cooked_name[MODEL_PATH_SIZE + sizeof(TEXTURE_COOKED_EXTENSION)];
+    for (size_t i = 0; i < scene->mesh.material_count; i++) {
+        SceneTexture* texture = pool_get(&texture_pool, scene->material_textures[i]);
+        if (!texture) continue;
+        string_t packed;
+        snprintf(cooked_name, sizeof(cooked_name), "%s%s", texture->name, TEXTURE_COOKED_EXTENSION);
+        if (pak_find(&content, cooked_name, &packed) == IO_SUCCESS) {
+            texture->id = texture_generate_from_memory((const u8*)packed.data, packed.size);
+        } else {
+            texture_requests[texture_request_count++] = (AioRequest){ texture->name, (void*)(uintptr_t)scene->material_textures[i] };
+        }
+    }
+    if (aio_submit(io, texture_requests, texture_request_count) != IO_SUCCESS) printf("ERROR: Failed to queue the textures\n");
+    free(texture_requests);
 
-    glBindBuffer(GL_ARRAY_BUFFER, VBO);
-    glBufferData(GL_ARRAY_BUFFER, model.verts.count * sizeof(f32), model.verts.items, GL_STATIC_DRAW);
+    // hot reloading: the sources of the assets are watched (see common/watch.h)
+    const char* shader_sources[] = { TIRO_CONTENT_DIR "/" VERTEX_SHADER, TIRO_CONTENT_DIR "/" FRAGMENT_SHADER };
+    const char* model_source = TIRO_CONTENT_DIR "/" SCENE_MODEL;
+    char texture_source[sizeof(TIRO_CONTENT_DIR) + MODEL_PATH_SIZE];
+    path_darray shader_includes = {0};
+    path_darray model_libraries = {0};
+    FileWatch* watch = watch_create();
+    if (watch) {
+        watch_add(watch, shader_sources[0]);
+        watch_add(watch, shader_sources[1]);
+        watch_add(watch, model_source);
+        shader_watch_includes(shader_sources, 2, &shader_includes, watch);
+        scene_model_watch(scene, model_source, &model_libraries, watch);
+    } else {
+        printf("WARNING: Files can't be watched, no hot reloading\n");
+    }
 
-    // position attribute (only positions for now - 3 floats per vertex)
-    glVertexAttribPointer(0, 3, GL_FLOAT, GL_FALSE, 3 * sizeof(float), (void*)0);
-    glEnableVertexAttribArray(0);
+    // reset at the start of every frame. Without it the meshlets are not culled
+    Arena frame;
+    if (arena_create(&frame, FRAME_ARENA_SIZE) != IO_SUCCESS) printf("WARNING: No frame arena, the meshlets won't be culled\n");
 
     while(!glfwWindowShouldClose(window)) {
+        arena_reset(&frame);
+        // the model stays in the same record when it is reloaded
+        scene = pool_get(&model_pool, scene_handle);
         // per-frame time logic
         f32 current_frame = (f32)glfwGetTime();
         deltaTime = current_frame - lastFrame;
@@ -90,12 +223,81 @@ int main()
         // -----
         processInput(window);
 
+        // textures whose read finished since the last frame
+        AioCompletion completions[ASSET_COMPLETIONS_PER_FRAME];
+        u32 completion_count = aio_poll(io, completions, ASSET_COMPLETIONS_PER_FRAME);
+        for (u32 i = 0; i < completion_count; i++) {
+            // a stale handle: the model was reloaded while the image was read
+            SceneTexture* texture = pool_get(&texture_pool, (Handle)(uintptr_t)completions[i].user);
+            if (texture && completions[i].status == IO_SUCCESS) {
+                texture->id = texture_generate_from_memory((const u8*)completions[i].data.data, completions[i].data.size);
+            } else if (texture) {
+                printf("ERROR: Failed to read texture %s\n", texture->name);
+            }
+            free(completions[i].data.data);
+        }
+
+        // sources edited since the last frame: only the assets they affect are rebuilt, and
+        // swapped in once complete, before anything is drawn. If that fails the old one stays.
+        const char* changes[ASSET_CHANGES_PER_FRAME];
+        u32 change_count = watch ? watch_poll(watch, changes, ASSET_CHANGES_PER_FRAME) : 0;
+        for (u32 c = 0; c < change_count; c++) {
+            int shader_changed = strcmp(changes[c], shader_sources[0]) == 0 || strcmp(changes[c], shader_sources[1]) == 0;
+            for (size_t i = 0; i < shader_includes.count && !shader_changed; i++) {
+                shader_changed = strcmp(changes[c], shader_includes.items[i]) == 0;
+            }
+            if (shader_changed) {
+                // the includes can change too, the new ones are watched as well
+                u32 reloaded = shader_new_with_includes(shader_sources[0], shader_sources[1], &shader_includes);
+                for (size_t i = 0; i < shader_includes.count; i++) watch_add(watch, shader_includes.items[i]);
+                if (!reloaded) continue;
+                program_id = pool_get(&program_pool, program);
+                glDeleteProgram(*program_id);
+                *program_id = reloaded;
+                printf("Reloaded the shaders\n");
+                continue;
+            }
+            // its materials are read from the libraries, they are imported again with it
+            int model_changed = strcmp(changes[c], model_source) == 0;
+            for (size_t i = 0; i < model_libraries.count && !model_changed; i++) {
+                model_changed = strcmp(changes[c], model_libraries.items[i]) == 0;
+            }
+            if (model_changed) {
+                SceneModel reloaded;
+                if (scene_model_load(&reloaded, model_source, SCENE_MODEL_FLAGS | MODEL_LOAD_NO_CACHE) != IO_SUCCESS) continue;
+                // the textures still being read are for the old materials, their handles
+                // are stale once it is released and they are dropped when they arrive
+                for (size_t i = 0; i < reloaded.mesh.material_count; i++) {
+                    SceneTexture* texture = pool_get(&texture_pool, reloaded.material_textures[i]);
+                    if (texture) texture->id = texture_generate(texture->name);
+                }
+                scene_model_free(scene);
+                *scene = reloaded;
+                scene_model_watch(scene, model_source, &model_libraries, watch);
+                printf("Reloaded %s\n", model_source);
+            } else {
+                // a texture, of as many materials as use it
+                for (size_t i = 0; i < scene->mesh.material_count; i++) {
+                    SceneTexture* texture = pool_get(&texture_pool, scene->material_textures[i]);
+                    if (!texture) continue;
+                    content_source_path(texture_source, sizeof(texture_source), texture->name);
+                    if (strcmp(texture_source, changes[c]) != 0) continue;
+                    u32 reloaded = texture_generate(texture_source);
+                    if (!reloaded) continue;
+                    if (texture->id) glDeleteTextures(1, &texture->id);
+                    texture->id = reloaded;
+                    printf("Reloaded %s\n", texture_source);
+                }
+            }
+        }
+
         // render
         // ------
         glClearColor(0.1f, 0.1f, 0.1f, 1.0f);
         glClear(GL_COLOR_BUFFER_BIT | GL_DEPTH_BUFFER_BIT);
         
         // activate shader
+        u32 shader_id = *(const u32*)pool_get(&program_pool, program);
         shader_use(shader_id);
         // projection matrix
         mat4 projection = mat4_perspective(radians(fov), (f32)WINDOW_WIDTH / (f32)WINDOW_HEIGHT, 0.1f, 100.0f);
@@ -106,23 +308,205 @@ int main()
         // model matrix
         mat4 model_matrix = mat4_identity();
         shader_set_mat4(shader_id, "model", model_matrix);
-        // draw the model
-        glBindVertexArray(VAO);
-        glDrawArrays(GL_TRIANGLES, 0, (GLsizei)(model.verts.count / 3));
+        shader_set_vec3(shader_id, "positionOffset", scene->mesh.position_offset);
+        shader_set_vec3(shader_id, "positionScale", scene->mesh.position_scale);
+        // draw the coarsest level of detail that still looks the same from here
+        f32 distance = vec3_length(vec3_sub(scene->mesh.bounds.center, cameraPos));
+        u32 lod = model_select_lod(scene->mesh.lods, scene->mesh.lod_count, distance, radians(fov), (f32)WINDOW_HEIGHT, MODEL_LOD_PIXEL_ERROR);
+        glBindVertexArray(scene->VAO);
+        shader_set_int(shader_id, "diffuseTexture", 0);
+        for (size_t s = 0; s < scene->mesh.submesh_count; s++) {
+            const Submesh* submesh = &scene->mesh.submeshes[s];
+            // submeshes are sorted by material, it only has to be set when it changes
+            if (s == 0 || submesh->material != scene->mesh.submeshes[s - 1].material) {
+                const Material* material = submesh->material != MODEL_NO_MATERIAL ? &scene->mesh.materials[submesh->material] : NULL;
+                const SceneTexture* texture = material ? pool_get(&texture_pool, scene->material_textures[submesh->material]) : NULL;
+                u32 texture_id = texture ? texture->id : 0;
+                shader_set_int(shader_id, "hasMaterial", material != NULL);
+                shader_set_int(shader_id, "hasTexture", texture_id != 0);
+                if (material) shader_set_vec3(shader_id, "diffuseColor", material->diffuse);
+                if (texture_id) texture_bind(texture_id, 0);
+            }
+
+            // culling output: the visible meshlets, merged in ranges of the index buffer
+            u32* visible = NULL;
+            GLsizei* draw_counts = NULL;
+            const void** draw_offsets = NULL;
+            if (lod == 0 && submesh->meshlet_count > 0) {
+                visible = arena_push(&frame, u32, submesh->meshlet_count);
+                draw_counts = arena_push(&frame, GLsizei, submesh->meshlet_count);
+                draw_offsets = arena_push(&frame, const void*, submesh->meshlet_count);
+            }
+            if (visible && draw_counts && draw_offsets) {
+                // only the meshlets in view and facing the camera, neighbours in the buffer are drawn as one range
+                const Meshlet* meshlets = scene->mesh.meshlets + submesh->meshlet_offset;
+                u32 visible_count = meshlet_cull(meshlets, submesh->meshlet_count, mat4_mul(view, projection), cameraPos, visible);
+                GLsizei draw_count = 0;
+                for (u32 i = 0; i < visible_count; i++) {
+                    const Meshlet* meshlet = &meshlets[visible[i]];
+                    size_t offset = (size_t)meshlet->index_offset * scene->mesh.index_size;
+                    if (draw_count > 0 && (size_t)draw_offsets[draw_count - 1] + (size_t)draw_counts[draw_count - 1] * scene->mesh.index_size == offset) {
+                        draw_counts[draw_count - 1] += (GLsizei)meshlet->triangle_count * 3;
+                    } else {
+                        draw_offsets[draw_count] = (const void*)offset;
+                        draw_counts[draw_count++] = (GLsizei)meshlet->triangle_count * 3;
+                    }
+                }
+                if (draw_count > 0) glMultiDrawElements(GL_TRIANGLES, draw_counts, scene->index_type, draw_offsets, draw_count);
+            } else if (submesh->lods[lod].index_count > 0) {
+                glDrawElements(GL_TRIANGLES, (GLsizei)submesh->lods[lod].index_count, scene->index_type,
+                               (void*)((size_t)submesh->lods[lod].index_offset * scene->mesh.index_size));
+            }
+        }
 
         glfwSwapBuffers(window);
         glfwPollEvents();
     }
 
     // Cleanup
-    glDeleteVertexArrays(1, &VAO);
-    glDeleteBuffers(1, &VBO);
-    da_free(model.verts);
+    arena_destroy(&frame);
+    watch_destroy(watch);
+    path_darray_free(&shader_includes);
+    path_darray_free(&model_libraries);
+    aio_destroy(io);
+    scene_model_free(scene);
+    pool_free(&model_pool, scene_handle);
+    glDeleteProgram(*(const u32*)pool_get(&program_pool, program));
+    pool_destroy(&model_pool);
+    pool_destroy(&program_pool);
+    pool_destroy(&texture_pool);
+    pak_close(&content);
 
     glfwTerminate();
     return 0;
 }
 
+// load a model, compress it for the GPU and upload it. A model cooked by tiro-cook is used
+// straight from the archive, otherwise it is loaded with model_load_packed. The textures
+// are left to the caller, all the materials start without one
+// -----------------------------------------------------------------------------------------
+IOStatus scene_model_load(SceneModel* scene, const char* path, u32 flags)
+{
+    *scene = (SceneModel){0};
+    PackedMesh* mesh = &scene->mesh;
+    char cooked_name[MODEL_PATH_SIZE + sizeof(PACKED_MESH_EXTENSION)];
+    string_t cooked;
+    snprintf(cooked_name, sizeof(cooked_name), "%s%s", path, PACKED_MESH_EXTENSION);
+    if (pak_mounted_find(cooked_name, &cooked) == IO_SUCCESS) {
+        IO_CHECK(packed_mesh_from_memory(cooked.data, cooked.size, mesh));
+    } else {
+        // compressed for the GPU, the full precision model is not kept
+        IO_CHECK(model_load_packed(path, mesh, flags));
+    }
+    printf("Loaded model with %zu vertices and %u triangles\n", mesh->vertex_count, mesh->lods[0].index_count / 3);
+    for (u32 i = 1; i < mesh->lod_count; i++) {
+        printf("  LOD %u: %u triangles, error %f\n", i, mesh->lods[i].index_count / 3, mesh->lods[i].error);
+    }
+    printf("  %zu meshlets\n", mesh->meshlet_count);
+    printf("  %zu submeshes, %zu materials\n", mesh->submesh_count, mesh->material_count);
+    scene->index_type = mesh->index_size == sizeof(u16) ? GL_UNSIGNED_SHORT : GL_UNSIGNED_INT;
+
+    // a texture handle for every material with a diffuse map, without a texture yet
+    scene->material_textures = calloc(mesh->material_count + 1, sizeof(Handle));
+    if (!scene->material_textures) {
+        scene_model_free(scene);
+        return IO_ERROR_MEMORY;
+    }
+    for (size_t i = 0; i < mesh->material_count; i++) {
+        if (!mesh->materials[i].diffuse_map[0]) continue;
+        SceneTexture* texture = pool_alloc(&texture_pool, &scene->material_textures[i]);
+        if (!texture) {
+            scene_model_free(scene);
+            return IO_ERROR_MEMORY;
+        }
+        texture->name = mesh->materials[i].diffuse_map;
+    }
+
+    glGenVertexArrays(1, &scene->VAO);
+    glGenBuffers(1, &scene->VBO);
+    glGenBuffers(1, &scene->EBO);
+    // bind the Vertex Array Object first, then bind and set vertex buffer(s), and then configure vertex attributes(s).
+    glBindVertexArray(scene->VAO);
+
+    // immutable storage: the data is never updated, and when the model was cooked the driver
+    // reads it straight from the mapped archive
+    glBindBuffer(GL_ARRAY_BUFFER, scene->VBO);
+    glBufferStorage(GL_ARRAY_BUFFER, mesh->vertex_count * sizeof(PackedVertex), mesh->verts, 0);
+
+    // the element buffer binding is stored in the VAO, so it has to be bound while the VAO is
+    glBindBuffer(GL_ELEMENT_ARRAY_BUFFER, scene->EBO);
+    glBufferStorage(GL_ELEMENT_ARRAY_BUFFER, mesh->index_count * mesh->index_size, mesh->indices, 0);
+
+    // interleaved packed vertex attributes (see model/model_pack.h): position, uv, normal and tangent
+    glVertexAttribPointer(0, 3, GL_UNSIGNED_SHORT, GL_TRUE, sizeof(PackedVertex), (void*)offsetof(PackedVertex, position));
+    glEnableVertexAttribArray(0);
+    glVertexAttribPointer(1, 2, GL_HALF_FLOAT, GL_FALSE, sizeof(PackedVertex), (void*)offsetof(PackedVertex, uv));
+    glEnableVertexAttribArray(1);
+    glVertexAttribPointer(2, 2, GL_SHORT, GL_TRUE, sizeof(PackedVertex), (void*)offsetof(PackedVertex, normal));
+    glEnableVertexAttribArray(2);
+    glVertexAttribIPointer(3, 1, GL_UNSIGNED_SHORT, sizeof(PackedVertex), (void*)(offsetof(PackedVertex, position) + 3 * sizeof(u16)));
+    glEnableVertexAttribArray(3);
+    glBindVertexArray(0);
+    return IO_SUCCESS;
+}
+
+// release the buffers, the textures and the mesh of a model
+// ---------------------------------------------------------
+void scene_model_free(SceneModel* scene)
+{
+    if (scene->VAO) glDeleteVertexArrays(1, &scene->VAO);
+    if (scene->VBO) glDeleteBuffers(1, &scene->VBO);
+    if (scene->EBO) glDeleteBuffers(1, &scene->EBO);
+    for (size_t i = 0; scene->material_textures && i < scene->mesh.material_count; i++) {
+        SceneTexture* texture = pool_get(&texture_pool, scene->material_textures[i]);
+        if (texture && texture->id) glDeleteTextures(1, &texture->id);
+        pool_free(&texture_pool, scene->material_textures[i]);
+    }
+    free(scene->material_textures);
+    packed_mesh_free(&scene->mesh);
+    *scene = (SceneModel){0};
+}
+
+// watch the material libraries of a model, listed in libraries, and the sources of its
+// textures. Adding them again does nothing
+// ------------------------------------------------------------------------------------
+void scene_model_watch(const SceneModel* scene, const char* source_path, path_darray* libraries, FileWatch* watch)
+{
+    if (watch && material_library_paths(source_path, libraries) != IO_SUCCESS) {
+        printf("WARNING: Failed to list the material libraries of %s\n", source_path);
+    }
+    for (size_t i = 0; watch && i < libraries->count; i++) watch_add(watch, libraries->items[i]);
+    char source[sizeof(TIRO_CONTENT_DIR) + MODEL_PATH_SIZE];
+    for (size_t i = 0; watch && i < scene->mesh.material_count; i++) {
+        if (!scene->mesh.materials[i].diffuse_map[0]) continue;
+        content_source_path(source, sizeof(source), scene->mesh.materials[i].diffuse_map);
+        watch_add(watch, source);
+    }
+}
+
+// watch the files the shader sources include, and list them in includes
+// ----------------------------------------------------------------------
+void shader_watch_includes(const char* const* sources, u32 count, path_darray* includes, FileWatch* watch)
+{
+    for (u32 i = 0; i < count; i++) {
+        string_t text;
+        if (shader_source_load(sources[i], &text, includes) == IO_SUCCESS) free(text.data);
+    }
+    for (size_t i = 0; i < includes->count; i++) watch_add(watch, includes->items[i]);
+}
+
+// path of the source of an asset from its name in the archive. Names that are already
+// paths (the textures of a model reloaded from its source) are kept as they are
+// -----------------------------------------------------------------------------------
+void content_source_path(char* out, size_t out_size, const char* name)
+{
+    if (name[0] == '/' || strncmp(name, TIRO_CONTENT_DIR "/", sizeof(TIRO_CONTENT_DIR)) == 0) {
+        snprintf(out, out_size, "%s", name);
+    } else {
+        snprintf(out, out_size, "%s/%s", TIRO_CONTENT_DIR, name);
+    }
+}
+
 // process all input: query GLFW whether relevant keys are pressed/released this frame and react accordingly
 // ---------------------------------------------------------------------------------------------------------
 void processInput(GLFWwindow *window)
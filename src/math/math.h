@@ -1,7 +1,39 @@
 #pragma once
 
 #include "common/defines.h"
+#include <string.h>
 
 #define PI 3.14159265358979323846
 
 static inline f32 radians(f32 degrees) { return degrees * (f32)PI / 180.0f; }
+
+// Convert a float to an IEEE half float (as its bit pattern), rounding to nearest even.
+// Values too large for a half become infinity, NaN stays NaN.
+static inline u16 f32_to_half(f32 value) {
+    const u32 f32_infinity = 255u << 23;
+    const u32 f16_overflow = (127u + 16u) << 23;                // 65536: first value that can't round to a finite half
+    const u32 denormal_magic = ((127u - 15u) + (23u - 10u) + 1u) << 23;
+    u32 bits;
+    memcpy(&bits, &value, sizeof(bits));
+    u32 sign = bits & 0x80000000u;
+    bits ^= sign;
+
+    u16 half;
+    if (bits >= f16_overflow) {
+        half = bits > f32_infinity ? 0x7E00 : 0x7C00;
+    } else if (bits < (113u << 23)) {
+        // result is a half denormal: let the float addition do the rounding
+        f32 f, magic;
+        memcpy(&f, &bits, sizeof(f));
+        memcpy(&magic, &denormal_magic, sizeof(magic));
+        f += magic;
+        memcpy(&bits, &f, sizeof(bits));
+        half = (u16)(bits - denormal_magic);
+    } else {
+        u32 mantissa_odd = (bits >> 13) & 1;
+        bits += ((u32)(15 - 127) << 23) + 0xFFF;    // rebias the exponent and round
+        bits += mantissa_odd;                       // ties to even
+        half = (u16)(bits >> 13);
+    }
+    return half | (u16)(sign >> 16);
+}
@@ -1,72 +1,868 @@
 #include "model.h"
+#include "common/arena.h"
 #include "common/defines.h"
 #include "common/files.h"
+#include "common/jobs.h"
+#include "common/parse.h"
+#include "common/scan.h"
+#include "common/timer.h"
+#include "model/model_binary.h"
+#include "model/model_bounds.h"
+#include "model/model_material.h"
+#include "model/model_meshlet.h"
+#include "model/model_normals.h"
+#include "model/model_optimize.h"
+#include "model/model_simplify.h"
+#include <ctype.h>
 #include <stdio.h>
 #include <stdlib.h>
+#include <string.h>
+#include <sys/stat.h>
 
-IOStatus model_from_obj(const char* file_path, Model* m) {
-    string_t file_content;
-    IO_CHECK(file_read_all(&file_content, file_path));
-    
-    char* cursor = file_content.data;
-    f32_darray vertices = {0};
-    u32_darray faces = {0};
-
-    while (*cursor) {
-        if (*cursor == '\n' || *cursor == '\r' || *cursor == ' ') {
-            cursor++;
-            continue;
+// Smallest piece of file worth handing to its own thread
+#define OBJ_MIN_CHUNK_SIZE (256 * 1024)
+// Biggest one, the line offset table of a chunk is 32-bit
+#define OBJ_MAX_CHUNK_SIZE (1ull << 30)
+// Files bigger than this are streamed instead of being read in memory all at once
+#define OBJ_STREAM_THRESHOLD (512ull * 1024 * 1024)
+// Size of each of the two buffers used when streaming
+#define OBJ_STREAM_WINDOW (4 * 1024 * 1024)
+
+// Triangle ratios of the levels of detail generated by model_load
+static const f32 MODEL_LOD_RATIOS[] = { 0.5f, 0.25f, 0.125f };
+
+// A face corner as written in the .obj file ("v", "v/vt", "v//vn" or "v/vt/vn"),
+// already converted to 0-based indices. Missing components are stored as -1.
+typedef struct {
+    i32 v, vt, vn;
+} ObjIndex;
+
+typedef DARRAY(ObjIndex) obj_index_darray;
+
+// Which components of a corner were written as negative (relative) indices
+#define OBJ_RELATIVE_V  0x1
+#define OBJ_RELATIVE_VT 0x2
+#define OBJ_RELATIVE_VN 0x4
+
+// A corner whose relative indices were resolved against the records of its own chunk
+// only, they still have to be shifted by the records of all the chunks before it.
+typedef struct {
+    size_t corner;  // position in ObjParseState.corners
+    u8 mask;        // OBJ_RELATIVE_* flags
+} ObjRelativeCorner;
+
+typedef DARRAY(ObjRelativeCorner) obj_relative_darray;
+
+// Records that change how the faces after them are grouped
+typedef enum {
+    OBJ_EVENT_MATERIAL,     // usemtl
+    OBJ_EVENT_GROUP,        // o or g
+    OBJ_EVENT_LIBRARY,      // mtllib
+} ObjEventKind;
+
+// Copied out of the line because the text doesn't outlive the chunk when streaming
+typedef struct {
+    size_t corner;                  // corners of the chunk before the record
+    ObjEventKind kind;
+    char name[MODEL_PATH_SIZE];
+} ObjEvent;
+
+typedef DARRAY(ObjEvent) obj_event_darray;
+
+// Records found by the counting pass, used to size every array exactly once
+typedef struct {
+    size_t v, vt, vn;
+    size_t corners;     // 3 per triangle once the faces are triangulated
+    size_t relative;    // corners that use relative indices
+} ObjCounts;
+
+// Parse state of a range of lines, record counts are local to the range
+typedef struct {
+    // record data, each points inside the arrays shared by all chunks
+    f32* positions;                 // 3 floats per "v" record
+    f32* uvs;                       // 2 floats per "vt" record
+    f32* normals;                   // 3 floats per "vn" record
+    size_t v_count;
+    size_t vt_count;
+    size_t vn_count;
+    obj_index_darray corners;       // 3 corners per triangle
+    obj_relative_darray relative;   // corners that need fixing up once the chunks are merged
+    obj_event_darray events;        // grouping records, in file order
+    int failed;                     // an array couldn't grow
+} ObjParseState;
+
+// A piece of the file, always starting at the beginning of a line, counted then parsed by one job
+typedef struct {
+    const char* begin;
+    const char* end;
+    u32_darray lines;   // line offset table, found by the counting pass and reused by the parse pass
+    int failed;         // the line table couldn't be built
+    ObjCounts counts;
+    ObjParseState state;
+} ObjChunk;
+
+// Resolve a 1-based (or negative, relative to the end) obj index to a 0-based one.
+static i32 obj_resolve_index(i64 index, size_t count) {
+    if (index > 0) return (i32)(index - 1);
+    if (index < 0) return (i32)((i64)count + index);
+    return -1;
+}
+
+// Parse one "v/vt/vn" corner starting at cursor, returns the pointer right after it.
+// The components written as relative indices are flagged in *relative.
+static const char* obj_parse_corner(const char* cursor, const char* end, ObjIndex* out, u8* relative, const ObjParseState* state) {
+    i64 index = 0;
+    out->vt = -1;
+    out->vn = -1;
+    *relative = 0;
+    const char* p = parse_i64(cursor, end, &index);
+    if (p == cursor) return cursor;
+    out->v = obj_resolve_index(index, state->v_count);
+    if (index < 0) *relative |= OBJ_RELATIVE_V;
+
+    if (p < end && *p == '/') {
+        p++;
+        const char* q = parse_i64(p, end, &index);
+        if (q != p) {
+            out->vt = obj_resolve_index(index, state->vt_count);
+            if (index < 0) *relative |= OBJ_RELATIVE_VT;
+        }
+        p = q;
+        if (p < end && *p == '/') {
+            p++;
+            q = parse_i64(p, end, &index);
+            if (q != p) {
+                out->vn = obj_resolve_index(index, state->vn_count);
+                if (index < 0) *relative |= OBJ_RELATIVE_VN;
+            }
+            p = q;
         }
+    }
+    return p;
+}
+
+// A whole triangle is appended at once, the corners were reserved by the counting pass.
+// The arrays are never grown here: they may come from the arena of another thread.
+static void obj_push_triangle(ObjParseState* state, const ObjIndex corners[3], const u8 relative[3]) {
+    size_t relative_count = (relative[0] != 0) + (relative[1] != 0) + (relative[2] != 0);
+    if (state->corners.count + 3 > state->corners.capacity ||
+        state->relative.count + relative_count > state->relative.capacity) {
+        state->failed = 1;
+        return;
+    }
+    for (int i = 0; i < 3; i++) {
+        if (!relative[i]) continue;
+        ObjRelativeCorner fixup = { state->corners.count + (size_t)i, relative[i] };
+        if (!da_append(state->relative, fixup)) state->failed = 1;
+    }
+    if (!da_append_n(state->corners, corners, 3)) state->failed = 1;
+}
+
+// Parse count space separated floats, the missing ones are set to 0.
+static void obj_parse_floats(const char* cursor, const char* end, f32* out, int count) {
+    for (int i = 0; i < count; i++) {
+        out[i] = 0.0f;
+        cursor = parse_f32(parse_skip_spaces(cursor, end), end, &out[i]);
+    }
+}
+
+// If the line starts with keyword followed by a space, returns the rest of the line
+static const char* obj_keyword(const char* cursor, const char* end, const char* keyword) {
+    size_t length = strlen(keyword);
+    if ((size_t)(end - cursor) <= length || memcmp(cursor, keyword, length) != 0) return NULL;
+    if (cursor[length] != ' ' && cursor[length] != '\t') return NULL;
+    return parse_skip_spaces(cursor + length, end);
+}
+
+static void obj_push_event(ObjParseState* state, ObjEvent* event, const char* name, const char* end) {
+    size_t length = (size_t)(end - name);
+    if (length > MODEL_PATH_SIZE - 1) length = MODEL_PATH_SIZE - 1;
+    memcpy(event->name, name, length);
+    event->name[length] = '\0';
+    event->corner = state->corners.count;
+    if (!da_append(state->events, *event)) state->failed = 1;
+}
+
+// usemtl, mtllib, o and g lines: remember the name and where it starts applying
+static void obj_parse_event(const char* cursor, const char* end, ObjParseState* state) {
+    ObjEvent event;
+    const char* name;
+    if ((name = obj_keyword(cursor, end, "usemtl"))) event.kind = OBJ_EVENT_MATERIAL;
+    else if ((name = obj_keyword(cursor, end, "mtllib"))) event.kind = OBJ_EVENT_LIBRARY;
+    else if ((name = obj_keyword(cursor, end, "o")) || (name = obj_keyword(cursor, end, "g"))) event.kind = OBJ_EVENT_GROUP;
+    else return;
+
+    while (end > name && (end[-1] == ' ' || end[-1] == '\t' || end[-1] == '\r')) end--;
+    if (event.kind != OBJ_EVENT_LIBRARY) {
+        obj_push_event(state, &event, name, end);
+        return;
+    }
+    // "mtllib a.mtl b.mtl": one event per library, loaded in that order
+    while (name < end) {
+        const char* name_end = scan_token_end(name, end);
+        obj_push_event(state, &event, name, name_end);
+        name = parse_skip_spaces(name_end, end);
+    }
+}
+
+// Parse a single line (without the '\n'), records we don't use are ignored.
+static void obj_parse_line(const char* cursor, const char* end, ObjParseState* state) {
+    cursor = parse_skip_spaces(cursor, end);
+    if (end - cursor < 2) return;
+
+    if (cursor[0] == 'v' && (cursor[1] == ' ' || cursor[1] == '\t')) {
+        obj_parse_floats(cursor + 2, end, state->positions + state->v_count * 3, 3);
+        state->v_count++;
+    }
+    else if (cursor[0] == 'v' && cursor[1] == 't') {
+        // the optional third (w) component is ignored
+        obj_parse_floats(cursor + 2, end, state->uvs + state->vt_count * 2, 2);
+        state->vt_count++;
+    }
+    else if (cursor[0] == 'v' && cursor[1] == 'n') {
+        obj_parse_floats(cursor + 2, end, state->normals + state->vn_count * 3, 3);
+        state->vn_count++;
+    }
+    else if (cursor[0] == 'f' && (cursor[1] == ' ' || cursor[1] == '\t')) {
+        ObjIndex first = {0}, prev = {0}, curr;
+        u8 first_rel = 0, prev_rel = 0, curr_rel;
+        int corner = 0;
+        cursor += 2;
+
+        // polygons are triangulated as a fan around their first corner
+        while (1) {
+            cursor = parse_skip_spaces(cursor, end);
+            const char* next = obj_parse_corner(cursor, end, &curr, &curr_rel, state);
+            if (next == cursor) break;
+            cursor = next;
 
-        if (cursor[0] == 'v' && cursor[1] == ' ') {
-            f32 x, y, z;
-            sscanf(cursor, "v %f %f %f", &x, &y, &z); 
-            
-            da_append(vertices, x);
-            da_append(vertices, y);
-            da_append(vertices, z);
-        }
-        else if (cursor[0] == 'f' && cursor[1] == ' ') {
-            cursor += 2;
-            for (int i = 0; i < 3; i++) {
-                char* end_ptr;
-                long index = strtol(cursor, &end_ptr, 10);
-
-                // OBJ is 1-based, OpenGL is 0-based
-                da_append(faces, (int)(index - 1));
-
-                // Skip over the slash stuff (textures/normals) to find the next number
-                cursor = end_ptr;
-                while (*cursor != ' ' && *cursor != '\n' && *cursor != '\0') {
-                    cursor++;
-                }
-                // Skip whitespace to get to the start of the next vertex
-                while (*cursor == ' ') {
-                    cursor++;
-                }
+            if (corner == 0) {
+                first = curr;
+                first_rel = curr_rel;
             }
+            else if (corner >= 2) {
+                ObjIndex triangle[3] = { first, prev, curr };
+                u8 relative[3] = { first_rel, prev_rel, curr_rel };
+                obj_push_triangle(state, triangle, relative);
+            }
+            prev = curr;
+            prev_rel = curr_rel;
+            corner++;
         }
-        
-        while (*cursor && *cursor != '\n') {
-            cursor++;
+    }
+    else if (cursor[0] == 'u' || cursor[0] == 'm' || cursor[0] == 'o' || cursor[0] == 'g') {
+        obj_parse_event(cursor, end, state);
+    }
+}
+
+// Signs right after a digit: parse_i64 ends a corner there and the sign starts the next
+// one, "f 1-2 3 4" has 4 corners in 3 tokens. It's the only way a token holds several.
+static size_t obj_count_inner_signs(const char* cursor, const char* end) {
+    size_t count = 0;
+    for (const char* p = cursor + 1; p < end; p++) {
+        count += (*p == '-' || *p == '+') && p[-1] >= '0' && p[-1] <= '9';
+    }
+    return count;
+}
+
+// Count the records of a single line, it must classify lines exactly like obj_parse_line.
+// Corners are counted as whitespace separated tokens plus the signs that split a token,
+// so they are an upper bound.
+static void obj_count_line(const char* cursor, const char* end, ObjCounts* counts) {
+    cursor = parse_skip_spaces(cursor, end);
+    if (end - cursor < 2) return;
+
+    if (cursor[0] == 'v' && (cursor[1] == ' ' || cursor[1] == '\t')) counts->v++;
+    else if (cursor[0] == 'v' && cursor[1] == 't') counts->vt++;
+    else if (cursor[0] == 'v' && cursor[1] == 'n') counts->vn++;
+    else if (cursor[0] == 'f' && (cursor[1] == ' ' || cursor[1] == '\t')) {
+        cursor += 2;
+        size_t tokens = scan_count_tokens(cursor, end);
+        int relative = memchr(cursor, '-', (size_t)(end - cursor)) != NULL;
+        if (relative || memchr(cursor, '+', (size_t)(end - cursor))) tokens += obj_count_inner_signs(cursor, end);
+        if (tokens >= 3) {
+            counts->corners += (tokens - 2) * 3;
+            if (relative) counts->relative += (tokens - 2) * 3;
+        }
+    }
+}
+
+// Job entry point: count the records of a chunk. All its lines are found first in a
+// single SIMD pass (see common/scan.h), then classified by their first bytes only.
+static void obj_count_chunk(void* data) {
+    ObjChunk* chunk = data;
+    size_t size = (size_t)(chunk->end - chunk->begin);
+    chunk->lines.count = 0;
+    if (scan_lines(chunk->begin, size, &chunk->lines) != IO_SUCCESS) {
+        chunk->failed = 1;
+        return;
+    }
+    for (size_t l = 0; l < chunk->lines.count; l++) {
+        const char* line_end = scan_line_at_end(chunk->begin, size, &chunk->lines, l);
+        obj_count_line(chunk->begin + chunk->lines.items[l], line_end, &chunk->counts);
+    }
+}
+
+// Job entry point: parse all the lines of a chunk into its own state
+static void obj_parse_chunk(void* data) {
+    ObjChunk* chunk = data;
+    size_t size = (size_t)(chunk->end - chunk->begin);
+    for (size_t l = 0; l < chunk->lines.count; l++) {
+        const char* line_end = scan_line_at_end(chunk->begin, size, &chunk->lines, l);
+        obj_parse_line(chunk->begin + chunk->lines.items[l], line_end, &chunk->state);
+    }
+}
+
+// Split [data, data + size) in at most max_chunks pieces of similar size that start
+// at the beginning of a line. Returns the number of chunks actually used.
+static u32 obj_split_chunks(const char* data, size_t size, ObjChunk* chunks, u32 max_chunks) {
+    const char* end = data + size;
+    const char* begin = data;
+    u32 count = 0;
+    for (u32 i = 0; i < max_chunks && begin < end; i++) {
+        const char* split = end;
+        if (i + 1 < max_chunks) {
+            split = data + size / max_chunks * (i + 1);
+            if (split < begin) split = begin;
+            const char* newline = memchr(split, '\n', (size_t)(end - split));
+            split = newline ? newline + 1 : end;
         }
+        chunks[count++] = (ObjChunk){ .begin = begin, .end = split };
+        begin = split;
+    }
+    return count;
+}
+
+static void obj_parse_state_free(ObjParseState* state) {
+    da_free(state->corners);
+    da_free(state->relative);
+    da_free(state->events);
+}
+
+static void obj_chunks_free(ObjChunk* chunks, u32 chunk_count) {
+    for (u32 i = 0; i < chunk_count; i++) {
+        obj_parse_state_free(&chunks[i].state);
+        da_free(chunks[i].lines);
     }
-    
-    for (size_t i = 0; i < faces.count; i++) {
-        u32 index = faces.items[i];
-        u32 base_index = index * 3;
+    free(chunks);
+}
 
-        f32 x = vertices.items[base_index + 0];
-        f32 y = vertices.items[base_index + 1];
-        f32 z = vertices.items[base_index + 2];
+// Hash of the position/uv/normal triple, used to find corners that share the same vertex.
+static u32 obj_index_hash(ObjIndex key) {
+    u32 h = (u32)key.v * 0x9E3779B1u;
+    h ^= (u32)key.vt * 0x85EBCA77u;
+    h ^= (u32)key.vn * 0xC2B2AE3Du;
+    h ^= h >> 15;
+    h *= 0x2C1B3C6Du;
+    h ^= h >> 13;
+    return h;
+}
 
-        da_append(m->verts, x);
-        da_append(m->verts, y);
-        da_append(m->verts, z);
+static int obj_index_equal(ObjIndex a, ObjIndex b) {
+    return a.v == b.v && a.vt == b.vt && a.vn == b.vn;
+}
+
+// Progress of obj_group_faces through the triangles, in file order
+typedef struct {
+    char group[MODEL_NAME_SIZE];    // last "o" or "g"
+    u32 material;                   // last "usemtl"
+    u32 submesh;                    // submesh of group and material, if not changed
+    int changed;
+    int warned;                     // an unknown material was reported
+    size_t tagged;                  // triangles already given a submesh
+    u32* tags;                      // submesh of every triangle
+} ObjGrouping;
+
+// Give the submesh of the current group and material to the triangles up to until
+static IOStatus obj_tag_triangles(ObjGrouping* grouping, Model* m, size_t until) {
+    if (until <= grouping->tagged) return IO_SUCCESS;
+    if (grouping->changed) {
+        size_t s = 0;
+        while (s < m->submeshes.count && (m->submeshes.items[s].material != grouping->material ||
+               strcmp(m->submeshes.items[s].name, grouping->group) != 0)) s++;
+        if (s == m->submeshes.count) {
+            Submesh submesh = { .material = grouping->material };
+            memcpy(submesh.name, grouping->group, sizeof(submesh.name));
+            if (!da_append(m->submeshes, submesh)) return IO_ERROR_MEMORY;
+        }
+        grouping->submesh = (u32)s;
+        grouping->changed = 0;
     }
+    for (size_t t = grouping->tagged; t < until; t++) grouping->tags[t] = grouping->submesh;
+    grouping->tagged = until;
+    return IO_SUCCESS;
+}
 
-    da_free(vertices);
-    da_free(faces);
-    free(file_content.data);
+static IOStatus obj_apply_event(ObjGrouping* grouping, Model* m, const ObjEvent* event, const char* file_path) {
+    if (event->kind == OBJ_EVENT_LIBRARY) {
+        char path[MODEL_PATH_SIZE];
+        IOStatus status = file_sibling_path(path, sizeof(path), file_path, event->name);
+        if (status == IO_SUCCESS) status = material_library_load(path, &m->materials);
+        if (status == IO_ERROR_MEMORY) return status;
+        // the faces are still usable without their materials
+        if (status != IO_SUCCESS) fprintf(stderr, "[MODEL] Could not load material library %s (code %d)\n", event->name, status);
+        return IO_SUCCESS;
+    }
+    if (event->kind == OBJ_EVENT_MATERIAL) {
+        grouping->material = material_find(&m->materials, event->name, strlen(event->name));
+        if (grouping->material == MODEL_NO_MATERIAL && !grouping->warned) {
+            // only once, a missing library would report every usemtl of the file
+            fprintf(stderr, "[MODEL] Unknown material %s in %s, drawn without material\n", event->name, file_path);
+            grouping->warned = 1;
+        }
+    }
+    else {
+        // truncated and zero padded, the names end up in the cache as they are
+        size_t length = strlen(event->name);
+        if (length > sizeof(grouping->group) - 1) length = sizeof(grouping->group) - 1;
+        memcpy(grouping->group, event->name, length);
+        memset(grouping->group + length, 0, sizeof(grouping->group) - length);
+    }
+    grouping->changed = 1;
     return IO_SUCCESS;
 }
+
+// Split the triangles of level 0 in submeshes, one per group and material, from the
+// usemtl/o/g records of the chunks. The triangles are sorted so that every submesh is
+// a range, and the submeshes by material so that the draws that share one are together.
+static IOStatus obj_group_faces(const ObjChunk* chunks, u32 chunk_count, const char* file_path, Model* m) {
+    size_t triangle_count = m->indices.count / 3;
+    // every buffer of the grouping is temporary
+    Arena* scratch = arena_scratch();
+    if (!scratch) return IO_ERROR_MEMORY;
+    ArenaMark mark = arena_mark(scratch);
+    ObjGrouping grouping = { .material = MODEL_NO_MATERIAL, .changed = 1 };
+    grouping.tags = arena_push(scratch, u32, triangle_count + 1);
+    if (!grouping.tags) return IO_ERROR_MEMORY;
+
+    IOStatus status = IO_SUCCESS;
+    size_t corner_base = 0;
+    for (u32 c = 0; c < chunk_count && status == IO_SUCCESS; c++) {
+        const obj_event_darray* events = &chunks[c].state.events;
+        for (size_t e = 0; e < events->count && status == IO_SUCCESS; e++) {
+            status = obj_tag_triangles(&grouping, m, (corner_base + events->items[e].corner) / 3);
+            if (status == IO_SUCCESS) status = obj_apply_event(&grouping, m, &events->items[e], file_path);
+        }
+        corner_base += chunks[c].state.corners.count;
+    }
+    if (status == IO_SUCCESS) status = obj_tag_triangles(&grouping, m, triangle_count);
+    if (status == IO_SUCCESS && m->submeshes.count == 0) {
+        // a model without faces still has its (empty) submesh
+        Submesh submesh = { .material = MODEL_NO_MATERIAL };
+        if (!da_append(m->submeshes, submesh)) status = IO_ERROR_MEMORY;
+    }
+    if (status != IO_SUCCESS) {
+        arena_reset_to(scratch, mark);
+        return status;
+    }
+
+    // stable sort of the submeshes by material (there are few of them)
+    size_t submesh_count = m->submeshes.count;
+    u32* order = arena_push(scratch, u32, submesh_count);
+    u32* rank = arena_push(scratch, u32, submesh_count);
+    size_t* offsets = arena_push_zero(scratch, size_t, submesh_count + 1);
+    Submesh* sorted = arena_push(scratch, Submesh, submesh_count);
+    u32* indices = arena_push(scratch, u32, triangle_count * 3 + 1);
+    if (!order || !rank || !offsets || !sorted || !indices) {
+        arena_reset_to(scratch, mark);
+        return IO_ERROR_MEMORY;
+    }
+    for (size_t i = 0; i < submesh_count; i++) {
+        u32 s = (u32)i;
+        size_t j = i;
+        while (j > 0 && m->submeshes.items[order[j - 1]].material > m->submeshes.items[s].material) {
+            order[j] = order[j - 1];
+            j--;
+        }
+        order[j] = s;
+    }
+    for (size_t i = 0; i < submesh_count; i++) {
+        rank[order[i]] = (u32)i;
+        sorted[i] = m->submeshes.items[order[i]];
+    }
+
+    // counting sort of the triangles by the rank of their submesh, file order is kept inside one
+    for (size_t t = 0; t < triangle_count; t++) offsets[rank[grouping.tags[t]] + 1]++;
+    for (size_t i = 0; i < submesh_count; i++) {
+        sorted[i].lods[0] = (ModelLod){ .index_offset = (u32)(offsets[i] * 3), .index_count = (u32)(offsets[i + 1] * 3) };
+        offsets[i + 1] += offsets[i];
+    }
+    for (size_t t = 0; t < triangle_count; t++) {
+        size_t slot = offsets[rank[grouping.tags[t]]]++;
+        memcpy(indices + slot * 3, m->indices.items + t * 3, 3 * sizeof(u32));
+    }
+    memcpy(m->indices.items, indices, triangle_count * 3 * sizeof(u32));
+    memcpy(m->submeshes.items, sorted, submesh_count * sizeof(Submesh));
+    arena_reset_to(scratch, mark);
+    return IO_SUCCESS;
+}
+
+// Turn the parsed chunks into the final model: shift the relative indices of every chunk,
+// then deduplicate the corners. Every distinct v/vt/vn triple becomes one vertex of the
+// output buffer and each corner becomes an index into it. Finally the faces are grouped
+// in submeshes, file_path is where the material libraries are looked up from.
+static IOStatus obj_build_model(ObjChunk* chunks, u32 chunk_count, const f32* positions, const f32* uvs, const f32* normals,
+                                const char* file_path, Model* m) {
+    // Prefix sum of the record counts: a chunk starts where all the previous ones end,
+    // that's how much its relative indices have to be shifted to become global.
+    size_t v_count = 0, vt_count = 0, vn_count = 0, corner_count = 0;
+    for (u32 i = 0; i < chunk_count; i++) {
+        ObjParseState* state = &chunks[i].state;
+        for (size_t r = 0; r < state->relative.count; r++) {
+            ObjRelativeCorner fixup = state->relative.items[r];
+            ObjIndex* corner = &state->corners.items[fixup.corner];
+            if (fixup.mask & OBJ_RELATIVE_V)  corner->v  += (i32)v_count;
+            if (fixup.mask & OBJ_RELATIVE_VT) corner->vt += (i32)vt_count;
+            if (fixup.mask & OBJ_RELATIVE_VN) corner->vn += (i32)vn_count;
+        }
+        state->relative.count = 0;
+        v_count += state->v_count;
+        vt_count += state->vt_count;
+        vn_count += state->vn_count;
+        corner_count += state->corners.count;
+    }
+
+    size_t map_capacity = 16;
+    while (map_capacity < corner_count * 2) map_capacity *= 2;
+    // the deduplication table is temporary
+    Arena* scratch = arena_scratch();
+    ArenaMark mark = scratch ? arena_mark(scratch) : 0;
+    u32* map = scratch ? arena_push_zero(scratch, u32, map_capacity) : NULL;  // vertex id + 1, 0 marks an empty slot
+    ObjIndex* keys = scratch ? arena_push(scratch, ObjIndex, corner_count + 1) : NULL;
+    // upper bound, trimmed once the corners are deduplicated
+    if (!map || !keys || !da_reserve(m->verts, corner_count) || !da_reserve(m->indices, corner_count)) {
+        if (scratch) arena_reset_to(scratch, mark);
+        model_free(m);
+        return IO_ERROR_MEMORY;
+    }
+
+    IOStatus status = IO_SUCCESS;
+    u32 unique_count = 0;
+    for (u32 c = 0; c < chunk_count && status == IO_SUCCESS; c++) {
+        obj_index_darray* corners = &chunks[c].state.corners;
+        for (size_t i = 0; i < corners->count; i++) {
+            ObjIndex key = corners->items[i];
+            if (key.v < 0 || (size_t)key.v >= v_count ||
+                (key.vt >= 0 && (size_t)key.vt >= vt_count) || (key.vn >= 0 && (size_t)key.vn >= vn_count)) {
+                status = IO_ERROR_PARSE;
+                break;
+            }
+
+            size_t slot = obj_index_hash(key) & (map_capacity - 1);
+            while (map[slot] != 0 && !obj_index_equal(keys[map[slot] - 1], key)) {
+                slot = (slot + 1) & (map_capacity - 1);
+            }
+
+            if (map[slot] == 0) {
+                keys[unique_count] = key;
+                map[slot] = ++unique_count;
+
+                Vertex vertex = {0};
+                memcpy(vertex.position.elements, positions + (size_t)key.v * 3, sizeof(vertex.position));
+                if (key.vt >= 0) memcpy(vertex.uv.elements, uvs + (size_t)key.vt * 2, sizeof(vertex.uv));
+                if (key.vn >= 0) memcpy(vertex.normal.elements, normals + (size_t)key.vn * 3, sizeof(vertex.normal));
+                // both arrays were reserved for every corner, nothing to check
+                m->verts.items[m->verts.count++] = vertex;
+            }
+            m->indices.items[m->indices.count++] = map[slot] - 1;
+        }
+    }
+
+    arena_reset_to(scratch, mark);
+    if (status != IO_SUCCESS) {
+        model_free(m);
+        return status;
+    }
+
+    // give back the part of the vertex upper bound that deduplication didn't use
+    da_shrink_to_fit(m->verts);
+    m->lod_count = 1;
+    m->lods[0] = (ModelLod){ .index_offset = 0, .index_count = (u32)m->indices.count, .error = 0.0f };
+    model_bounds_compute(m->verts.items, m->verts.count, &m->bounds);
+    status = obj_group_faces(chunks, chunk_count, file_path, m);
+    if (status == IO_SUCCESS) status = model_generate_normals(m);
+    if (status != IO_SUCCESS) model_free(m);
+    return status;
+}
+
+IOStatus model_from_obj(const char* file_path, Model* m) {
+    struct stat st;
+    if (stat(file_path, &st) == 0 && (u64)st.st_size > OBJ_STREAM_THRESHOLD) {
+        return model_from_obj_stream(file_path, m);
+    }
+    return model_from_obj_threaded(file_path, m, 0);
+}
+
+IOStatus model_from_obj_threaded(const char* file_path, Model* m, u32 thread_count) {
+    return model_from_obj_timed(file_path, m, thread_count, NULL);
+}
+
+IOStatus model_from_obj_timed(const char* file_path, Model* m, u32 thread_count, ObjImportTimings* timings) {
+    ObjImportTimings phases = {0};
+    f64 start = timer_now();
+    string_t file_content;
+    // populated: the parse threads never wait for a page fault
+    IO_CHECK(file_map(&file_content, file_path, FILE_MAP_POPULATE));
+    f64 now = timer_now();
+    phases.read = now - start;
+    start = now;
+
+    if (thread_count == 0) thread_count = jobs_core_count();
+    size_t max_chunks = file_content.size / OBJ_MIN_CHUNK_SIZE + 1;
+    size_t min_chunks = file_content.size / OBJ_MAX_CHUNK_SIZE + 1;
+    if (thread_count > max_chunks) thread_count = (u32)max_chunks;
+    if (thread_count < min_chunks) thread_count = (u32)min_chunks;
+
+    ObjChunk* chunks = calloc(thread_count, sizeof(ObjChunk));
+    if (!chunks) {
+        file_unmap(&file_content);
+        return IO_ERROR_MEMORY;
+    }
+    u32 chunk_count = obj_split_chunks(file_content.data, file_content.size, chunks, thread_count);
+
+    // Counting pre-pass: with the exact number of records every array below is
+    // allocated once, the records of all the chunks go straight into the same block.
+    jobs_run(obj_count_chunk, chunks, sizeof(ObjChunk), chunk_count);
+    ObjCounts total = {0};
+    int reserved = 1;
+    for (u32 i = 0; i < chunk_count; i++) {
+        reserved = reserved && !chunks[i].failed;
+        total.v += chunks[i].counts.v;
+        total.vt += chunks[i].counts.vt;
+        total.vn += chunks[i].counts.vn;
+    }
+
+    // the records are only needed until the vertices are built
+    Arena* scratch = arena_scratch();
+    ArenaMark mark = scratch ? arena_mark(scratch) : 0;
+    f32* records = scratch ? arena_push(scratch, f32, total.v * 3 + total.vt * 2 + total.vn * 3 + 1) : NULL;
+    f32* positions = records;
+    f32* uvs = positions + total.v * 3;
+    f32* normals = uvs + total.vt * 2;
+    reserved = reserved && records != NULL;
+    ObjCounts base = {0};
+    for (u32 i = 0; reserved && i < chunk_count; i++) {
+        ObjParseState* state = &chunks[i].state;
+        state->positions = positions + base.v * 3;
+        state->uvs = uvs + base.vt * 2;
+        state->normals = normals + base.vn * 3;
+        base.v += chunks[i].counts.v;
+        base.vt += chunks[i].counts.vt;
+        base.vn += chunks[i].counts.vn;
+        // in the scratch arena too: the counts are upper bounds, so the parse jobs never
+        // have to grow the arrays, which an arena of this thread couldn't take
+        state->corners.allocator = &scratch->allocator;
+        state->relative.allocator = &scratch->allocator;
+        reserved = da_reserve(state->corners, chunks[i].counts.corners) &&
+                   da_reserve(state->relative, chunks[i].counts.relative);
+    }
+    if (!reserved) {
+        obj_chunks_free(chunks, chunk_count);
+        if (scratch) arena_reset_to(scratch, mark);
+        file_unmap(&file_content);
+        return IO_ERROR_MEMORY;
+    }
+
+    now = timer_now();
+    phases.scan = now - start;
+    start = now;
+
+    jobs_run(obj_parse_chunk, chunks, sizeof(ObjChunk), chunk_count);
+    file_unmap(&file_content);
+    now = timer_now();
+    phases.parse = now - start;
+    start = now;
+
+    IOStatus status = IO_SUCCESS;
+    for (u32 i = 0; i < chunk_count; i++) {
+        if (chunks[i].state.failed) status = IO_ERROR_MEMORY;
+    }
+    if (status == IO_SUCCESS) status = obj_build_model(chunks, chunk_count, positions, uvs, normals, file_path, m);
+    obj_chunks_free(chunks, chunk_count);
+    arena_reset_to(scratch, mark);
+    phases.index = timer_now() - start;
+    if (timings) *timings = phases;
+    return status;
+}
+
+
+// One side of a double buffered step: either read the next window or parse the current one
+typedef struct {
+    int is_reader;
+    // reader
+    FILE* fp;
+    char* buffer;
+    size_t size;
+    size_t read;
+    // parser
+    ObjChunk* chunk;
+    f32_darray* records[3];     // positions, uvs, normals
+    int failed;
+} ObjStreamJob;
+
+static void obj_stream_job(void* data) {
+    ObjStreamJob* job = data;
+    if (job->is_reader) {
+        job->read = job->size > 0 ? fread(job->buffer, 1, job->size, job->fp) : 0;
+        return;
+    }
+
+    // count the window, grow the arrays for it and only then parse it
+    ObjChunk* chunk = job->chunk;
+    ObjParseState* state = &chunk->state;
+    chunk->counts = (ObjCounts){0};
+    obj_count_chunk(chunk);
+    if (chunk->failed) {
+        job->failed = 1;
+        return;
+    }
+    // grown rather than reserved, so that the windows don't reallocate every time
+    f32_darray** records = job->records;
+    if (!da_grow(*records[0], records[0]->count + chunk->counts.v * 3) ||
+        !da_grow(*records[1], records[1]->count + chunk->counts.vt * 2) ||
+        !da_grow(*records[2], records[2]->count + chunk->counts.vn * 3) ||
+        !da_grow(state->corners, state->corners.count + chunk->counts.corners) ||
+        !da_reserve(state->relative, chunk->counts.relative)) {
+        job->failed = 1;
+        return;
+    }
+
+    // the arrays may have moved, the state points at their start
+    state->positions = records[0]->items;
+    state->uvs = records[1]->items;
+    state->normals = records[2]->items;
+    obj_parse_chunk(chunk);
+    if (state->failed) job->failed = 1;
+    records[0]->count = state->v_count * 3;
+    records[1]->count = state->vt_count * 2;
+    records[2]->count = state->vn_count * 3;
+    // a single chunk covers the whole file, relative indices are already global
+    state->relative.count = 0;
+}
+
+IOStatus model_from_obj_stream(const char* file_path, Model* m) {
+    FILE* fp = fopen(file_path, "rb");
+    if (!fp) return IO_ERROR_OPEN;
+
+    size_t window = OBJ_STREAM_WINDOW;
+    char* buffers[2] = { malloc(window), malloc(window) };
+    f32_darray positions = {0}, uvs = {0}, normals = {0};
+    ObjChunk chunk = {0};
+    IOStatus status = IO_SUCCESS;
+    if (!buffers[0] || !buffers[1]) status = IO_ERROR_MEMORY;
+
+    int current = 0;
+    size_t length = status == IO_SUCCESS ? fread(buffers[0], 1, window, fp) : 0;
+    int eof = length < window;
+    while (status == IO_SUCCESS && length > 0) {
+        // only whole lines are parsed, the last partial one moves to the next window
+        size_t parse_end = length;
+        if (!eof) {
+            while (parse_end > 0 && buffers[current][parse_end - 1] != '\n') parse_end--;
+        }
+        if (parse_end == 0) {
+            // a single line longer than the window: make the windows bigger
+            char* grown[2] = { realloc(buffers[0], window * 2), NULL };
+            if (grown[0]) buffers[0] = grown[0];
+            grown[1] = grown[0] ? realloc(buffers[1], window * 2) : NULL;
+            if (grown[1]) buffers[1] = grown[1];
+            if (!grown[0] || !grown[1]) {
+                status = IO_ERROR_MEMORY;
+                break;
+            }
+            size_t read = fread(buffers[current] + length, 1, window, fp);
+            window *= 2;
+            length += read;
+            eof = length < window;
+            continue;
+        }
+
+        size_t carry = length - parse_end;
+        char* next = buffers[1 - current];
+        memcpy(next, buffers[current] + parse_end, carry);
+
+        // read the next window while this one is parsed
+        chunk.begin = buffers[current];
+        chunk.end = buffers[current] + parse_end;
+        ObjStreamJob jobs[2] = {
+            { .is_reader = 0, .chunk = &chunk, .records = { &positions, &uvs, &normals } },
+            { .is_reader = 1, .fp = fp, .buffer = next + carry, .size = eof ? 0 : window - carry },
+        };
+        jobs_run(obj_stream_job, jobs, sizeof(ObjStreamJob), 2);
+        if (jobs[0].failed) status = IO_ERROR_MEMORY;
+        else if (ferror(fp)) status = IO_ERROR_READ;
+
+        eof = eof || jobs[1].read < window - carry;
+        length = carry + jobs[1].read;
+        current = 1 - current;
+    }
+    fclose(fp);
+    free(buffers[0]);
+    free(buffers[1]);
+
+    if (status == IO_SUCCESS) status = obj_build_model(&chunk, 1, positions.items, uvs.items, normals.items, file_path, m);
+    da_free(positions);
+    da_free(uvs);
+    da_free(normals);
+    obj_parse_state_free(&chunk.state);
+    da_free(chunk.lines);
+    return status;
+}
+
+int model_has_extension(const char* file_path, const char* extension) {
+    const char* dot = strrchr(file_path, '.');
+    if (!dot || strchr(dot, '/')) return 0;
+    size_t i = 0;
+    for (; dot[i + 1] && extension[i]; i++) {
+        if (tolower((unsigned char)dot[i + 1]) != extension[i]) return 0;
+    }
+    return dot[i + 1] == '\0' && extension[i] == '\0';
+}
+
+IOStatus model_import(const char* file_path, Model* m) {
+    if (model_has_extension(file_path, "ply")) return model_from_ply(file_path, m);
+    if (model_has_extension(file_path, "stl")) return model_from_stl(file_path, m);
+    return model_from_obj(file_path, m);
+}
+
+IOStatus model_load(const char* file_path, Model* m, u32 flags, ModelOptimizeStats* stats) {
+    IO_CHECK(model_import(file_path, m));
+    if (flags & MODEL_LOAD_TANGENTS) {
+        IOStatus status = model_generate_tangents(m);
+        if (status != IO_SUCCESS) {
+            model_free(m);
+            return status;
+        }
+    }
+    if (flags & MODEL_LOAD_LODS) {
+        IOStatus status = model_generate_lods(m, MODEL_LOD_RATIOS, sizeof(MODEL_LOD_RATIOS) / sizeof(MODEL_LOD_RATIOS[0]));
+        if (status != IO_SUCCESS) {
+            model_free(m);
+            return status;
+        }
+    }
+    if (flags & MODEL_LOAD_OPTIMIZE) {
+        IOStatus status = model_optimize(m, stats);
+        if (status != IO_SUCCESS) {
+            model_free(m);
+            return status;
+        }
+    }
+    if (flags & MODEL_LOAD_MESHLETS) {
+        IOStatus status = model_build_meshlets(m);
+        if (status != IO_SUCCESS) {
+            model_free(m);
+            return status;
+        }
+    }
+    return IO_SUCCESS;
+}
+
+void model_free(Model* m) {
+    da_free(m->verts);
+    da_free(m->tangents);
+    da_free(m->indices);
+    da_free(m->submeshes);
+    da_free(m->materials);
+    da_free(m->meshlets);
+}
@@ -1,10 +1,147 @@
-#pragma once 
+#pragma once
 #include "common/files.h"
 #include "common/defines.h"
+#include "math/math_types.h"
 
+// One vertex of the interleaved vertex buffer, tightly packed (32 bytes).
+// Attributes missing from the source file are left to 0.
 typedef struct {
-    f32_darray verts;    
+    vec3 position;
+    vec2 uv;
+    vec3 normal;
+} Vertex;
+
+typedef DARRAY(Vertex) vertex_darray;
+
+// Tangents of the vertices, parallel to Model.verts (see model/model_normals.h)
+typedef DARRAY(vec4) vec4_darray;
+
+// Most levels of detail a model can have, level 0 included
+#define MODEL_MAX_LODS 8
+
+// One level of detail: a range of the index buffer drawn over the shared vertices
+typedef struct {
+    u32 index_offset;
+    u32 index_count;
+    f32 error;          // bound on the distance from the full detail surface, in model units
+} ModelLod;
+
+// Fixed size strings, so that materials and submeshes can be stored in the cache as they are
+#define MODEL_NAME_SIZE 64
+#define MODEL_PATH_SIZE 256
+
+// Material of the faces of a submesh, from a .mtl file (see model/model_material.h)
+typedef struct {
+    char name[MODEL_NAME_SIZE];
+    vec3 ambient;                       // Ka
+    vec3 diffuse;                       // Kd
+    vec3 specular;                      // Ks
+    f32 shininess;                      // Ns
+    f32 opacity;                        // d, or 1 - Tr
+    char diffuse_map[MODEL_PATH_SIZE];  // map_Kd, usable as is with texture_generate, empty if none
+} Material;
+
+typedef DARRAY(Material) material_darray;
+
+// Submesh.material when the faces have none
+#define MODEL_NO_MATERIAL 0xFFFFFFFFu
+
+// The faces of one object/group ("o"/"g") that use the same material. Every level of
+// detail keeps the submeshes in the same order, each one is a range of that level.
+typedef struct {
+    char name[MODEL_NAME_SIZE];     // object or group name, empty if the file has none
+    u32 material;                   // index in Model.materials or MODEL_NO_MATERIAL
+    u32 meshlet_offset;             // meshlets of level 0, in Model.meshlets
+    u32 meshlet_count;
+    ModelLod lods[MODEL_MAX_LODS];
+} Submesh;
+
+typedef DARRAY(Submesh) submesh_darray;
+
+// Bounding volumes of the vertices, in model space (see model/model_bounds.h)
+typedef struct {
+    vec3 min;           // axis aligned box
+    vec3 max;
+    vec3 center;        // bounding sphere
+    f32 radius;
+} ModelBounds;
+
+// A small cluster of triangles of level 0 (see model/model_meshlet.h), culled as a whole
+typedef struct {
+    vec3 center;        // bounding sphere
+    f32 radius;
+    vec3 cone_apex;     // normal cone: the cluster faces away from any camera inside it
+    f32 cone_cutoff;    // sine of the cone half angle, 1 if the cluster can't be backface culled
+    vec3 cone_axis;
+    u32 index_offset;   // triangles are a range of the index buffer
+    u32 triangle_count;
+    u32 vertex_count;   // distinct vertices used by the triangles
+} Meshlet;
+
+typedef DARRAY(Meshlet) meshlet_darray;
+
+typedef struct {
+    vertex_darray verts; // unique vertices
+    vec4_darray tangents; // xyz tangent and w bitangent sign of every vertex, empty unless generated
+    u32_darray indices;  // 3 indices into verts per triangle, the levels of detail one after the other
+    u32 lod_count;       // at least 1, level 0 is the full detail mesh
+    ModelLod lods[MODEL_MAX_LODS];
+    submesh_darray submeshes;   // at least 1, sorted by material
+    material_darray materials;
+    meshlet_darray meshlets; // clusters of level 0, empty unless built
+    ModelBounds bounds;
 } Model;
 
 // Create a new model struct give a .obj file
+// Faces are triangulated and corners sharing the same v/vt/vn triple are merged
+// into a single vertex, so the result is meant to be drawn with glDrawElements.
+// Corners without a normal get a smooth one (see model/model_normals.h).
 IOStatus model_from_obj(const char* file_path, Model* m);
+
+// Same as model_from_obj, but the file is split at line boundaries and the chunks are
+// parsed on thread_count threads (0 means one per core). Small files use fewer threads.
+IOStatus model_from_obj_threaded(const char* file_path, Model* m, u32 thread_count);
+
+// Seconds spent in each phase of model_from_obj_timed
+typedef struct {
+    f64 read;   // file mapped and read in
+    f64 scan;   // line offsets and record counts, arrays allocated
+    f64 parse;  // records and face corners
+    f64 index;  // corners deduplicated into vertices, submeshes and missing normals
+} ObjImportTimings;
+
+// Same as model_from_obj_threaded, and measures its phases in timings (if not NULL)
+IOStatus model_from_obj_timed(const char* file_path, Model* m, u32 thread_count, ObjImportTimings* timings);
+
+// Same as model_from_obj, but the file is read through two fixed-size windows: the next
+// one is read while the current one is parsed, so memory is bounded by the output plus a
+// constant. model_from_obj uses it for files too big to be read in memory at once.
+IOStatus model_from_obj_stream(const char* file_path, Model* m);
+
+// Import a source model, the format is chosen by the extension of file_path (case
+// insensitive): .ply and .stl (see model/model_binary.h), .obj for anything else.
+IOStatus model_import(const char* file_path, Model* m);
+
+// Whether file_path ends with "." and extension (lower case, compared case insensitively)
+int model_has_extension(const char* file_path, const char* extension);
+
+// Optional processing applied by model_load and model_load_packed
+typedef enum {
+    MODEL_LOAD_OPTIMIZE = 1 << 0,   // reorder for the vertex cache, overdraw and fetch (see model/model_optimize.h)
+    MODEL_LOAD_LODS     = 1 << 1,   // generate simplified levels of detail (see model/model_simplify.h)
+    MODEL_LOAD_MESHLETS = 1 << 2,   // split level 0 in culling clusters (see model/model_meshlet.h)
+    MODEL_LOAD_TANGENTS = 1 << 3,   // generate tangents for normal mapping (see model/model_normals.h)
+    MODEL_LOAD_NO_CACHE = 1 << 4,   // model_load_packed always imports the source, and doesn't write a cache (hot reloading)
+} ModelLoadFlags;
+
+// See model/model_optimize.h
+typedef struct ModelOptimizeStats ModelOptimizeStats;
+
+// Import a source file with model_import and process it according to flags. With
+// MODEL_LOAD_OPTIMIZE, stats (can be NULL) receives the vertex cache efficiency before and
+// after, it is only measured when asked for. The cached version, ready to upload, is
+// model_load_packed (see model/model_cache.h).
+IOStatus model_load(const char* file_path, Model* m, u32 flags, ModelOptimizeStats* stats);
+
+// Release the memory owned by the model
+void model_free(Model* m);
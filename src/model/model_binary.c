@@ -0,0 +1,366 @@
+#include "model_binary.h"
+#include "common/parse.h"
+#include "common/scan.h"
+#include "model/model_bounds.h"
+#include "model/model_normals.h"
+#include <stdint.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+// The values are copied as they are: like the .tmesh cache this assumes a little endian CPU
+_Static_assert(sizeof(Vertex) == 8 * sizeof(f32), "PLY vertices are read as 8 floats");
+
+// Level 0 is the whole index buffer in a single submesh, then the bounds and the normals
+static IOStatus binary_finish(Model* m) {
+    if (m->indices.count > UINT32_MAX) return IO_ERROR_MEMORY;
+    m->lod_count = 1;
+    m->lods[0] = (ModelLod){ .index_offset = 0, .index_count = (u32)m->indices.count, .error = 0.0f };
+    Submesh submesh = { .material = MODEL_NO_MATERIAL };
+    submesh.lods[0] = m->lods[0];
+    if (!da_append(m->submeshes, submesh)) return IO_ERROR_MEMORY;
+    model_bounds_compute(m->verts.items, m->verts.count, &m->bounds);
+    return model_generate_normals(m);
+}
+
+// =============================================================
+// PLY
+// =============================================================
+
+typedef enum {
+    PLY_INT8, PLY_UINT8, PLY_INT16, PLY_UINT16, PLY_INT32, PLY_UINT32, PLY_FLOAT32, PLY_FLOAT64,
+    PLY_NOT_A_LIST,     // PlyProperty.count_type of a single value
+} PlyType;
+
+static const u8 PLY_TYPE_SIZES[] = { 1, 1, 2, 2, 4, 4, 4, 8 };
+static const char* const PLY_TYPE_NAMES[][2] = {
+    { "char", "int8" }, { "uchar", "uint8" }, { "short", "int16" }, { "ushort", "uint16" },
+    { "int", "int32" }, { "uint", "uint32" }, { "float", "float32" }, { "double", "float64" },
+};
+
+// What a property is used for: the float slot of a Vertex (+ 1) for the vertex element
+#define PLY_ROLE_NONE    0
+#define PLY_ROLE_INDICES 0xFF
+
+typedef struct {
+    u8 type;        // PlyType of the value, or of the items of a list
+    u8 count_type;  // PlyType of the item count of a list, PLY_NOT_A_LIST otherwise
+    u8 role;        // PLY_ROLE_*, or 1 + the index of the float it fills in a Vertex
+} PlyProperty;
+
+#define PLY_ELEMENT_OTHER  0
+#define PLY_ELEMENT_VERTEX 1
+#define PLY_ELEMENT_FACE   2
+
+typedef struct {
+    u8 kind;                // PLY_ELEMENT_*
+    u64 count;
+    u32 property_offset;    // first property in PlyHeader.properties
+    u32 property_count;
+} PlyElement;
+
+#define PLY_MAX_ELEMENTS 16
+#define PLY_MAX_PROPERTIES 64
+
+typedef struct {
+    PlyElement elements[PLY_MAX_ELEMENTS];
+    PlyProperty properties[PLY_MAX_PROPERTIES];
+    u32 element_count;
+    u32 property_count;
+    size_t data_offset;     // first byte after end_header
+} PlyHeader;
+
+// Names of the vertex properties, in the order of the floats of a Vertex
+static const char* const PLY_VERTEX_NAMES[][4] = {
+    { "x" }, { "y" }, { "z" },
+    { "u", "s", "texture_u", "texture_s" }, { "v", "t", "texture_v", "texture_t" },
+    { "nx" }, { "ny" }, { "nz" },
+};
+
+static int ply_token_is(const char* token, size_t length, const char* word) {
+    return strlen(word) == length && memcmp(token, word, length) == 0;
+}
+
+// Next token of the line and its length, the length is 0 once the line is over
+static const char* ply_next_token(const char** cursor, const char* end, size_t* length) {
+    const char* token = parse_skip_spaces(*cursor, end);
+    *cursor = scan_token_end(token, end);
+    *length = (size_t)(*cursor - token);
+    return token;
+}
+
+static int ply_parse_type(const char** cursor, const char* end, u8* type) {
+    size_t length;
+    const char* token = ply_next_token(cursor, end, &length);
+    for (u8 t = 0; t < PLY_NOT_A_LIST; t++) {
+        if (ply_token_is(token, length, PLY_TYPE_NAMES[t][0]) || ply_token_is(token, length, PLY_TYPE_NAMES[t][1])) {
+            *type = t;
+            return 1;
+        }
+    }
+    return 0;
+}
+
+static u8 ply_property_role(u8 element_kind, const char* name, size_t length) {
+    if (element_kind == PLY_ELEMENT_FACE) {
+        int indices = ply_token_is(name, length, "vertex_indices") || ply_token_is(name, length, "vertex_index");
+        return indices ? PLY_ROLE_INDICES : PLY_ROLE_NONE;
+    }
+    if (element_kind != PLY_ELEMENT_VERTEX) return PLY_ROLE_NONE;
+    for (u8 slot = 0; slot < sizeof(PLY_VERTEX_NAMES) / sizeof(PLY_VERTEX_NAMES[0]); slot++) {
+        for (int i = 0; i < 4 && PLY_VERTEX_NAMES[slot][i]; i++) {
+            if (ply_token_is(name, length, PLY_VERTEX_NAMES[slot][i])) return slot + 1;
+        }
+    }
+    return PLY_ROLE_NONE;
+}
+
+static IOStatus ply_parse_header(const string_t* file, const char* file_path, PlyHeader* header) {
+    const char* text = file->data;
+    const char* text_end = text + file->size;
+    const char* cursor = text;
+    int line_number = 0;
+    int little_endian = 0;
+    while (cursor < text_end) {
+        const char* end = scan_line_end(cursor, text_end);
+        if (end == text_end) break;     // the binary data must follow the header
+        const char* line = cursor;
+        cursor = end + 1;
+        size_t length;
+        const char* keyword = ply_next_token(&line, end, &length);
+
+        if (line_number++ == 0) {
+            if (!ply_token_is(keyword, length, "ply")) break;
+        }
+        else if (ply_token_is(keyword, length, "format")) {
+            const char* format = ply_next_token(&line, end, &length);
+            little_endian = ply_token_is(format, length, "binary_little_endian");
+            if (!little_endian) {
+                fprintf(stderr, "[MODEL] Only binary little endian PLY files are supported: %s is %.*s\n",
+                        file_path, (int)length, format);
+                return IO_ERROR_PARSE;
+            }
+        }
+        else if (ply_token_is(keyword, length, "element")) {
+            if (header->element_count == PLY_MAX_ELEMENTS) break;
+            PlyElement* element = &header->elements[header->element_count++];
+            const char* name = ply_next_token(&line, end, &length);
+            element->kind = ply_token_is(name, length, "vertex") ? PLY_ELEMENT_VERTEX :
+                            ply_token_is(name, length, "face") ? PLY_ELEMENT_FACE : PLY_ELEMENT_OTHER;
+            element->property_offset = header->property_count;
+            i64 count = -1;
+            parse_i64(parse_skip_spaces(line, end), end, &count);
+            if (count < 0) break;
+            element->count = (u64)count;
+        }
+        else if (ply_token_is(keyword, length, "property")) {
+            if (header->element_count == 0 || header->property_count == PLY_MAX_PROPERTIES) break;
+            PlyProperty* property = &header->properties[header->property_count++];
+            property->count_type = PLY_NOT_A_LIST;
+            const char* type_start = line;
+            const char* list = ply_next_token(&line, end, &length);
+            if (!ply_token_is(list, length, "list")) line = type_start;
+            else if (!ply_parse_type(&line, end, &property->count_type)) break;
+            if (!ply_parse_type(&line, end, &property->type)) break;
+            const char* name = ply_next_token(&line, end, &length);
+            PlyElement* element = &header->elements[header->element_count - 1];
+            property->role = ply_property_role(element->kind, name, length);
+            // indices are a list and vertex attributes are not
+            if ((property->role == PLY_ROLE_INDICES) != (property->count_type != PLY_NOT_A_LIST)) property->role = PLY_ROLE_NONE;
+            element->property_count++;
+        }
+        else if (ply_token_is(keyword, length, "end_header")) {
+            if (!little_endian) break;
+            header->data_offset = (size_t)(cursor - text);
+            return IO_SUCCESS;
+        }
+        // comment, obj_info and anything else is skipped
+    }
+    fprintf(stderr, "[MODEL] Invalid PLY header in %s (line %d)\n", file_path, line_number);
+    return IO_ERROR_PARSE;
+}
+
+static inline f32 ply_read_f32(const u8* p, u8 type) {
+    switch (type) {
+        case PLY_FLOAT32: { f32 value; memcpy(&value, p, sizeof(value)); return value; }
+        case PLY_FLOAT64: { f64 value; memcpy(&value, p, sizeof(value)); return (f32)value; }
+        case PLY_INT8:    return (f32)(i8)p[0];
+        case PLY_UINT8:   return (f32)p[0];
+        case PLY_INT16:   { i16 value; memcpy(&value, p, sizeof(value)); return (f32)value; }
+        case PLY_UINT16:  { u16 value; memcpy(&value, p, sizeof(value)); return (f32)value; }
+        case PLY_INT32:   { i32 value; memcpy(&value, p, sizeof(value)); return (f32)value; }
+        default:          { u32 value; memcpy(&value, p, sizeof(value)); return (f32)value; }
+    }
+}
+
+// Counts and indices, negative values become huge and fail the range checks
+static inline u32 ply_read_u32(const u8* p, u8 type) {
+    switch (type) {
+        case PLY_INT32:
+        case PLY_UINT32:  { u32 value; memcpy(&value, p, sizeof(value)); return value; }
+        case PLY_UINT8:   return p[0];
+        case PLY_INT8:    return (u32)(i32)(i8)p[0];
+        case PLY_INT16:   { i16 value; memcpy(&value, p, sizeof(value)); return (u32)(i32)value; }
+        case PLY_UINT16:  { u16 value; memcpy(&value, p, sizeof(value)); return value; }
+        default:          return (u32)(i64)ply_read_f32(p, type);
+    }
+}
+
+// Read the records of one element from *cursor: vertex attributes go to m->verts and the
+// face polygons to m->indices as triangle fans, everything else is only stepped over.
+static IOStatus ply_read_element(const PlyHeader* header, const PlyElement* element, const u8** cursor, const u8* end, Model* m) {
+    const PlyProperty* properties = header->properties + element->property_offset;
+    // every record takes at least a byte, unless the element has no properties at all
+    if (element->property_count == 0) return IO_SUCCESS;
+    if (element->count > (u64)(end - *cursor)) return IO_ERROR_PARSE;
+    if (element->kind == PLY_ELEMENT_VERTEX) {
+        if (m->verts.count + element->count > UINT32_MAX) return IO_ERROR_MEMORY;
+        if (!da_reserve(m->verts, m->verts.count + element->count)) return IO_ERROR_MEMORY;
+    }
+    // polygons grow the array further, in O(1) amortized
+    if (element->kind == PLY_ELEMENT_FACE && !da_grow(m->indices, m->indices.count + element->count * 3)) return IO_ERROR_MEMORY;
+
+    const u8* p = *cursor;
+    for (u64 r = 0; r < element->count; r++) {
+        f32 values[8] = {0};
+        for (u32 i = 0; i < element->property_count; i++) {
+            const PlyProperty* property = &properties[i];
+            size_t size = PLY_TYPE_SIZES[property->type];
+            if (property->count_type == PLY_NOT_A_LIST) {
+                if ((size_t)(end - p) < size) return IO_ERROR_PARSE;
+                if (property->role != PLY_ROLE_NONE && element->kind == PLY_ELEMENT_VERTEX) {
+                    values[property->role - 1] = ply_read_f32(p, property->type);
+                }
+                p += size;
+                continue;
+            }
+
+            size_t count_size = PLY_TYPE_SIZES[property->count_type];
+            if ((size_t)(end - p) < count_size) return IO_ERROR_PARSE;
+            u32 count = ply_read_u32(p, property->count_type);
+            p += count_size;
+            if ((size_t)(end - p) / size < count) return IO_ERROR_PARSE;
+            if (property->role == PLY_ROLE_INDICES && count >= 3) {
+                u32_darray* indices = &m->indices;
+                if (!da_grow(*indices, indices->count + ((size_t)count - 2) * 3)) return IO_ERROR_MEMORY;
+                if (count == 3 && (property->type == PLY_INT32 || property->type == PLY_UINT32)) {
+                    // the common case, a triangle of 32-bit indices
+                    memcpy(indices->items + indices->count, p, 3 * sizeof(u32));
+                    indices->count += 3;
+                } else {
+                    u32 first = ply_read_u32(p, property->type);
+                    u32 previous = ply_read_u32(p + size, property->type);
+                    for (u32 k = 2; k < count; k++) {
+                        u32 current = ply_read_u32(p + k * size, property->type);
+                        indices->items[indices->count++] = first;
+                        indices->items[indices->count++] = previous;
+                        indices->items[indices->count++] = current;
+                        previous = current;
+                    }
+                }
+            }
+            p += (size_t)count * size;
+        }
+        if (element->kind == PLY_ELEMENT_VERTEX) memcpy(&m->verts.items[m->verts.count++], values, sizeof(Vertex));
+    }
+    *cursor = p;
+    return IO_SUCCESS;
+}
+
+IOStatus model_from_ply(const char* file_path, Model* m) {
+    string_t file;
+    IO_CHECK(file_map(&file, file_path, FILE_MAP_POPULATE));
+    PlyHeader header = {0};
+    IOStatus status = ply_parse_header(&file, file_path, &header);
+
+    const u8* cursor = (const u8*)file.data + header.data_offset;
+    const u8* end = (const u8*)file.data + file.size;
+    for (u32 e = 0; e < header.element_count && status == IO_SUCCESS; e++) {
+        status = ply_read_element(&header, &header.elements[e], &cursor, end, m);
+        if (status == IO_ERROR_PARSE) fprintf(stderr, "[MODEL] %s ends in the middle of its data\n", file_path);
+    }
+    file_unmap(&file);
+
+    // the faces may come before the vertices, so the indices are checked once both are read
+    for (size_t i = 0; i < m->indices.count && status == IO_SUCCESS; i++) {
+        if (m->indices.items[i] >= m->verts.count) {
+            fprintf(stderr, "[MODEL] Vertex index %u out of range in %s\n", m->indices.items[i], file_path);
+            status = IO_ERROR_PARSE;
+        }
+    }
+    if (status == IO_SUCCESS) status = binary_finish(m);
+    if (status != IO_SUCCESS) model_free(m);
+    return status;
+}
+
+// =============================================================
+// STL
+// =============================================================
+
+#define STL_HEADER_SIZE 80
+// facet normal, 3 corners and a 16-bit attribute, without padding
+#define STL_TRIANGLE_SIZE 50
+
+IOStatus model_from_stl(const char* file_path, Model* m) {
+    string_t file;
+    IO_CHECK(file_map(&file, file_path, FILE_MAP_POPULATE));
+
+    // text STL files start with "solid" like many binary ones, the size tells them apart
+    u32 triangle_count = 0;
+    if (file.size >= STL_HEADER_SIZE + sizeof(u32)) memcpy(&triangle_count, file.data + STL_HEADER_SIZE, sizeof(u32));
+    const u8* record = (const u8*)file.data + STL_HEADER_SIZE + sizeof(u32);
+    if (file.size < STL_HEADER_SIZE + sizeof(u32) ||
+        (u64)(file.size - STL_HEADER_SIZE - sizeof(u32)) < (u64)triangle_count * STL_TRIANGLE_SIZE) {
+        fprintf(stderr, "[MODEL] %s is not a binary STL file\n", file_path);
+        file_unmap(&file);
+        return IO_ERROR_PARSE;
+    }
+    size_t corner_count = (size_t)triangle_count * 3;
+    if (corner_count > UINT32_MAX) {
+        file_unmap(&file);
+        return IO_ERROR_MEMORY;
+    }
+
+    size_t map_capacity = 16;
+    while (map_capacity < corner_count * 2) map_capacity *= 2;
+    u32* map = calloc(map_capacity, sizeof(u32));  // vertex id + 1, 0 marks an empty slot
+    // upper bound, trimmed once the corners are welded
+    if (!map || !da_reserve(m->verts, corner_count) || !da_reserve(m->indices, corner_count)) {
+        free(map);
+        file_unmap(&file);
+        model_free(m);
+        return IO_ERROR_MEMORY;
+    }
+
+    for (size_t t = 0; t < triangle_count; t++, record += STL_TRIANGLE_SIZE) {
+        for (int c = 0; c < 3; c++) {
+            f32 key[3];
+            memcpy(key, record + (size_t)(c + 1) * sizeof(key), sizeof(key));
+            // + 0.0f turns -0 into +0, they are the same position
+            for (int i = 0; i < 3; i++) key[i] += 0.0f;
+            u32 bits[3];
+            memcpy(bits, key, sizeof(bits));
+            u32 h = bits[0] * 0x9E3779B1u ^ bits[1] * 0x85EBCA77u ^ bits[2] * 0xC2B2AE3Du;
+            h ^= h >> 15;
+            size_t slot = h & (map_capacity - 1);
+            while (map[slot] != 0 && memcmp(m->verts.items[map[slot] - 1].position.elements, key, sizeof(key)) != 0) {
+                slot = (slot + 1) & (map_capacity - 1);
+            }
+            if (map[slot] == 0) {
+                Vertex vertex = {0};
+                memcpy(vertex.position.elements, key, sizeof(key));
+                m->verts.items[m->verts.count++] = vertex;
+                map[slot] = (u32)m->verts.count;
+            }
+            m->indices.items[m->indices.count++] = map[slot] - 1;
+        }
+    }
+    free(map);
+    file_unmap(&file);
+
+    // give back the part of the vertex upper bound that welding didn't use
+    da_shrink_to_fit(m->verts);
+    IOStatus status = binary_finish(m);
+    if (status != IO_SUCCESS) model_free(m);
+    return status;
+}
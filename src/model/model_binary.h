@@ -0,0 +1,38 @@
+#pragma once
+#include "common/files.h"
+#include "common/defines.h"
+#include "model/model.h"
+
+// =============================================================
+// Binary model formats
+// =============================================================
+// Scans and CAD exports often come as binary PLY or STL. The file is mapped (see
+// file_map) and its little endian payload copied straight into the vertex and index
+// arrays, there is almost nothing to parse. The result is the same as model_from_obj:
+// an indexed mesh with a single level of detail and a single submesh without material,
+// bounds, and smooth normals for the vertices that have none (see model/model_normals.h).
+
+/*
+* @brief Import a binary little endian .ply file. Vertex positions come from x/y/z,
+*   normals from nx/ny/nz and uvs from u/v (or s/t, texture_u/texture_v), in any of
+*   the PLY scalar types. Faces are read from vertex_indices (or vertex_index) and
+*   polygons are triangulated as fans. Other elements and properties are skipped.
+*
+* @param file_path Path of the .ply file.
+* @param m The model to fill.
+* @return IO_SUCCESS, IO_ERROR_OPEN/READ/EMPTY/MEMORY, or IO_ERROR_PARSE if the file is
+*   not binary little endian PLY or an index is out of range.
+*/
+IOStatus model_from_ply(const char* file_path, Model* m);
+
+/*
+* @brief Import a binary .stl file. STL stores three separate corners per triangle:
+*   corners at the same position are welded into one vertex and the normals are
+*   generated smooth, the facet normals of the file are ignored.
+*
+* @param file_path Path of the .stl file.
+* @param m The model to fill.
+* @return IO_SUCCESS, IO_ERROR_OPEN/READ/EMPTY/MEMORY, or IO_ERROR_PARSE if the file is
+*   a text STL file or shorter than its triangle count says.
+*/
+IOStatus model_from_stl(const char* file_path, Model* m);
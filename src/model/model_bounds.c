@@ -0,0 +1,95 @@
+#include "model_bounds.h"
+#include "math/linalg.h"
+#include <math.h>
+
+#if defined(__SSE__) || defined(_M_X64)
+#include <xmmintrin.h>
+#define MODEL_BOUNDS_SSE 1
+#endif
+
+static void bounds_box(const Vertex* verts, size_t vertex_count, vec3* min, vec3* max) {
+#ifdef MODEL_BOUNDS_SSE
+    // Each load takes the position and the first uv component, the 4th lane is ignored.
+    // Two pairs of accumulators so that consecutive min/max don't wait on each other.
+    __m128 lo0 = _mm_loadu_ps(verts[0].position.elements);
+    __m128 hi0 = lo0, lo1 = lo0, hi1 = lo0;
+    size_t i = 1;
+    for (; i + 1 < vertex_count; i += 2) {
+        __m128 a = _mm_loadu_ps(verts[i].position.elements);
+        __m128 b = _mm_loadu_ps(verts[i + 1].position.elements);
+        lo0 = _mm_min_ps(lo0, a);
+        hi0 = _mm_max_ps(hi0, a);
+        lo1 = _mm_min_ps(lo1, b);
+        hi1 = _mm_max_ps(hi1, b);
+    }
+    if (i < vertex_count) {
+        __m128 a = _mm_loadu_ps(verts[i].position.elements);
+        lo0 = _mm_min_ps(lo0, a);
+        hi0 = _mm_max_ps(hi0, a);
+    }
+    f32 lo[4], hi[4];
+    _mm_storeu_ps(lo, _mm_min_ps(lo0, lo1));
+    _mm_storeu_ps(hi, _mm_max_ps(hi0, hi1));
+    *min = (vec3){{ lo[0], lo[1], lo[2] }};
+    *max = (vec3){{ hi[0], hi[1], hi[2] }};
+#else
+    *min = verts[0].position;
+    *max = verts[0].position;
+    for (size_t i = 1; i < vertex_count; i++) {
+        for (int axis = 0; axis < 3; axis++) {
+            f32 value = verts[i].position.elements[axis];
+            if (value < min->elements[axis]) min->elements[axis] = value;
+            if (value > max->elements[axis]) max->elements[axis] = value;
+        }
+    }
+#endif
+}
+
+static size_t bounds_farthest(const Vertex* verts, size_t vertex_count, vec3 from) {
+    size_t farthest = 0;
+    f32 farthest_distance = -1.0f;
+    for (size_t i = 0; i < vertex_count; i++) {
+        vec3 d = vec3_sub(verts[i].position, from);
+        f32 distance = vec3_dot_prod(d, d);
+        if (distance > farthest_distance) {
+            farthest = i;
+            farthest_distance = distance;
+        }
+    }
+    return farthest;
+}
+
+void model_bounds_compute(const Vertex* verts, size_t vertex_count, ModelBounds* out) {
+    *out = (ModelBounds){0};
+    if (vertex_count == 0) return;
+    bounds_box(verts, vertex_count, &out->min, &out->max);
+
+    // Ritter: start from two points far apart, then grow the sphere just enough to
+    // include every point left outside
+    vec3 a = verts[bounds_farthest(verts, vertex_count, verts[0].position)].position;
+    vec3 b = verts[bounds_farthest(verts, vertex_count, a)].position;
+    vec3 center = vec3_mul_scalar(vec3_sum(a, b), 0.5f);
+    f32 radius = vec3_length(vec3_sub(b, a)) * 0.5f;
+    for (size_t i = 0; i < vertex_count; i++) {
+        vec3 d = vec3_sub(verts[i].position, center);
+        f32 distance = vec3_length(d);
+        if (distance > radius) {
+            f32 grown = (radius + distance) * 0.5f;
+            center = vec3_sum(center, vec3_mul_scalar(d, (grown - radius) / distance));
+            radius = grown;
+        }
+    }
+
+    // The growth steps round, so the radius is measured again from the final center.
+    // The sphere around the box wins for some shapes (a cube for one).
+    vec3 box_center = vec3_mul_scalar(vec3_sum(out->min, out->max), 0.5f);
+    f32 ritter_radius = 0.0f, box_radius = 0.0f;
+    for (size_t i = 0; i < vertex_count; i++) {
+        f32 distance = vec3_length(vec3_sub(verts[i].position, center));
+        f32 box_distance = vec3_length(vec3_sub(verts[i].position, box_center));
+        if (distance > ritter_radius) ritter_radius = distance;
+        if (box_distance > box_radius) box_radius = box_distance;
+    }
+    out->center = box_radius < ritter_radius ? box_center : center;
+    out->radius = box_radius < ritter_radius ? box_radius : ritter_radius;
+}
@@ -0,0 +1,20 @@
+#pragma once
+#include "common/defines.h"
+#include "model/model.h"
+
+// =============================================================
+// Bounding volumes
+// =============================================================
+// The box comes from a SIMD min/max reduction over the positions, the sphere from
+// Ritter's algorithm ("An Efficient Bounding Sphere", 1990), kept only when it's tighter
+// than the sphere around the box.
+
+/*
+* @brief Compute the bounding box and sphere of a set of vertices.
+*
+* @param verts The vertices.
+* @param vertex_count Number of vertices, if 0 the bounds are all zero.
+* @param out Where to store the bounds.
+* @return void
+*/
+void model_bounds_compute(const Vertex* verts, size_t vertex_count, ModelBounds* out);
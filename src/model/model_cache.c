@@ -0,0 +1,263 @@
+#define _DEFAULT_SOURCE
+#include "model_cache.h"
+#include "common/hash.h"
+#include "common/pak.h"
+#include "model/model_material.h"
+#include <fcntl.h>
+#include <stddef.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+
+#define TMESH_EXTENSION ".tmesh"
+
+// "<source_path>.tmesh", returns NULL if out of memory
+static char* model_cache_path(const char* source_path) {
+    size_t len = strlen(source_path);
+    char* path = malloc(len + sizeof(TMESH_EXTENSION));
+    if (!path) return NULL;
+    memcpy(path, source_path, len);
+    memcpy(path + len, TMESH_EXTENSION, sizeof(TMESH_EXTENSION));
+    return path;
+}
+
+static IOStatus model_cache_stat_file(const char* path, u64* size, i64* mtime_ns) {
+    struct stat st;
+    if (stat(path, &st) != 0) return IO_ERROR_OPEN;
+    *size = (u64)st.st_size;
+    *mtime_ns = (i64)st.st_mtim.tv_sec * 1000000000 + st.st_mtim.tv_nsec;
+    return IO_SUCCESS;
+}
+
+static IOStatus model_cache_hash_file(const char* path, u64* hash) {
+    string_t content;
+    IOStatus status = file_map(&content, path, 0);
+    if (status == IO_ERROR_EMPTY) {
+        *hash = hash_bytes(NULL, 0, 0);
+        return IO_SUCCESS;
+    }
+    IO_CHECK(status);
+    *hash = hash_bytes(content.data, content.size, 0);
+    file_unmap(&content);
+    return IO_SUCCESS;
+}
+
+// Whether a file is still what it was: the fast check is size and mtime, and only if they
+// changed the content itself is compared. When only the mtime changed it is updated, so
+// that the content isn't hashed again next time.
+static int model_cache_file_unchanged(const char* path, u64 hash, u64 size, i64* mtime_ns) {
+    u64 current_size;
+    i64 current_mtime_ns;
+    if (model_cache_stat_file(path, &current_size, &current_mtime_ns) != IO_SUCCESS) return *mtime_ns == TMESH_MISSING;
+    if (*mtime_ns == TMESH_MISSING || current_size != size) return 0;
+    if (current_mtime_ns == *mtime_ns) return 1;
+    u64 current_hash;
+    if (model_cache_hash_file(path, &current_hash) != IO_SUCCESS || current_hash != hash) return 0;
+    *mtime_ns = current_mtime_ns;
+    return 1;
+}
+
+// The library at *offset in the part of a cache before the mesh, moves offset to the next
+// one. Returns NULL if it doesn't fit before the mesh.
+static TMeshLibrary* model_cache_next_library(u8* prefix, u64 mesh_offset, u64* offset) {
+    if (mesh_offset - *offset < sizeof(TMeshLibrary)) return NULL;
+    TMeshLibrary* library = (TMeshLibrary*)(prefix + *offset);
+    u64 path = *offset + sizeof(TMeshLibrary);
+    if (library->path_size == 0 || mesh_offset - path < library->path_size || prefix[path + library->path_size - 1] != '\0') {
+        return NULL;
+    }
+    *offset = align_up(path + library->path_size, 8);
+    return library;
+}
+
+// Check that the part of a cache before the mesh describes this source processed with
+// flags, and that neither the source nor its libraries changed since. The mtimes in prefix
+// are updated for the files that were only touched. The mesh itself is checked by
+// packed_mesh_from_memory.
+static IOStatus model_cache_validate(u8* prefix, const char* source_path, u32 flags) {
+    TMeshHeader* header = (TMeshHeader*)prefix;
+    if (header->path_hash != hash_string(source_path)) return IO_ERROR_STALE;
+    if (header->flags != flags) return IO_ERROR_STALE;
+
+    // the libraries are all checked for damage before any file is compared
+    u64 offset = sizeof(TMeshHeader);
+    for (u32 i = 0; i < header->library_count; i++) {
+        if (!model_cache_next_library(prefix, header->mesh_offset, &offset)) return IO_ERROR_PARSE;
+    }
+
+    // a cache without its source is still usable
+    if (access(source_path, F_OK) != 0) return IO_SUCCESS;
+    if (!model_cache_file_unchanged(source_path, header->source_hash, header->source_size, &header->source_mtime_ns)) {
+        return IO_ERROR_STALE;
+    }
+    offset = sizeof(TMeshHeader);
+    for (u32 i = 0; i < header->library_count; i++) {
+        TMeshLibrary* library = model_cache_next_library(prefix, header->mesh_offset, &offset);
+        if (!model_cache_file_unchanged((const char*)(library + 1), library->hash, library->size, &library->mtime_ns)) {
+            return IO_ERROR_STALE;
+        }
+    }
+    return IO_SUCCESS;
+}
+
+IOStatus model_cache_load(const char* source_path, PackedMesh* mesh, u32 flags) {
+    char* cache_path = model_cache_path(source_path);
+    if (!cache_path) return IO_ERROR_MEMORY;
+    int fd = open(cache_path, O_RDONLY);
+    if (fd < 0) {
+        free(cache_path);
+        return IO_ERROR_OPEN;
+    }
+
+    struct stat st;
+    if (fstat(fd, &st) != 0 || (u64)st.st_size < sizeof(TMeshHeader)) {
+        close(fd);
+        free(cache_path);
+        return IO_ERROR_STALE;
+    }
+    size_t size = (size_t)st.st_size;
+    void* mapping = mmap(NULL, size, PROT_READ, MAP_PRIVATE, fd, 0);
+    close(fd);
+    if (mapping == MAP_FAILED) {
+        free(cache_path);
+        return IO_ERROR_READ;
+    }
+
+    // the mapping is page aligned, so the mesh is aligned like in the file
+    const TMeshHeader* header = mapping;
+    IOStatus status = IO_SUCCESS;
+    if (header->magic != TMESH_MAGIC || header->version != TMESH_VERSION) {
+        status = IO_ERROR_STALE;
+    } else if (header->mesh_offset < sizeof(TMeshHeader) || header->mesh_offset % PACKED_MESH_ALIGNMENT != 0 ||
+               header->mesh_offset > size) {
+        status = IO_ERROR_PARSE;
+    }
+    // the header and the libraries are checked on a copy, where the mtimes can be updated
+    u8* prefix = status == IO_SUCCESS ? malloc(header->mesh_offset) : NULL;
+    if (status == IO_SUCCESS && !prefix) status = IO_ERROR_MEMORY;
+    if (status == IO_SUCCESS) {
+        memcpy(prefix, mapping, header->mesh_offset);
+        status = model_cache_validate(prefix, source_path, flags);
+    }
+    if (status == IO_SUCCESS) {
+        status = packed_mesh_from_memory((const u8*)mapping + header->mesh_offset, size - header->mesh_offset, mesh);
+    }
+    if (status == IO_SUCCESS && memcmp(prefix, mapping, header->mesh_offset) != 0) {
+        // only mtimes changed: store the new ones so that the files aren't hashed again
+        // on every load. Not fatal if it fails, the cache is still valid.
+        fd = open(cache_path, O_WRONLY);
+        if (fd >= 0) {
+            ssize_t written = pwrite(fd, prefix, header->mesh_offset, 0);
+            (void)written;
+            close(fd);
+        }
+    }
+    free(prefix);
+    free(cache_path);
+    if (status != IO_SUCCESS) {
+        munmap(mapping, size);
+        return status;
+    }
+    // the whole file is about to be uploaded, start reading it in now
+    madvise(mapping, size, MADV_WILLNEED);
+    mesh->mapping = mapping;
+    mesh->mapping_size = size;
+    return IO_SUCCESS;
+}
+
+// What model_cache_save writes
+typedef struct {
+    const u8* prefix;       // header and libraries
+    u64 prefix_size;
+    const PackedMesh* mesh;
+} TMeshContents;
+
+static int model_cache_write_file(FILE* fp, void* context) {
+    const TMeshContents* contents = context;
+    const TMeshHeader* header = (const TMeshHeader*)contents->prefix;
+    return file_write_at(fp, 0, contents->prefix, contents->prefix_size) &&
+           file_write_at(fp, header->mesh_offset, NULL, 0) &&
+           packed_mesh_write_file(fp, (void*)contents->mesh);
+}
+
+// The header and the libraries of the cache of source_path, in a buffer to free
+static IOStatus model_cache_prefix(const char* source_path, u32 flags, u8** out, u64* out_size) {
+    path_darray paths = {0};
+    IOStatus status = material_library_paths(source_path, &paths);
+    u64 size = sizeof(TMeshHeader);
+    for (size_t i = 0; i < paths.count; i++) size = align_up(size + sizeof(TMeshLibrary) + strlen(paths.items[i]) + 1, 8);
+    u8* prefix = status == IO_SUCCESS ? calloc(1, size) : NULL;
+    if (status == IO_SUCCESS && !prefix) status = IO_ERROR_MEMORY;
+    if (status != IO_SUCCESS) {
+        path_darray_free(&paths);
+        return status;
+    }
+
+    TMeshHeader* header = (TMeshHeader*)prefix;
+    header->magic = TMESH_MAGIC;
+    header->version = TMESH_VERSION;
+    header->flags = flags;
+    header->library_count = (u32)paths.count;
+    header->path_hash = hash_string(source_path);
+    header->mesh_offset = align_up(size, PACKED_MESH_ALIGNMENT);
+    status = model_cache_stat_file(source_path, &header->source_size, &header->source_mtime_ns);
+    if (status == IO_SUCCESS) status = model_cache_hash_file(source_path, &header->source_hash);
+
+    u64 offset = sizeof(TMeshHeader);
+    for (size_t i = 0; i < paths.count && status == IO_SUCCESS; i++) {
+        TMeshLibrary* library = (TMeshLibrary*)(prefix + offset);
+        const char* path = paths.items[i];
+        library->path_size = (u32)strlen(path) + 1;
+        memcpy(library + 1, path, library->path_size);
+        if (model_cache_stat_file(path, &library->size, &library->mtime_ns) != IO_SUCCESS) {
+            library->mtime_ns = TMESH_MISSING;
+        } else {
+            status = model_cache_hash_file(path, &library->hash);
+        }
+        offset = align_up(offset + sizeof(TMeshLibrary) + library->path_size, 8);
+    }
+    path_darray_free(&paths);
+    if (status != IO_SUCCESS) {
+        free(prefix);
+        return status;
+    }
+    *out = prefix;
+    *out_size = size;
+    return IO_SUCCESS;
+}
+
+IOStatus model_cache_save(const char* source_path, const PackedMesh* mesh, u32 flags) {
+    TMeshContents contents = { .mesh = mesh };
+    u8* prefix;
+    IO_CHECK(model_cache_prefix(source_path, flags, &prefix, &contents.prefix_size));
+    contents.prefix = prefix;
+
+    char* cache_path = model_cache_path(source_path);
+    IOStatus status = cache_path ? file_write_atomic(cache_path, model_cache_write_file, &contents) : IO_ERROR_MEMORY;
+    free(cache_path);
+    free(prefix);
+    return status;
+}
+
+IOStatus model_load_packed(const char* file_path, PackedMesh* out, u32 flags) {
+    // a model from the mounted archive has no file to put its cache next to
+    string_t packed;
+    int cached = !(flags & MODEL_LOAD_NO_CACHE) && pak_mounted_find(file_path, &packed) != IO_SUCCESS;
+    if (cached && model_cache_load(file_path, out, flags) == IO_SUCCESS) return IO_SUCCESS;
+
+    Model model = {0};
+    IO_CHECK(model_load(file_path, &model, flags, NULL));
+    IOStatus status = model_pack(&model, out);
+    model_free(&model);
+    IO_CHECK(status);
+
+    status = cached ? model_cache_save(file_path, out, flags) : IO_SUCCESS;
+    if (status != IO_SUCCESS) {
+        // not fatal, the model will just be imported again next time
+        fprintf(stderr, "[MODEL] Could not write the cache of %s (code %d)\n", file_path, status);
+    }
+    return IO_SUCCESS;
+}
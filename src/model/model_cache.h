@@ -0,0 +1,87 @@
+#pragma once
+#include "common/files.h"
+#include "common/defines.h"
+#include "model/model.h"
+#include "model/model_pack.h"
+
+// =============================================================
+// Binary mesh cache (.tmesh)
+// =============================================================
+// A model loaded with model_load_packed is saved next to its source as "<source>.tmesh":
+// a header with the cache key, followed by the packed mesh exactly as tiro-cook writes a
+// cooked .mesh (see model/model_pack.h). There is a single binary mesh format: loading a
+// cache maps the file read-only and hands the mesh to packed_mesh_from_memory, which
+// checks it and points the arrays straight into the mapping, so the blobs can be handed
+// to glBufferStorage without any parsing or copy.
+//
+// The cache is keyed on the source path, modification time and content hash, and on the
+// same for every material library the source uses (the materials are in the cache too):
+// when the mtime or size of one of them changed its content is hashed again, and the cache
+// is rejected only if the content is actually different. The header is followed by one
+// TMeshLibrary per library, each one followed by its path.
+
+#define TMESH_MAGIC       0x48534D54u   // "TMSH" read as a little-endian u32
+#define TMESH_VERSION     1
+// TMeshLibrary.mtime_ns of a library that didn't exist, creating it changes the model
+#define TMESH_MISSING     (-1)
+
+typedef struct {
+    u32 magic;
+    u32 version;
+    u32 flags;              // ModelLoadFlags the model was processed with
+    u32 library_count;
+    // cache key
+    u64 path_hash;
+    u64 source_hash;
+    u64 source_size;
+    i64 source_mtime_ns;
+    // the packed mesh, up to the end of the file, aligned on PACKED_MESH_ALIGNMENT
+    u64 mesh_offset;
+} TMeshHeader;
+
+// A material library of the source, as it was when the cache was written
+typedef struct {
+    u64 hash;
+    u64 size;
+    i64 mtime_ns;           // TMESH_MISSING if it didn't exist
+    u32 path_size;          // the path that follows, NUL included, the next library is 8 byte aligned
+    u32 reserved;
+} TMeshLibrary;
+
+/*
+* @brief Load a model ready for upload: from its cache if there is a valid one, otherwise
+*   the source is loaded with model_load, packed with model_pack and the cache is written
+*   for the next time. Models in the mounted content archive (see common/pak.h) are always
+*   imported, there is no cache for them, and so are models loaded with MODEL_LOAD_NO_CACHE.
+*
+* @param file_path Path of the source asset.
+* @param out The packed mesh, release it with packed_mesh_free.
+* @param flags ModelLoadFlags.
+* @return IO_SUCCESS or the error of importing the source.
+*/
+IOStatus model_load_packed(const char* file_path, PackedMesh* out, u32 flags);
+
+/*
+* @brief Load the cache of a model if it's still valid.
+*   On success the arrays of mesh point into a read-only mapping of the cache file,
+*   they must not be modified and packed_mesh_free unmaps it.
+*
+* @param source_path Path of the source asset (e.g. the .obj file).
+* @param mesh The mesh to fill.
+* @param flags ModelLoadFlags the cached model must have been processed with, no more and no less.
+* @return IO_SUCCESS, IO_ERROR_OPEN if there is no cache, IO_ERROR_STALE if it's
+*   outdated, was processed differently or was written by an incompatible version,
+*   IO_ERROR_PARSE if it is damaged.
+*/
+IOStatus model_cache_load(const char* source_path, PackedMesh* mesh, u32 flags);
+
+/*
+* @brief Write the cache of a model loaded from source_path.
+*   The file is written under a temporary name and renamed, so a reader never sees it half written.
+*
+* @param source_path Path of the source asset the model was imported from.
+* @param mesh The packed model.
+* @param flags ModelLoadFlags the model was processed with.
+* @return IO_SUCCESS or the error that prevented writing the cache.
+*/
+IOStatus model_cache_save(const char* source_path, const PackedMesh* mesh, u32 flags);
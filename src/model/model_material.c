@@ -0,0 +1,139 @@
+#include "model_material.h"
+#include "common/parse.h"
+#include "common/scan.h"
+#include <stdlib.h>
+#include <string.h>
+
+// If the line starts with keyword followed by a space, returns the rest of the line
+static const char* mtl_keyword(const char* cursor, const char* end, const char* keyword) {
+    size_t length = strlen(keyword);
+    if ((size_t)(end - cursor) <= length || memcmp(cursor, keyword, length) != 0) return NULL;
+    if (cursor[length] != ' ' && cursor[length] != '\t') return NULL;
+    return parse_skip_spaces(cursor + length, end);
+}
+
+// End of the line without the trailing spaces (and the '\r' of CRLF files)
+static const char* mtl_trim_end(const char* cursor, const char* end) {
+    while (end > cursor && (end[-1] == ' ' || end[-1] == '\t' || end[-1] == '\r')) end--;
+    return end;
+}
+
+// Copy [begin, end) as a NUL terminated string, truncated to fit size bytes
+static void mtl_copy_string(char* out, size_t size, const char* begin, const char* end) {
+    size_t length = (size_t)(end - begin);
+    if (length > size - 1) length = size - 1;
+    memcpy(out, begin, length);
+    out[length] = '\0';
+}
+
+static void mtl_parse_color(const char* cursor, const char* end, vec3* out) {
+    for (int i = 0; i < 3; i++) {
+        cursor = parse_f32(parse_skip_spaces(cursor, end), end, &out->elements[i]);
+    }
+}
+
+// "map_Kd [options] file": with options the file is the last token, otherwise it's
+// the whole rest of the line so that names with spaces work
+static void mtl_parse_map(const char* cursor, const char* end, const char* mtl_path, char* out) {
+    end = mtl_trim_end(cursor, end);
+    if (cursor < end && *cursor == '-') {
+        const char* last = end;
+        while (last > cursor && last[-1] != ' ' && last[-1] != '\t') last--;
+        cursor = last;
+    }
+    char name[MODEL_PATH_SIZE];
+    mtl_copy_string(name, sizeof(name), cursor, end);
+    if (file_sibling_path(out, MODEL_PATH_SIZE, mtl_path, name) != IO_SUCCESS) {
+        fprintf(stderr, "[MODEL] Texture path too long in %s: %s\n", mtl_path, name);
+        out[0] = '\0';
+    }
+}
+
+IOStatus material_library_load(const char* mtl_path, material_darray* materials) {
+    string_t content;
+    IO_CHECK(file_map(&content, mtl_path, 0));
+
+    size_t first = materials->count;
+    Material* material = NULL;
+    const char* cursor = content.data;
+    const char* file_end = content.data + content.size;
+    while (cursor < file_end) {
+        const char* end = scan_line_end(cursor, file_end);
+        const char* line = parse_skip_spaces(cursor, end);
+        const char* rest;
+        cursor = end + 1;
+
+        if ((rest = mtl_keyword(line, end, "newmtl"))) {
+            Material defaults = {
+                .diffuse = {{ 1.0f, 1.0f, 1.0f }},
+                .opacity = 1.0f,
+            };
+            mtl_copy_string(defaults.name, sizeof(defaults.name), rest, mtl_trim_end(rest, end));
+            if (!da_append(*materials, defaults)) {
+                file_unmap(&content);
+                return IO_ERROR_MEMORY;
+            }
+            material = &materials->items[materials->count - 1];
+        }
+        // everything else belongs to the last newmtl
+        else if (!material) continue;
+        else if ((rest = mtl_keyword(line, end, "Ka"))) mtl_parse_color(rest, end, &material->ambient);
+        else if ((rest = mtl_keyword(line, end, "Kd"))) mtl_parse_color(rest, end, &material->diffuse);
+        else if ((rest = mtl_keyword(line, end, "Ks"))) mtl_parse_color(rest, end, &material->specular);
+        else if ((rest = mtl_keyword(line, end, "Ns"))) parse_f32(rest, end, &material->shininess);
+        else if ((rest = mtl_keyword(line, end, "d"))) parse_f32(rest, end, &material->opacity);
+        else if ((rest = mtl_keyword(line, end, "Tr"))) {
+            f32 transparency = 0.0f;
+            parse_f32(rest, end, &transparency);
+            material->opacity = 1.0f - transparency;
+        }
+        else if ((rest = mtl_keyword(line, end, "map_Kd"))) mtl_parse_map(rest, end, mtl_path, material->diffuse_map);
+    }
+
+    file_unmap(&content);
+    printf("[MODEL] Loaded %zu materials from %s\n", materials->count - first, mtl_path);
+    return IO_SUCCESS;
+}
+
+IOStatus material_library_paths(const char* source_path, path_darray* paths) {
+    if (model_has_extension(source_path, "ply") || model_has_extension(source_path, "stl")) return IO_SUCCESS;
+    string_t content;
+    IOStatus status = file_map(&content, source_path, 0);
+    if (status != IO_SUCCESS) return status == IO_ERROR_EMPTY ? IO_SUCCESS : status;
+
+    const char* cursor = content.data;
+    const char* file_end = content.data + content.size;
+    while (cursor < file_end && status == IO_SUCCESS) {
+        const char* end = scan_line_end(cursor, file_end);
+        const char* line = parse_skip_spaces(cursor, end);
+        const char* rest = mtl_keyword(line, end, "mtllib");
+        cursor = end + 1;
+        if (!rest) continue;
+
+        // the same names and paths as obj_apply_event gives material_library_load,
+        // a line can list several libraries
+        end = mtl_trim_end(rest, end);
+        while (rest < end && status == IO_SUCCESS) {
+            const char* name_end = scan_token_end(rest, end);
+            char name[MODEL_PATH_SIZE];
+            char path[MODEL_PATH_SIZE];
+            mtl_copy_string(name, sizeof(name), rest, name_end);
+            if (file_sibling_path(path, sizeof(path), source_path, name) == IO_SUCCESS) {
+                status = path_darray_add(paths, path);
+            }
+            rest = parse_skip_spaces(name_end, end);
+        }
+    }
+    file_unmap(&content);
+    return status;
+}
+
+u32 material_find(const material_darray* materials, const char* name, size_t name_length) {
+    // names are truncated when stored, so compare the truncated version
+    if (name_length > MODEL_NAME_SIZE - 1) name_length = MODEL_NAME_SIZE - 1;
+    for (size_t i = materials->count; i > 0; i--) {
+        const char* candidate = materials->items[i - 1].name;
+        if (strncmp(candidate, name, name_length) == 0 && candidate[name_length] == '\0') return (u32)(i - 1);
+    }
+    return MODEL_NO_MATERIAL;
+}
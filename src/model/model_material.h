@@ -0,0 +1,41 @@
+#pragma once
+#include "common/files.h"
+#include "common/defines.h"
+#include "model/model.h"
+
+// =============================================================
+// Materials
+// =============================================================
+// .mtl libraries referenced by "mtllib" in .obj files. Only what the renderer uses is
+// kept: the Ka/Kd/Ks colors, Ns, d/Tr and the diffuse texture (map_Kd), whose path is
+// resolved against the directory of the library.
+
+/*
+* @brief Append the materials of a .mtl file.
+*
+* @param mtl_path Path of the .mtl file.
+* @param materials Where to append the materials, the ones already there are kept.
+* @return IO_SUCCESS, or the error of reading the file / IO_ERROR_MEMORY.
+*/
+IOStatus material_library_load(const char* mtl_path, material_darray* materials);
+
+/*
+* @brief List the material libraries a source model uses: the files of the "mtllib" lines
+*   of an .obj file, resolved the way the importer resolves them, whether they exist or not.
+*   .ply and .stl files have none.
+*
+* @param source_path Path of the source model.
+* @param paths Where to append the paths it doesn't have yet, release them with path_darray_free.
+* @return IO_SUCCESS, or the error of reading the file / IO_ERROR_MEMORY.
+*/
+IOStatus material_library_paths(const char* source_path, path_darray* paths);
+
+/*
+* @brief Find a material by name.
+*
+* @param materials The materials to search.
+* @param name The name, it doesn't have to be NUL terminated.
+* @param name_length Length of the name.
+* @return The index of the last material with that name, or MODEL_NO_MATERIAL.
+*/
+u32 material_find(const material_darray* materials, const char* name, size_t name_length);
@@ -0,0 +1,460 @@
+#include "model_meshlet.h"
+#include "common/hash.h"
+#include "math/linalg.h"
+#include <float.h>
+#include <math.h>
+#include <stdlib.h>
+#include <string.h>
+
+// How much a triangle bending away from the meshlet normal costs, in new vertices
+#define MESHLET_CONE_WEIGHT 0.5f
+// Most triangles in a leaf of the k-d tree
+#define MESHLET_KD_LEAF_SIZE 8
+
+// Node of the k-d tree of the triangle centroids of a submesh: a leaf is a range of
+// items, an inner node splits its triangles in two on an axis
+typedef struct {
+    f32 split;
+    u32 axis;                   // 3 for a leaf
+    u32 first;                  // leaf: range of items
+    u32 count;
+    u32 left;                   // inner node: children
+    u32 right;
+} MeshletKdNode;
+
+typedef struct {
+    const vec3* centroids;
+    MeshletKdNode* nodes;
+    u32 node_count;
+    u32* items;                 // triangle indices, grouped by leaf
+} MeshletKdTree;
+
+// Triangle -> meshlet assignment state
+typedef struct {
+    const u32* indices;
+    const u32* position_id;     // vertex -> the first vertex at the same position
+    const vec3* normals;        // unit face normal of each triangle
+    const vec3* centroids;
+    const u8* emitted;
+    u32* offsets;               // position -> triangles adjacency, only the live ones are kept
+    u32* live;
+    u32* adjacency;
+    u32* in_meshlet;            // meshlet id + 1 of the last meshlet that used the vertex
+    u32 first_triangle;         // triangles of the current submesh, the others are never picked
+    u32 end_triangle;
+    u32 vertices[MESHLET_MAX_VERTICES];
+    u32 vertex_count;
+    u32 triangle_count;
+    vec3 normal_sum;
+    vec3 centroid_sum;
+} MeshletBuilder;
+
+static int u32_compare(const void* a, const void* b) {
+    u32 x = *(const u32*)a;
+    u32 y = *(const u32*)b;
+    return (x > y) - (x < y);
+}
+
+// Vertices at the same position share a position id, the first of them. The adjacency
+// goes through positions: a flat shaded or uv mapped surface is split in separate vertices
+// at every seam, but its triangles are still neighbours.
+static void meshlet_weld_positions(const Vertex* verts, size_t vertex_count, u32* position_id, u32* table, size_t table_capacity) {
+    memset(table, 0xFF, table_capacity * sizeof(u32));
+    for (size_t i = 0; i < vertex_count; i++) {
+        size_t slot = (size_t)hash_bytes(verts[i].position.elements, sizeof(vec3), 0) & (table_capacity - 1);
+        while (table[slot] != 0xFFFFFFFFu &&
+               memcmp(verts[table[slot]].position.elements, verts[i].position.elements, sizeof(vec3)) != 0) {
+            slot = (slot + 1) & (table_capacity - 1);
+        }
+        if (table[slot] == 0xFFFFFFFFu) table[slot] = (u32)i;
+        position_id[i] = table[slot];
+    }
+}
+
+// Build the subtree of items[first, first + count), split in the middle of its longest side
+static u32 meshlet_kd_build(MeshletKdTree* tree, u32 first, u32 count) {
+    u32 node = tree->node_count++;
+    MeshletKdNode* n = &tree->nodes[node];
+    *n = (MeshletKdNode){ .axis = 3, .first = first, .count = count };
+    if (count <= MESHLET_KD_LEAF_SIZE) return node;
+
+    vec3 min = tree->centroids[tree->items[first]], max = min;
+    for (u32 i = first + 1; i < first + count; i++) {
+        vec3 c = tree->centroids[tree->items[i]];
+        for (int axis = 0; axis < 3; axis++) {
+            if (c.elements[axis] < min.elements[axis]) min.elements[axis] = c.elements[axis];
+            if (c.elements[axis] > max.elements[axis]) max.elements[axis] = c.elements[axis];
+        }
+    }
+    u32 axis = 0;
+    for (u32 k = 1; k < 3; k++) {
+        if (max.elements[k] - min.elements[k] > max.elements[axis] - min.elements[axis]) axis = k;
+    }
+    f32 split = (min.elements[axis] + max.elements[axis]) * 0.5f;
+    u32 i = first, j = first + count;
+    while (i < j) {
+        if (tree->centroids[tree->items[i]].elements[axis] < split) {
+            i++;
+        } else {
+            u32 item = tree->items[i];
+            tree->items[i] = tree->items[--j];
+            tree->items[j] = item;
+        }
+    }
+    // all the centroids at the same place: nothing to split
+    if (i == first || i == first + count) return node;
+
+    u32 left = meshlet_kd_build(tree, first, i - first);
+    u32 right = meshlet_kd_build(tree, i, first + count - i);
+    tree->nodes[node] = (MeshletKdNode){ .split = split, .axis = axis, .left = left, .right = right };
+    return node;
+}
+
+// Closest triangle to p that isn't emitted yet, best stays -1 if there is none
+static void meshlet_kd_nearest(const MeshletKdTree* tree, u32 node, vec3 p, const u8* emitted, i64* best, f32* best_distance) {
+    const MeshletKdNode* n = &tree->nodes[node];
+    if (n->axis == 3) {
+        for (u32 i = n->first; i < n->first + n->count; i++) {
+            u32 t = tree->items[i];
+            if (emitted[t]) continue;
+            vec3 d = vec3_sub(tree->centroids[t], p);
+            f32 distance = vec3_dot_prod(d, d);
+            if (distance < *best_distance) {
+                *best = t;
+                *best_distance = distance;
+            }
+        }
+        return;
+    }
+    f32 delta = p.elements[n->axis] - n->split;
+    meshlet_kd_nearest(tree, delta < 0.0f ? n->left : n->right, p, emitted, best, best_distance);
+    // the other side can only be closer if the splitting plane is
+    if (delta * delta < *best_distance) meshlet_kd_nearest(tree, delta < 0.0f ? n->right : n->left, p, emitted, best, best_distance);
+}
+
+// Best live triangle around the vertices of the current meshlet: few new vertices and a
+// normal close to the ones already in, the closest one between equals so that the meshlet
+// stays round. Returns -1 if none fits.
+static i64 meshlet_next_triangle(const MeshletBuilder* b, u32 meshlet_id) {
+    vec3 axis = vec3_zero();
+    f32 axis_length = vec3_length(b->normal_sum);
+    if (axis_length > 0.0f) axis = vec3_mul_scalar(b->normal_sum, 1.0f / axis_length);
+    vec3 center = vec3_mul_scalar(b->centroid_sum, 1.0f / (f32)b->triangle_count);
+
+    i64 best = -1;
+    f32 best_score = 0.0f;
+    f32 best_distance = 0.0f;
+    for (u32 i = 0; i < b->vertex_count; i++) {
+        u32 v = b->position_id[b->vertices[i]];
+        for (u32 a = b->offsets[v]; a < b->offsets[v] + b->live[v]; a++) {
+            u32 t = b->adjacency[a];
+            if (t < b->first_triangle || t >= b->end_triangle) continue;
+            u32 extra = 0;
+            for (int k = 0; k < 3; k++) extra += b->in_meshlet[b->indices[t * 3 + k]] != meshlet_id;
+            if (b->vertex_count + extra > MESHLET_MAX_VERTICES) continue;
+            f32 score = (f32)extra + (1.0f - vec3_dot_prod(b->normals[t], axis)) * MESHLET_CONE_WEIGHT;
+            vec3 d = vec3_sub(b->centroids[t], center);
+            f32 distance = vec3_dot_prod(d, d);
+            if (best < 0 || score < best_score || (score == best_score && distance < best_distance)) {
+                best = t;
+                best_score = score;
+                best_distance = distance;
+            }
+        }
+    }
+    return best;
+}
+
+// When no triangle around the meshlet fits, it goes on with the closest triangle left in
+// the submesh, like meshoptimizer does: islands and cut off pieces don't each end up in a
+// meshlet of their own. Returns -1 if there is none or it doesn't fit either.
+static i64 meshlet_nearest_triangle(const MeshletBuilder* b, const MeshletKdTree* tree, u32 meshlet_id) {
+    if (b->triangle_count == 0 || tree->node_count == 0) return -1;
+    vec3 center = vec3_mul_scalar(b->centroid_sum, 1.0f / (f32)b->triangle_count);
+    i64 best = -1;
+    f32 best_distance = FLT_MAX;
+    meshlet_kd_nearest(tree, 0, center, b->emitted, &best, &best_distance);
+    if (best < 0) return -1;
+    u32 extra = 0;
+    for (int k = 0; k < 3; k++) extra += b->in_meshlet[b->indices[best * 3 + k]] != meshlet_id;
+    return b->vertex_count + extra <= MESHLET_MAX_VERTICES ? best : -1;
+}
+
+static void meshlet_add_triangle(MeshletBuilder* b, u32 t, u32 meshlet_id) {
+    for (int k = 0; k < 3; k++) {
+        u32 v = b->indices[t * 3 + k];
+        if (b->in_meshlet[v] != meshlet_id) {
+            b->in_meshlet[v] = meshlet_id;
+            b->vertices[b->vertex_count++] = v;
+        }
+        // drop the triangle from the adjacency, so the searches only see what's left
+        u32 p = b->position_id[v];
+        u32* list = &b->adjacency[b->offsets[p]];
+        for (u32 a = 0; a < b->live[p]; a++) {
+            if (list[a] == t) {
+                list[a] = list[--b->live[p]];
+                break;
+            }
+        }
+    }
+    b->normal_sum = vec3_sum(b->normal_sum, b->normals[t]);
+    b->centroid_sum = vec3_sum(b->centroid_sum, b->centroids[t]);
+    b->triangle_count++;
+}
+
+// Bounding sphere and normal cone of a finished meshlet
+static void meshlet_bounds(const Vertex* verts, const u32* indices, Meshlet* meshlet) {
+    const u32* tris = indices + meshlet->index_offset;
+    vec3 min = verts[tris[0]].position, max = min;
+    for (u32 i = 1; i < meshlet->triangle_count * 3; i++) {
+        vec3 p = verts[tris[i]].position;
+        for (int axis = 0; axis < 3; axis++) {
+            if (p.elements[axis] < min.elements[axis]) min.elements[axis] = p.elements[axis];
+            if (p.elements[axis] > max.elements[axis]) max.elements[axis] = p.elements[axis];
+        }
+    }
+    meshlet->center = vec3_mul_scalar(vec3_sum(min, max), 0.5f);
+    meshlet->radius = 0.0f;
+    for (u32 i = 0; i < meshlet->triangle_count * 3; i++) {
+        f32 distance = vec3_length(vec3_sub(verts[tris[i]].position, meshlet->center));
+        if (distance > meshlet->radius) meshlet->radius = distance;
+    }
+
+    // the axis is the average normal, the cone has to contain the normal of every triangle
+    vec3 axis = vec3_zero();
+    for (u32 t = 0; t < meshlet->triangle_count; t++) {
+        vec3 a = verts[tris[t * 3 + 0]].position;
+        vec3 n = vec3_cross_prod(vec3_sub(verts[tris[t * 3 + 1]].position, a), vec3_sub(verts[tris[t * 3 + 2]].position, a));
+        f32 length = vec3_length(n);
+        if (length > 0.0f) axis = vec3_sum(axis, vec3_mul_scalar(n, 1.0f / length));
+    }
+    meshlet->cone_apex = meshlet->center;
+    meshlet->cone_axis = vec3_zero();
+    meshlet->cone_cutoff = 1.0f;
+    f32 axis_length = vec3_length(axis);
+    if (axis_length == 0.0f) return;
+    axis = vec3_mul_scalar(axis, 1.0f / axis_length);
+
+    f32 min_dot = 1.0f;
+    vec3 normals[MESHLET_MAX_TRIANGLES];
+    for (u32 t = 0; t < meshlet->triangle_count; t++) {
+        vec3 a = verts[tris[t * 3 + 0]].position;
+        vec3 n = vec3_cross_prod(vec3_sub(verts[tris[t * 3 + 1]].position, a), vec3_sub(verts[tris[t * 3 + 2]].position, a));
+        f32 length = vec3_length(n);
+        normals[t] = length > 0.0f ? vec3_mul_scalar(n, 1.0f / length) : axis;
+        f32 d = vec3_dot_prod(normals[t], axis);
+        if (d < min_dot) min_dot = d;
+    }
+    // wider than a hemisphere (with some margin): the cluster always has a front face
+    if (min_dot <= 0.1f) return;
+
+    // the apex is moved back along the axis until it's behind the plane of every triangle
+    f32 max_t = 0.0f;
+    for (u32 t = 0; t < meshlet->triangle_count; t++) {
+        vec3 a = verts[tris[t * 3 + 0]].position;
+        f32 d = vec3_dot_prod(vec3_sub(meshlet->center, a), normals[t]) / vec3_dot_prod(axis, normals[t]);
+        if (d > max_t) max_t = d;
+    }
+    meshlet->cone_apex = vec3_sub(meshlet->center, vec3_mul_scalar(axis, max_t));
+    meshlet->cone_axis = axis;
+    meshlet->cone_cutoff = sqrtf(1.0f - min_dot * min_dot);
+}
+
+IOStatus model_build_meshlets(Model* m) {
+    m->meshlets.count = 0;
+
+    u32* indices = m->indices.items + m->lods[0].index_offset;
+    size_t triangle_count = m->lods[0].index_count / 3;
+    size_t vertex_count = m->verts.count;
+    size_t table_capacity = 16;
+    while (table_capacity < vertex_count * 2) table_capacity *= 2;
+    vec3* normals = malloc((triangle_count + 1) * sizeof(vec3));
+    vec3* centroids = malloc((triangle_count + 1) * sizeof(vec3));
+    u32* position_id = malloc((vertex_count + 1) * sizeof(u32));
+    u32* table = malloc(table_capacity * sizeof(u32));
+    u32* offsets = calloc(vertex_count + 1, sizeof(u32));
+    u32* live = calloc(vertex_count + 1, sizeof(u32));
+    u32* adjacency = malloc((triangle_count * 3 + 1) * sizeof(u32));
+    u32* in_meshlet = calloc(vertex_count + 1, sizeof(u32));
+    u8* emitted = calloc(triangle_count + 1, sizeof(u8));
+    u32* order = malloc((triangle_count + 1) * sizeof(u32));
+    u32* reordered = malloc((triangle_count * 3 + 1) * sizeof(u32));
+    // every leaf has a triangle at least, and there is one inner node less than leaves
+    MeshletKdTree tree = {
+        .centroids = centroids,
+        .nodes = malloc((triangle_count * 2 + 1) * sizeof(MeshletKdNode)),
+        .items = malloc((triangle_count + 1) * sizeof(u32)),
+    };
+    if (!normals || !centroids || !position_id || !table || !offsets || !live || !adjacency || !in_meshlet ||
+        !emitted || !order || !reordered || !tree.nodes || !tree.items) {
+        free(normals);
+        free(centroids);
+        free(position_id);
+        free(table);
+        free(offsets);
+        free(live);
+        free(adjacency);
+        free(in_meshlet);
+        free(emitted);
+        free(order);
+        free(reordered);
+        free(tree.nodes);
+        free(tree.items);
+        return IO_ERROR_MEMORY;
+    }
+
+    for (size_t t = 0; t < triangle_count; t++) {
+        vec3 a = m->verts.items[indices[t * 3 + 0]].position;
+        vec3 b = m->verts.items[indices[t * 3 + 1]].position;
+        vec3 c = m->verts.items[indices[t * 3 + 2]].position;
+        vec3 n = vec3_cross_prod(vec3_sub(b, a), vec3_sub(c, a));
+        f32 length = vec3_length(n);
+        normals[t] = length > 0.0f ? vec3_mul_scalar(n, 1.0f / length) : vec3_zero();
+        centroids[t] = vec3_mul_scalar(vec3_sum(vec3_sum(a, b), c), 1.0f / 3.0f);
+    }
+    // position -> triangles adjacency, live is used as the fill cursor
+    meshlet_weld_positions(m->verts.items, vertex_count, position_id, table, table_capacity);
+    free(table);
+    for (size_t i = 0; i < triangle_count * 3; i++) offsets[position_id[indices[i]]]++;
+    for (size_t v = 0, sum = 0; v < vertex_count; v++) {
+        u32 count = offsets[v];
+        offsets[v] = (u32)sum;
+        sum += count;
+    }
+    for (size_t i = 0; i < triangle_count * 3; i++) {
+        u32 p = position_id[indices[i]];
+        adjacency[offsets[p] + live[p]++] = (u32)(i / 3);
+    }
+
+    MeshletBuilder builder = {
+        .indices = indices,
+        .position_id = position_id,
+        .normals = normals,
+        .centroids = centroids,
+        .emitted = emitted,
+        .offsets = offsets,
+        .live = live,
+        .adjacency = adjacency,
+        .in_meshlet = in_meshlet,
+    };
+    IOStatus status = IO_SUCCESS;
+    size_t emitted_count = 0;
+    // a meshlet never mixes submeshes, they are drawn with different materials
+    for (size_t s = 0; s < m->submeshes.count && status == IO_SUCCESS; s++) {
+        Submesh* submesh = &m->submeshes.items[s];
+        builder.first_triangle = (submesh->lods[0].index_offset - m->lods[0].index_offset) / 3;
+        builder.end_triangle = builder.first_triangle + submesh->lods[0].index_count / 3;
+        submesh->meshlet_offset = (u32)m->meshlets.count;
+        size_t cursor = builder.first_triangle;
+        tree.node_count = 0;
+        if (builder.end_triangle > builder.first_triangle) {
+            for (u32 t = builder.first_triangle; t < builder.end_triangle; t++) tree.items[t] = t;
+            meshlet_kd_build(&tree, builder.first_triangle, builder.end_triangle - builder.first_triangle);
+        }
+        while (emitted_count < builder.end_triangle) {
+            u32 meshlet_id = (u32)m->meshlets.count + 1;
+
+            // continue next to the previous meshlet if it's not surrounded yet, so that
+            // consecutive meshlets stay close, otherwise from the first triangle left
+            i64 seed = -1;
+            for (u32 i = 0; i < builder.vertex_count && seed < 0; i++) {
+                u32 v = position_id[builder.vertices[i]];
+                for (u32 a = offsets[v]; a < offsets[v] + live[v] && seed < 0; a++) {
+                    if (adjacency[a] >= builder.first_triangle && adjacency[a] < builder.end_triangle) seed = adjacency[a];
+                }
+            }
+            if (seed < 0) {
+                while (emitted[cursor]) cursor++;
+                seed = (i64)cursor;
+            }
+
+            size_t first = emitted_count;
+            builder.vertex_count = 0;
+            builder.triangle_count = 0;
+            builder.normal_sum = vec3_zero();
+            builder.centroid_sum = vec3_zero();
+            for (i64 t = seed; t >= 0;) {
+                meshlet_add_triangle(&builder, (u32)t, meshlet_id);
+                emitted[t] = 1;
+                order[emitted_count++] = (u32)t;
+                if (builder.triangle_count == MESHLET_MAX_TRIANGLES) break;
+                t = meshlet_next_triangle(&builder, meshlet_id);
+                if (t < 0) t = meshlet_nearest_triangle(&builder, &tree, meshlet_id);
+            }
+
+            // the original order inside a meshlet keeps what model_optimize did for the vertex cache
+            qsort(order + first, emitted_count - first, sizeof(u32), u32_compare);
+            Meshlet meshlet = {
+                .index_offset = m->lods[0].index_offset + (u32)first * 3,
+                .triangle_count = builder.triangle_count,
+                .vertex_count = builder.vertex_count,
+            };
+            if (!da_append(m->meshlets, meshlet)) {
+                status = IO_ERROR_MEMORY;
+                break;
+            }
+        }
+        submesh->meshlet_count = (u32)m->meshlets.count - submesh->meshlet_offset;
+    }
+
+    if (status == IO_SUCCESS) {
+        for (size_t i = 0; i < triangle_count; i++) memcpy(reordered + i * 3, indices + (size_t)order[i] * 3, 3 * sizeof(u32));
+        memcpy(indices, reordered, triangle_count * 3 * sizeof(u32));
+        for (size_t i = 0; i < m->meshlets.count; i++) meshlet_bounds(m->verts.items, m->indices.items, &m->meshlets.items[i]);
+    } else {
+        m->meshlets.count = 0;
+        for (size_t s = 0; s < m->submeshes.count; s++) m->submeshes.items[s].meshlet_count = 0;
+    }
+
+    free(normals);
+    free(centroids);
+    free(position_id);
+    free(offsets);
+    free(live);
+    free(adjacency);
+    free(in_meshlet);
+    free(emitted);
+    free(order);
+    free(reordered);
+    free(tree.nodes);
+    free(tree.items);
+    return status;
+}
+
+u32 meshlet_cull(const Meshlet* meshlets, size_t meshlet_count, mat4 view_projection, vec3 camera_position, u32* visible) {
+    // Frustum planes (Gribb and Hartmann) from the rows of the matrix, which is column
+    // major. The near plane is left out, clipping takes care of it.
+    const f32* d = view_projection.data;
+    vec4 planes[5];
+    for (int i = 0; i < 4; i++) {
+        int row = i / 2;
+        f32 sign = i % 2 ? -1.0f : 1.0f;
+        planes[i] = (vec4){{ d[3] + sign * d[row], d[7] + sign * d[4 + row], d[11] + sign * d[8 + row], d[15] + sign * d[12 + row] }};
+    }
+    planes[4] = (vec4){{ d[3] - d[2], d[7] - d[6], d[11] - d[10], d[15] - d[14] }};
+    for (int i = 0; i < 5; i++) {
+        f32 length = sqrtf(planes[i].x * planes[i].x + planes[i].y * planes[i].y + planes[i].z * planes[i].z);
+        if (length > 0.0f) planes[i] = (vec4){{ planes[i].x / length, planes[i].y / length, planes[i].z / length, planes[i].w / length }};
+    }
+
+    u32 visible_count = 0;
+    for (size_t i = 0; i < meshlet_count; i++) {
+        const Meshlet* meshlet = &meshlets[i];
+        int inside = 1;
+        for (int p = 0; p < 5 && inside; p++) {
+            f32 distance = planes[p].x * meshlet->center.x + planes[p].y * meshlet->center.y +
+                           planes[p].z * meshlet->center.z + planes[p].w;
+            inside = distance >= -meshlet->radius;
+        }
+        if (!inside) continue;
+
+        // backfacing: the camera is inside the cone opposite to the normals
+        if (meshlet->cone_cutoff < 1.0f) {
+            vec3 to_apex = vec3_sub(meshlet->cone_apex, camera_position);
+            f32 length = vec3_length(to_apex);
+            if (length > 0.0f && vec3_dot_prod(to_apex, meshlet->cone_axis) >= meshlet->cone_cutoff * length) continue;
+        }
+        visible[visible_count++] = (u32)i;
+    }
+    return visible_count;
+}
@@ -0,0 +1,43 @@
+#pragma once
+#include "common/files.h"
+#include "common/defines.h"
+#include "math/math_types.h"
+#include "model/model.h"
+
+// =============================================================
+// Meshlets
+// =============================================================
+// Level 0 of a model is split into clusters of neighbouring triangles that face about
+// the same way. Triangles are neighbours when they share a position, whatever their
+// normals and uvs, and a cluster that runs out of neighbours goes on with the closest
+// triangle left. Every cluster keeps a bounding sphere and a normal cone, so the clusters
+// outside of the view or facing away from the camera can be skipped before drawing.
+// The triangles of a cluster are a contiguous range of the index buffer, the visible
+// ones are drawn with a single glMultiDrawElements.
+
+// Limits of a cluster, the usual ones for mesh shaders
+#define MESHLET_MAX_VERTICES 64
+#define MESHLET_MAX_TRIANGLES 124
+
+/*
+* @brief Split level 0 of a model in meshlets. Its triangles are reordered so that every
+*   meshlet is a range of the index buffer, in the same order as before inside a meshlet.
+*   Meshlets don't cross submeshes, every submesh gets its own range of Model.meshlets.
+*
+* @param m The model, its meshlets are replaced.
+* @return IO_SUCCESS or IO_ERROR_MEMORY.
+*/
+IOStatus model_build_meshlets(Model* m);
+
+/*
+* @brief Find the meshlets that can be visible: inside the view frustum and with at
+*   least one triangle facing the camera.
+*
+* @param meshlets The meshlets to test.
+* @param meshlet_count Number of meshlets.
+* @param view_projection Projection * view * model matrix of the mesh.
+* @param camera_position Position of the camera in model space.
+* @param visible Where to write the index of every visible meshlet (meshlet_count entries).
+* @return The number of visible meshlets.
+*/
+u32 meshlet_cull(const Meshlet* meshlets, size_t meshlet_count, mat4 view_projection, vec3 camera_position, u32* visible);
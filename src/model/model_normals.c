@@ -0,0 +1,353 @@
+#include "model_normals.h"
+#include "common/jobs.h"
+#include "math/linalg.h"
+#include <math.h>
+#include <stdint.h>
+#include <stdlib.h>
+#include <string.h>
+
+// Fewest triangles worth a job of their own
+#define NORMALS_MIN_TRIANGLES_PER_JOB (64 * 1024)
+// Floats summed per slot: the face normal, or the tangent and bitangent
+#define NORMALS_WIDTH 3
+#define TANGENTS_WIDTH 6
+
+// Sums of the faces around a range of slots. The job visits every triangle with a corner
+// in its range and writes the sums of those corners only.
+typedef struct {
+    const Vertex* verts;
+    const u32* indices;
+    const u32* slots;           // slot of every vertex, NULL if it's the vertex itself
+    const u32* triangles;       // the triangles it visits, NULL for all of them
+    size_t triangle_count;
+    u32 width;
+    u32 first_slot;             // the job owns [first_slot, end_slot)
+    u32 end_slot;
+    f32* sums;                  // width floats per slot, shared by all the jobs
+} AccumulateJob;
+
+// Sorts the triangles of a range by the jobs owning their corners
+typedef struct {
+    const u32* indices;
+    const u32* slots;
+    size_t first_triangle;
+    size_t end_triangle;
+    size_t slot_count;
+    u32 job_count;
+    size_t* offsets;            // per owner: its triangles in the range, then where the next one goes
+    u32* triangles;             // every owner's triangles, one after the other
+} PartitionJob;
+
+static inline u32 accumulate_slot(const u32* slots, u32 vertex) {
+    return slots ? slots[vertex] : vertex;
+}
+
+static inline const u32* accumulate_triangle(const AccumulateJob* job, size_t i) {
+    return job->indices + (size_t)(job->triangles ? job->triangles[i] : i) * 3;
+}
+
+// Sums of a corner, NULL if another job owns it
+static inline f32* accumulate_at(const AccumulateJob* job, u32 vertex) {
+    u32 slot = accumulate_slot(job->slots, vertex);
+    if (slot < job->first_slot || slot >= job->end_slot) return NULL;
+    return job->sums + (size_t)slot * job->width;
+}
+
+// Jobs owning the corners of a triangle, each one once. Returns how many there are.
+static u32 partition_owners(const PartitionJob* job, const u32* tri, u32 owners[3]) {
+    u32 count = 0;
+    for (int k = 0; k < 3; k++) {
+        u32 owner = (u32)((u64)accumulate_slot(job->slots, tri[k]) * job->job_count / job->slot_count);
+        if ((count < 1 || owners[0] != owner) && (count < 2 || owners[1] != owner)) owners[count++] = owner;
+    }
+    return count;
+}
+
+// Job entry point: count the triangles of the range each job will visit
+static void partition_count(void* data) {
+    PartitionJob* job = data;
+    u32 owners[3];
+    for (size_t t = job->first_triangle; t < job->end_triangle; t++) {
+        u32 count = partition_owners(job, job->indices + t * 3, owners);
+        for (u32 i = 0; i < count; i++) job->offsets[owners[i]]++;
+    }
+}
+
+// Job entry point: append the triangles of the range to the lists of their jobs
+static void partition_scatter(void* data) {
+    PartitionJob* job = data;
+    u32 owners[3];
+    for (size_t t = job->first_triangle; t < job->end_triangle; t++) {
+        u32 count = partition_owners(job, job->indices + t * 3, owners);
+        for (u32 i = 0; i < count; i++) job->triangles[job->offsets[owners[i]]++] = (u32)t;
+    }
+}
+
+static void normals_add_face(AccumulateJob* job, const u32* tri, vec3 normal) {
+    for (int k = 0; k < 3; k++) {
+        f32* sum = accumulate_at(job, tri[k]);
+        if (!sum) continue;
+        sum[0] += normal.x;
+        sum[1] += normal.y;
+        sum[2] += normal.z;
+    }
+}
+
+// Job entry point: the unnormalized cross product of two edges is the face normal
+// scaled by twice its area, which is the weight we want
+static void normals_accumulate(void* data) {
+    AccumulateJob* job = data;
+    const Vertex* verts = job->verts;
+    size_t t = 0;
+    for (; t + 4 <= job->triangle_count; t += 4) {
+        const u32* tri[4];
+        for (int i = 0; i < 4; i++) tri[i] = accumulate_triangle(job, t + i);
+        vec3x4 a = vec3x4_set(verts[tri[0][0]].position, verts[tri[1][0]].position, verts[tri[2][0]].position, verts[tri[3][0]].position);
+        vec3x4 b = vec3x4_set(verts[tri[0][1]].position, verts[tri[1][1]].position, verts[tri[2][1]].position, verts[tri[3][1]].position);
+        vec3x4 c = vec3x4_set(verts[tri[0][2]].position, verts[tri[1][2]].position, verts[tri[2][2]].position, verts[tri[3][2]].position);
+        vec3 normals[4];
+        vec3x4_get(vec3x4_cross_prod(vec3x4_sub(b, a), vec3x4_sub(c, a)), normals);
+        for (int i = 0; i < 4; i++) normals_add_face(job, tri[i], normals[i]);
+    }
+    for (; t < job->triangle_count; t++) {
+        const u32* tri = accumulate_triangle(job, t);
+        vec3 a = verts[tri[0]].position;
+        normals_add_face(job, tri, vec3_cross_prod(vec3_sub(verts[tri[1]].position, a), vec3_sub(verts[tri[2]].position, a)));
+    }
+}
+
+// v without its component along the unit vector n, normalized (zero if nothing is left)
+static vec3 project_normalized(vec3 v, vec3 n) {
+    vec3 projected = vec3_sub(v, vec3_mul_scalar(n, vec3_dot_prod(n, v)));
+    f32 length = vec3_length(projected);
+    return length > 1e-20f ? vec3_mul_scalar(projected, 1.0f / length) : vec3_zero();
+}
+
+// Job entry point: tangent and bitangent of every face from its uv gradient, added to each
+// corner in the tangent plane of the corner's normal and weighted by the corner angle
+static void tangents_accumulate(void* data) {
+    AccumulateJob* job = data;
+    const Vertex* verts = job->verts;
+    for (size_t t = 0; t < job->triangle_count; t++) {
+        const u32* tri = accumulate_triangle(job, t);
+        const Vertex* v[3] = { &verts[tri[0]], &verts[tri[1]], &verts[tri[2]] };
+        vec3 e1 = vec3_sub(v[1]->position, v[0]->position);
+        vec3 e2 = vec3_sub(v[2]->position, v[0]->position);
+        f32 du1 = v[1]->uv.x - v[0]->uv.x, dv1 = v[1]->uv.y - v[0]->uv.y;
+        f32 du2 = v[2]->uv.x - v[0]->uv.x, dv2 = v[2]->uv.y - v[0]->uv.y;
+        f32 det = du1 * dv2 - du2 * dv1;
+        if (fabsf(det) < 1e-20f) continue;  // no uv mapping on this face
+        // the orientation is all that matters, so det only counts for its sign
+        f32 sign = det > 0.0f ? 1.0f : -1.0f;
+        vec3 tangent = vec3_mul_scalar(vec3_sub(vec3_mul_scalar(e1, dv2), vec3_mul_scalar(e2, dv1)), sign);
+        vec3 bitangent = vec3_mul_scalar(vec3_sub(vec3_mul_scalar(e2, du1), vec3_mul_scalar(e1, du2)), sign);
+
+        for (int k = 0; k < 3; k++) {
+            f32* sum = accumulate_at(job, tri[k]);
+            if (!sum) continue;
+            vec3 to_next = vec3_normalized(vec3_sub(v[(k + 1) % 3]->position, v[k]->position));
+            vec3 to_prev = vec3_normalized(vec3_sub(v[(k + 2) % 3]->position, v[k]->position));
+            f32 cosine = fmaxf(-1.0f, fminf(1.0f, vec3_dot_prod(to_next, to_prev)));
+            f32 angle = acosf(cosine);
+            vec3 t_corner = vec3_mul_scalar(project_normalized(tangent, v[k]->normal), angle);
+            vec3 b_corner = vec3_mul_scalar(project_normalized(bitangent, v[k]->normal), angle);
+            sum[0] += t_corner.x;
+            sum[1] += t_corner.y;
+            sum[2] += t_corner.z;
+            sum[3] += b_corner.x;
+            sum[4] += b_corner.y;
+            sum[5] += b_corner.z;
+        }
+    }
+}
+
+// Give every job the triangles with a corner in its range of slots, in the order of the
+// index buffer. Returns the array they point into, NULL if out of memory.
+static u32* partition_triangles(const u32* indices, const u32* slots, size_t triangle_count, size_t slot_count, AccumulateJob* jobs, u32 job_count) {
+    PartitionJob* parts = calloc(job_count, sizeof(PartitionJob));
+    size_t* offsets = calloc((size_t)job_count * job_count, sizeof(size_t));
+    if (!parts || !offsets) {
+        free(parts);
+        free(offsets);
+        return NULL;
+    }
+    for (u32 j = 0; j < job_count; j++) {
+        parts[j] = (PartitionJob){
+            .indices = indices,
+            .slots = slots,
+            .first_triangle = triangle_count * j / job_count,
+            .end_triangle = triangle_count * (j + 1) / job_count,
+            .slot_count = slot_count,
+            .job_count = job_count,
+            .offsets = offsets + (size_t)j * job_count,
+        };
+    }
+    jobs_run(partition_count, parts, sizeof(PartitionJob), job_count);
+
+    // the triangles of a job are those of the first range, then of the second...
+    size_t total = 0;
+    for (u32 owner = 0; owner < job_count; owner++) {
+        jobs[owner].triangle_count = 0;
+        for (u32 j = 0; j < job_count; j++) {
+            size_t count = parts[j].offsets[owner];
+            parts[j].offsets[owner] = total;
+            total += count;
+            jobs[owner].triangle_count += count;
+        }
+    }
+    u32* triangles = malloc(total * sizeof(u32) + 1);
+    if (triangles) {
+        for (u32 j = 0; j < job_count; j++) parts[j].triangles = triangles;
+        jobs_run(partition_scatter, parts, sizeof(PartitionJob), job_count);
+        size_t start = 0;
+        for (u32 owner = 0; owner < job_count; owner++) {
+            jobs[owner].triangles = triangles + start;
+            start += jobs[owner].triangle_count;
+        }
+    }
+    free(parts);
+    free(offsets);
+    return triangles;
+}
+
+// Run fn over the triangles of level 0 on all cores, every job summing the faces around its
+// own range of slots. On success *out holds width floats per slot, to free by the caller.
+static IOStatus accumulate_parallel(job_fn fn, const Model* m, const u32* slots, size_t slot_count, u32 width, f32** out) {
+    size_t triangle_count = m->lods[0].index_count / 3;
+    size_t job_count = jobs_core_count();
+    size_t max_jobs = triangle_count / NORMALS_MIN_TRIANGLES_PER_JOB + 1;
+    if (job_count > max_jobs) job_count = max_jobs;
+    const u32* indices = m->indices.items + m->lods[0].index_offset;
+
+    AccumulateJob* jobs = calloc(job_count, sizeof(AccumulateJob));
+    f32* total = calloc(slot_count * width + 1, sizeof(f32));
+    if (!jobs || !total) {
+        free(jobs);
+        free(total);
+        return IO_ERROR_MEMORY;
+    }
+    for (size_t j = 0; j < job_count; j++) {
+        // slot s is owned by job s * job_count / slot_count
+        jobs[j] = (AccumulateJob){
+            .verts = m->verts.items,
+            .indices = indices,
+            .slots = slots,
+            .triangle_count = triangle_count,
+            .width = width,
+            .first_slot = (u32)((slot_count * j + job_count - 1) / job_count),
+            .end_slot = (u32)((slot_count * (j + 1) + job_count - 1) / job_count),
+            .sums = total,
+        };
+    }
+    u32* triangles = NULL;
+    if (job_count > 1) {
+        triangles = partition_triangles(indices, slots, triangle_count, slot_count, jobs, (u32)job_count);
+        if (!triangles) {
+            free(jobs);
+            free(total);
+            return IO_ERROR_MEMORY;
+        }
+    }
+    jobs_run(fn, jobs, sizeof(AccumulateJob), (u32)job_count);
+
+    free(triangles);
+    free(jobs);
+    *out = total;
+    return IO_SUCCESS;
+}
+
+// Same slot for all the vertices at the same position, numbered in order of first use.
+// Returns NULL if out of memory.
+static u32* normals_weld(const Vertex* verts, size_t vertex_count, size_t* slot_count) {
+    size_t map_capacity = 16;
+    while (map_capacity < vertex_count * 2) map_capacity *= 2;
+    u32* map = calloc(map_capacity, sizeof(u32));  // vertex + 1 that owns the slot, 0 if empty
+    u32* slots = malloc((vertex_count + 1) * sizeof(u32));
+    if (!map || !slots) {
+        free(map);
+        free(slots);
+        return NULL;
+    }
+
+    u32 count = 0;
+    for (size_t v = 0; v < vertex_count; v++) {
+        // + 0.0f turns -0 into +0, they are the same position
+        vec3 p = verts[v].position;
+        f32 key[3] = { p.x + 0.0f, p.y + 0.0f, p.z + 0.0f };
+        u32 bits[3];
+        memcpy(bits, key, sizeof(bits));
+        u32 h = bits[0] * 0x9E3779B1u ^ bits[1] * 0x85EBCA77u ^ bits[2] * 0xC2B2AE3Du;
+        h ^= h >> 15;
+        size_t slot = h & (map_capacity - 1);
+        while (map[slot] != 0) {
+            vec3 q = verts[map[slot] - 1].position;
+            if (q.x == key[0] && q.y == key[1] && q.z == key[2]) break;
+            slot = (slot + 1) & (map_capacity - 1);
+        }
+        if (map[slot] == 0) {
+            map[slot] = (u32)v + 1;
+            slots[v] = count++;
+        } else {
+            slots[v] = slots[map[slot] - 1];
+        }
+    }
+    free(map);
+    *slot_count = count;
+    return slots;
+}
+
+IOStatus model_generate_normals(Model* m) {
+    size_t missing = 0;
+    for (size_t v = 0; v < m->verts.count; v++) {
+        vec3 n = m->verts.items[v].normal;
+        missing += n.x == 0.0f && n.y == 0.0f && n.z == 0.0f;
+    }
+    if (missing == 0) return IO_SUCCESS;
+
+    size_t slot_count = 0;
+    u32* slots = normals_weld(m->verts.items, m->verts.count, &slot_count);
+    if (!slots) return IO_ERROR_MEMORY;
+    f32* sums = NULL;
+    IOStatus status = accumulate_parallel(normals_accumulate, m, slots, slot_count, NORMALS_WIDTH, &sums);
+    if (status != IO_SUCCESS) {
+        free(slots);
+        return status;
+    }
+
+    for (size_t v = 0; v < m->verts.count; v++) {
+        vec3* normal = &m->verts.items[v].normal;
+        if (normal->x != 0.0f || normal->y != 0.0f || normal->z != 0.0f) continue;
+        const f32* sum = sums + (size_t)slots[v] * NORMALS_WIDTH;
+        vec3 n = {{ sum[0], sum[1], sum[2] }};
+        f32 length = vec3_length(n);
+        // vertices of degenerate faces only keep the zero normal
+        if (length > 0.0f) *normal = vec3_mul_scalar(n, 1.0f / length);
+    }
+    free(sums);
+    free(slots);
+    return IO_SUCCESS;
+}
+
+IOStatus model_generate_tangents(Model* m) {
+    if (!da_reserve(m->tangents, m->verts.count + 1)) return IO_ERROR_MEMORY;
+
+    f32* sums = NULL;
+    IO_CHECK(accumulate_parallel(tangents_accumulate, m, NULL, m->verts.count, TANGENTS_WIDTH, &sums));
+
+    for (size_t v = 0; v < m->verts.count; v++) {
+        vec3 n = m->verts.items[v].normal;
+        const f32* sum = sums + v * TANGENTS_WIDTH;
+        vec3 tangent = project_normalized((vec3){{ sum[0], sum[1], sum[2] }}, n);
+        vec3 bitangent = {{ sum[3], sum[4], sum[5] }};
+        if (tangent.x == 0.0f && tangent.y == 0.0f && tangent.z == 0.0f) {
+            // no uv gradient: any direction in the tangent plane will do
+            vec3 axis = fabsf(n.x) < 0.9f ? (vec3){{ 1.0f, 0.0f, 0.0f }} : (vec3){{ 0.0f, 1.0f, 0.0f }};
+            tangent = project_normalized(axis, n);
+        }
+        f32 w = vec3_dot_prod(vec3_cross_prod(n, tangent), bitangent) < 0.0f ? -1.0f : 1.0f;
+        m->tangents.items[v] = (vec4){{ tangent.x, tangent.y, tangent.z, w }};
+    }
+    m->tangents.count = m->verts.count;
+    free(sums);
+    return IO_SUCCESS;
+}
@@ -0,0 +1,37 @@
+#pragma once
+#include "common/files.h"
+#include "common/defines.h"
+#include "model/model.h"
+
+// =============================================================
+// Normals and tangents
+// =============================================================
+// Generated at import time on all cores. Every job owns a range of vertices and adds up
+// the faces around them, the triangles being sorted by the jobs owning their corners
+// first. A face whose corners belong to several jobs is visited by each of them, but
+// no two threads ever write the same memory, whatever the vertex order, and the sums
+// come out the same as on a single thread.
+//
+// Normals are the area weighted average of the faces around a position, so vertices
+// split only by their uv get the same one. Tangents follow the MikkTSpace conventions:
+// at every corner the face tangent is projected on the vertex normal and weighted by the
+// corner angle, w is the sign of the bitangent and bitangent = w * cross(normal, tangent).
+
+/*
+* @brief Give a smooth normal to the vertices that have none (a zero normal), from the
+*   faces of level 0. The normals already there are kept.
+*
+* @param m The model.
+* @return IO_SUCCESS or IO_ERROR_MEMORY.
+*/
+IOStatus model_generate_normals(Model* m);
+
+/*
+* @brief Compute the tangent of every vertex from the positions and uvs of level 0 into
+*   m->tangents. The normals must be there already. Vertices whose faces have no usable
+*   uvs get an arbitrary tangent perpendicular to the normal.
+*
+* @param m The model.
+* @return IO_SUCCESS or IO_ERROR_MEMORY.
+*/
+IOStatus model_generate_tangents(Model* m);
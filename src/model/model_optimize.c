@@ -0,0 +1,378 @@
+#include "model_optimize.h"
+#include "common/arena.h"
+#include "math/linalg.h"
+#include <stdint.h>
+#include <stdlib.h>
+#include <string.h>
+
+// Lambda of the cluster split: a cluster ends as soon as its own ACMR is back under this
+// times the ACMR of the run it is cut from, more clusters let the overdraw sort do more
+#define OVERDRAW_CLUSTER_THRESHOLD 1.05f
+
+// A run of triangles [begin, end) that can be drawn in any order with the others
+typedef struct {
+    f32 sort_key;
+    u32 begin;
+    u32 end;
+} TriangleCluster;
+
+static void vertex_cache_stats(const u32* indices, size_t index_count, size_t vertex_count, u32 cache_size, f32* acmr, f32* atvr) {
+    // FIFO cache: a vertex is still cached if less than cache_size misses happened since it was loaded
+    u32* loaded_at = calloc(vertex_count + 1, sizeof(u32));
+    u32 misses = 0;
+    if (loaded_at) {
+        for (size_t i = 0; i < index_count; i++) {
+            u32 v = indices[i];
+            if (loaded_at[v] == 0 || misses + 1 - loaded_at[v] > cache_size) {
+                misses++;
+                loaded_at[v] = misses;
+            }
+        }
+        free(loaded_at);
+    }
+    if (acmr) *acmr = index_count ? (f32)misses / (f32)(index_count / 3) : 0.0f;
+    if (atvr) *atvr = vertex_count ? (f32)misses / (f32)vertex_count : 0.0f;
+}
+
+void model_vertex_cache_stats(const Model* m, u32 cache_size, f32* acmr, f32* atvr) {
+    vertex_cache_stats(m->indices.items + m->lods[0].index_offset, m->lods[0].index_count, m->verts.count, cache_size, acmr, atvr);
+}
+
+// Buffers of tipsify, allocated once per model for its largest submesh. Each call works on
+// the vertices its range uses, numbered from 0 in first use order, so its cost doesn't
+// depend on the size of the whole model.
+typedef struct {
+    u32* local;         // model vertex -> vertex of the range, UINT32_MAX outside of it (restored after every call)
+    u32* global;        // vertex of the range -> model vertex
+    u32* indices;       // the range with its own vertex numbers
+    u32* offsets;       // vertex -> first of its triangles in adjacency, one more than the vertices
+    u32* adjacency;
+    u32* live;          // triangles of the vertex not emitted yet
+    u32* cache_time;
+    u32* dead_end;
+    u8* emitted;
+} TipsifyScratch;
+
+static IOStatus tipsify_scratch_init(TipsifyScratch* scratch, Arena* arena, size_t vertex_count, size_t max_index_count) {
+    size_t max_vertices = max_index_count < vertex_count ? max_index_count : vertex_count;
+    scratch->local = arena_push(arena, u32, vertex_count + 1);
+    scratch->global = arena_push(arena, u32, max_vertices + 1);
+    scratch->indices = arena_push(arena, u32, max_index_count + 1);
+    scratch->offsets = arena_push(arena, u32, max_vertices + 2);
+    scratch->adjacency = arena_push(arena, u32, max_index_count + 1);
+    scratch->live = arena_push(arena, u32, max_vertices + 1);
+    scratch->cache_time = arena_push(arena, u32, max_vertices + 1);
+    scratch->dead_end = arena_push(arena, u32, max_index_count + 1);
+    scratch->emitted = arena_push(arena, u8, max_index_count / 3 + 1);
+    if (!scratch->local || !scratch->global || !scratch->indices || !scratch->offsets || !scratch->adjacency ||
+        !scratch->live || !scratch->cache_time || !scratch->dead_end || !scratch->emitted) {
+        return IO_ERROR_MEMORY;
+    }
+    memset(scratch->local, 0xFF, vertex_count * sizeof(u32));
+    return IO_SUCCESS;
+}
+
+// Vertices of triangle t that miss the FIFO cache, whose clock is *time
+static u32 cluster_cache_misses(const u32* local, const u32* out, size_t t, u32* cache_time, u32* time, u32 cache_size) {
+    u32 misses = 0;
+    for (int k = 0; k < 3; k++) {
+        u32 v = local[out[t * 3 + k]];
+        if (*time - cache_time[v] > cache_size) {
+            cache_time[v] = (*time)++;
+            misses++;
+        }
+    }
+    return misses;
+}
+
+// Cut the runs Tipsify emitted without a dead end in smaller clusters (section 4.2 of the
+// paper): a cluster ends once its running ACMR is down to OVERDRAW_CLUSTER_THRESHOLD times
+// the ACMR of its run, there the next one can start without hurting the cache much.
+// clusters holds the runs, they are replaced by the clusters.
+static void tipsify_split_clusters(TipsifyScratch* scratch, const u32* out, size_t vertex_count, u32 cache_size, u32_darray* clusters) {
+    u32* runs = scratch->dead_end;
+    size_t run_count = clusters->count;
+    memcpy(runs, clusters->items, run_count * sizeof(u32));
+    u32* cache_time = scratch->cache_time;
+    memset(cache_time, 0, vertex_count * sizeof(u32));
+    u32 time = cache_size + 1;
+
+    clusters->count = 0;
+    for (size_t r = 0; r + 1 < run_count; r++) {
+        u32 begin = runs[r], end = runs[r + 1];
+        // a dead end empties the cache: it is measured again from scratch
+        time += cache_size + 1;
+        u32 run_misses = 0;
+        for (u32 t = begin; t < end; t++) run_misses += cluster_cache_misses(scratch->local, out, t, cache_time, &time, cache_size);
+        f32 threshold = OVERDRAW_CLUSTER_THRESHOLD * (f32)run_misses / (f32)(end - begin);
+
+        // each cluster is measured from an empty cache, as the sort can put anything before it
+        time += cache_size + 1;
+        u32 start = begin, misses = 0;
+        clusters->items[clusters->count++] = begin;
+        for (u32 t = begin; t + 1 < end; t++) {
+            misses += cluster_cache_misses(scratch->local, out, t, cache_time, &time, cache_size);
+            if ((f32)misses <= threshold * (f32)(t + 1 - start)) {
+                time += cache_size + 1;
+                start = t + 1;
+                misses = 0;
+                clusters->items[clusters->count++] = start;
+            }
+        }
+    }
+    if (run_count > 0) clusters->items[clusters->count++] = runs[run_count - 1];
+}
+
+// Tipsify (Sander, Nehab and Barczak, "Fast Triangle Reordering for Vertex Locality and
+// Reduced Overdraw", 2007): fan around a vertex emitting all its remaining triangles, then
+// move to a neighbour that is still in the cache. Writes the new index order to out and
+// the start of every cluster to clusters: a new one begins at each dead end, and where
+// tipsify_split_clusters cuts the runs in between.
+static IOStatus tipsify(TipsifyScratch* scratch, const u32* indices, size_t index_count, u32 cache_size, u32* out, u32_darray* clusters) {
+    size_t triangle_count = index_count / 3;
+    // every cluster has a triangle at least, plus the end of the last one
+    if (!da_reserve(*clusters, triangle_count + 1)) return IO_ERROR_MEMORY;
+
+    // number the vertices of the range, only those are cleared and visited below
+    u32* local = scratch->local;
+    u32* global = scratch->global;
+    u32* local_indices = scratch->indices;
+    size_t vertex_count = 0;
+    for (size_t i = 0; i < index_count; i++) {
+        u32 v = indices[i];
+        if (local[v] == UINT32_MAX) {
+            local[v] = (u32)vertex_count;
+            global[vertex_count++] = v;
+        }
+        local_indices[i] = local[v];
+    }
+    u32* offsets = scratch->offsets;
+    u32* adjacency = scratch->adjacency;
+    u32* live = scratch->live;
+    u32* cache_time = scratch->cache_time;
+    u32* dead_end = scratch->dead_end;
+    u8* emitted = scratch->emitted;
+    memset(offsets, 0, (vertex_count + 1) * sizeof(u32));
+    memset(live, 0, vertex_count * sizeof(u32));
+    memset(cache_time, 0, vertex_count * sizeof(u32));
+    memset(emitted, 0, triangle_count);
+
+    // vertex -> triangles adjacency, cache_time is used as the fill cursor and reset after
+    for (size_t i = 0; i < index_count; i++) live[local_indices[i]]++;
+    for (size_t v = 0; v < vertex_count; v++) offsets[v + 1] = offsets[v] + live[v];
+    for (size_t i = 0; i < index_count; i++) {
+        u32 v = local_indices[i];
+        adjacency[offsets[v] + cache_time[v]++] = (u32)(i / 3);
+    }
+    memset(cache_time, 0, vertex_count * sizeof(u32));
+
+    size_t out_count = 0;
+    size_t dead_top = 0;
+    u32 time = cache_size + 1;
+    u32 cursor = 0;
+    i64 fanning = vertex_count > 0 ? 0 : -1;
+    if (fanning >= 0) clusters->items[clusters->count++] = 0;
+
+    while (fanning >= 0) {
+        u32 f = (u32)fanning;
+        size_t candidates = dead_top;
+        for (u32 a = offsets[f]; a < offsets[f + 1]; a++) {
+            u32 t = adjacency[a];
+            if (emitted[t]) continue;
+            emitted[t] = 1;
+            for (int k = 0; k < 3; k++) {
+                u32 v = local_indices[t * 3 + k];
+                out[out_count++] = global[v];
+                dead_end[dead_top++] = v;
+                live[v]--;
+                if (time - cache_time[v] > cache_size) cache_time[v] = time++;
+            }
+        }
+
+        // prefer the neighbour that entered the cache first, as long as all its
+        // remaining triangles can be emitted before it gets evicted
+        i64 best = -1;
+        i64 best_priority = -1;
+        for (size_t c = candidates; c < dead_top; c++) {
+            u32 v = dead_end[c];
+            if (live[v] == 0) continue;
+            i64 priority = 0;
+            if (time - cache_time[v] + 2 * live[v] <= cache_size) priority = time - cache_time[v];
+            if (priority > best_priority) {
+                best_priority = priority;
+                best = v;
+            }
+        }
+
+        if (best < 0) {
+            // dead end: go back to a recently used vertex, or to the next one with triangles left
+            while (dead_top > 0 && best < 0) {
+                u32 v = dead_end[--dead_top];
+                if (live[v] > 0) best = v;
+            }
+            while (best < 0 && cursor < vertex_count) {
+                if (live[cursor] > 0) best = cursor;
+                else cursor++;
+            }
+            if (best >= 0) clusters->items[clusters->count++] = (u32)(out_count / 3);
+        }
+        fanning = best;
+    }
+    clusters->items[clusters->count++] = (u32)(out_count / 3);
+    tipsify_split_clusters(scratch, out, vertex_count, cache_size, clusters);
+
+    for (size_t v = 0; v < vertex_count; v++) local[global[v]] = UINT32_MAX;
+    return IO_SUCCESS;
+}
+
+static int cluster_compare(const void* a, const void* b) {
+    f32 ka = ((const TriangleCluster*)a)->sort_key;
+    f32 kb = ((const TriangleCluster*)b)->sort_key;
+    return (ka < kb) - (ka > kb);   // descending
+}
+
+// Sort the clusters so the ones facing away from the center of the mesh are drawn
+// first: they are the most likely to occlude the rest.
+static IOStatus optimize_overdraw(const Vertex* verts, u32* indices, size_t index_count, const u32_darray* boundaries) {
+    if (boundaries->count < 3) return IO_SUCCESS;
+    size_t cluster_count = boundaries->count - 1;
+    TriangleCluster* clusters = malloc(cluster_count * sizeof(TriangleCluster));
+    u32* sorted = malloc((index_count + 1) * sizeof(u32));
+    if (!clusters || !sorted) {
+        free(clusters);
+        free(sorted);
+        return IO_ERROR_MEMORY;
+    }
+
+    // area weighted centroid of the whole mesh
+    vec3 mesh_center = vec3_zero();
+    f32 mesh_area = 0.0f;
+    for (size_t i = 0; i < index_count; i += 3) {
+        vec3 a = verts[indices[i + 0]].position;
+        vec3 b = verts[indices[i + 1]].position;
+        vec3 c = verts[indices[i + 2]].position;
+        f32 area = vec3_length(vec3_cross_prod(vec3_sub(b, a), vec3_sub(c, a)));
+        mesh_center = vec3_sum(mesh_center, vec3_mul_scalar(vec3_sum(vec3_sum(a, b), c), area / 3.0f));
+        mesh_area += area;
+    }
+    if (mesh_area > 0.0f) mesh_center = vec3_mul_scalar(mesh_center, 1.0f / mesh_area);
+
+    for (size_t k = 0; k < cluster_count; k++) {
+        TriangleCluster* cluster = &clusters[k];
+        cluster->begin = boundaries->items[k];
+        cluster->end = boundaries->items[k + 1];
+
+        vec3 center = vec3_zero();
+        vec3 normal = vec3_zero();     // sum of unnormalized face normals, so it's area weighted
+        f32 area = 0.0f;
+        for (u32 t = cluster->begin; t < cluster->end; t++) {
+            vec3 a = verts[indices[t * 3 + 0]].position;
+            vec3 b = verts[indices[t * 3 + 1]].position;
+            vec3 c = verts[indices[t * 3 + 2]].position;
+            vec3 face = vec3_cross_prod(vec3_sub(b, a), vec3_sub(c, a));
+            f32 face_area = vec3_length(face);
+            center = vec3_sum(center, vec3_mul_scalar(vec3_sum(vec3_sum(a, b), c), face_area / 3.0f));
+            normal = vec3_sum(normal, face);
+            area += face_area;
+        }
+        cluster->sort_key = 0.0f;
+        f32 normal_length = vec3_length(normal);
+        if (area > 0.0f && normal_length > 0.0f) {
+            center = vec3_mul_scalar(center, 1.0f / area);
+            cluster->sort_key = vec3_dot_prod(vec3_sub(center, mesh_center), normal) / normal_length;
+        }
+    }
+    qsort(clusters, cluster_count, sizeof(TriangleCluster), cluster_compare);
+
+    size_t out = 0;
+    for (size_t k = 0; k < cluster_count; k++) {
+        size_t count = (size_t)(clusters[k].end - clusters[k].begin) * 3;
+        memcpy(sorted + out, indices + (size_t)clusters[k].begin * 3, count * sizeof(u32));
+        out += count;
+    }
+    memcpy(indices, sorted, index_count * sizeof(u32));
+
+    free(clusters);
+    free(sorted);
+    return IO_SUCCESS;
+}
+
+// Renumber vertices in the order the index buffer first references them
+static IOStatus optimize_vertex_fetch(Model* m) {
+    u32* remap = malloc((m->verts.count + 1) * sizeof(u32));
+    // from the same allocators, they replace the arrays of the model
+    vertex_darray verts = { .allocator = m->verts.allocator };
+    vec4_darray tangents = { .allocator = m->tangents.allocator };
+    int has_tangents = m->tangents.count != 0;
+    if (!remap || !da_reserve(verts, m->verts.count + 1) || (has_tangents && !da_reserve(tangents, m->verts.count + 1))) {
+        free(remap);
+        da_free(verts);
+        da_free(tangents);
+        return IO_ERROR_MEMORY;
+    }
+    memset(remap, 0xFF, m->verts.count * sizeof(u32));
+
+    u32 next = 0;
+    for (size_t i = 0; i < m->indices.count; i++) {
+        u32 v = m->indices.items[i];
+        if (remap[v] == 0xFFFFFFFFu) {
+            verts.items[next] = m->verts.items[v];
+            if (has_tangents) tangents.items[next] = m->tangents.items[v];
+            remap[v] = next++;
+        }
+        m->indices.items[i] = remap[v];
+    }
+
+    free(remap);
+    verts.count = next;
+    da_free(m->verts);
+    m->verts = verts;
+    if (has_tangents) {
+        tangents.count = next;
+        da_free(m->tangents);
+        m->tangents = tangents;
+    }
+    return IO_SUCCESS;
+}
+
+IOStatus model_optimize(Model* m, ModelOptimizeStats* stats) {
+    // the stats are about the full detail level, the one the others are derived from,
+    // they cost two cache simulations so they are only measured when asked for
+    if (stats) model_vertex_cache_stats(m, MODEL_VERTEX_CACHE_SIZE, &stats->acmr_before, &stats->atvr_before);
+
+    // every submesh of every level of detail is drawn on its own, so each one is reordered separately
+    size_t max_index_count = 0;
+    for (u32 level = 0; level < m->lod_count; level++) {
+        for (size_t s = 0; s < m->submeshes.count; s++) {
+            size_t index_count = m->submeshes.items[s].lods[level].index_count;
+            if (index_count > max_index_count) max_index_count = index_count;
+        }
+    }
+    Arena* arena = arena_scratch();
+    if (!arena) return IO_ERROR_MEMORY;
+    ArenaMark mark = arena_mark(arena);
+    TipsifyScratch scratch;
+    IOStatus status = tipsify_scratch_init(&scratch, arena, m->verts.count, max_index_count);
+    u32* reordered = arena_push(arena, u32, max_index_count + 1);
+    if (status == IO_SUCCESS && !reordered) status = IO_ERROR_MEMORY;
+    u32_darray clusters = {0};
+    for (u32 level = 0; level < m->lod_count && status == IO_SUCCESS; level++) {
+        for (size_t s = 0; s < m->submeshes.count && status == IO_SUCCESS; s++) {
+            const ModelLod* lod = &m->submeshes.items[s].lods[level];
+            u32* indices = m->indices.items + lod->index_offset;
+            size_t index_count = lod->index_count;
+            clusters.count = 0;
+            status = tipsify(&scratch, indices, index_count, MODEL_VERTEX_CACHE_SIZE, reordered, &clusters);
+            if (status == IO_SUCCESS) status = optimize_overdraw(m->verts.items, reordered, index_count, &clusters);
+            if (status == IO_SUCCESS) memcpy(indices, reordered, index_count * sizeof(u32));
+        }
+    }
+    arena_reset_to(arena, mark);
+    da_free(clusters);
+    if (status != IO_SUCCESS) return status;
+
+    // only the order changes from here, so a failure leaves a valid (just less optimized) model
+    status = optimize_vertex_fetch(m);
+    if (stats) model_vertex_cache_stats(m, MODEL_VERTEX_CACHE_SIZE, &stats->acmr_after, &stats->atvr_after);
+    return status;
+}
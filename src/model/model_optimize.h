@@ -0,0 +1,45 @@
+#pragma once
+#include "common/files.h"
+#include "common/defines.h"
+#include "model/model.h"
+
+// =============================================================
+// Mesh optimization
+// =============================================================
+
+// Size of the FIFO post-transform cache used both to optimize and to measure meshes
+#define MODEL_VERTEX_CACHE_SIZE 16
+
+// Vertex cache efficiency of a mesh before and after model_optimize
+typedef struct ModelOptimizeStats {
+    f32 acmr_before;    // average cache miss ratio: transformed vertices per triangle (0.5 is ideal, 3 is worst)
+    f32 acmr_after;
+    f32 atvr_before;    // average transformed vertex ratio: transformed vertices per vertex (1 is ideal)
+    f32 atvr_after;
+} ModelOptimizeStats;
+
+/*
+* @brief Measure how well the triangle order of the full detail level of a model uses a FIFO vertex cache.
+*
+* @param m The model to measure.
+* @param cache_size Number of entries of the simulated cache.
+* @param acmr Where to store the average cache miss ratio (can be NULL).
+* @param atvr Where to store the average transformed vertex ratio (can be NULL).
+* @return void
+*/
+void model_vertex_cache_stats(const Model* m, u32 cache_size, f32* acmr, f32* atvr);
+
+/*
+* @brief Reorder a model for the GPU, the rendered result doesn't change:
+*   1. triangles of each submesh of each level of detail are reordered for the post-transform
+*      vertex cache (Tipsify),
+*   2. that order is cut in clusters wherever the cache allows it, and the clusters are
+*      sorted to reduce overdraw, the ones facing away from the center of the mesh go first,
+*   3. vertices (and their tangents) are reordered in the order they are first used, for fetch locality.
+*   Vertices not used by any triangle are dropped.
+*
+* @param m The model to optimize.
+* @param stats Where to store ACMR/ATVR before and after, NULL to skip measuring them.
+* @return IO_SUCCESS or IO_ERROR_MEMORY, the model stays valid (just less optimized) on failure.
+*/
+IOStatus model_optimize(Model* m, ModelOptimizeStats* stats);
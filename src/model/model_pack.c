@@ -0,0 +1,280 @@
+#define _DEFAULT_SOURCE
+#include "model_pack.h"
+#include "math/math.h"
+#include <math.h>
+#include <stdint.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <sys/mman.h>
+
+static u16 quantize_unorm16(f32 value) {
+    if (!(value > 0.0f)) return 0;
+    if (value >= 1.0f) return 0xFFFF;
+    return (u16)(value * 65535.0f + 0.5f);
+}
+
+static i16 quantize_snorm16(f32 value) {
+    if (value <= -1.0f) return -32767;
+    if (value >= 1.0f) return 32767;
+    return (i16)lroundf(value * 32767.0f);
+}
+
+// Octahedral mapping: project on the |x|+|y|+|z| = 1 octahedron and fold the lower half
+// over the upper one, the result is in [-1, 1]^2. A zero normal maps to +Z.
+static void encode_octahedral(vec3 n, i16 out[2]) {
+    f32 sum = fabsf(n.x) + fabsf(n.y) + fabsf(n.z);
+    if (sum == 0.0f) {
+        out[0] = out[1] = 0;
+        return;
+    }
+    f32 x = n.x / sum;
+    f32 y = n.y / sum;
+    if (n.z < 0.0f) {
+        f32 fx = (1.0f - fabsf(y)) * (x >= 0.0f ? 1.0f : -1.0f);
+        f32 fy = (1.0f - fabsf(x)) * (y >= 0.0f ? 1.0f : -1.0f);
+        x = fx;
+        y = fy;
+    }
+    out[0] = quantize_snorm16(x);
+    out[1] = quantize_snorm16(y);
+}
+
+// Exactly what the vertex shader gets back from encode_octahedral
+static vec3 decode_octahedral(const i16 e[2]) {
+    vec3 n = {{ fmaxf(e[0] / 32767.0f, -1.0f), fmaxf(e[1] / 32767.0f, -1.0f), 0.0f }};
+    n.z = 1.0f - fabsf(n.x) - fabsf(n.y);
+    f32 t = fmaxf(-n.z, 0.0f);
+    n.x += n.x >= 0.0f ? -t : t;
+    n.y += n.y >= 0.0f ? -t : t;
+    f32 length = sqrtf(n.x * n.x + n.y * n.y + n.z * n.z);
+    return (vec3){{ n.x / length, n.y / length, n.z / length }};
+}
+
+// Orthonormal basis around a unit normal without branches on its direction (Duff et al. 2017)
+static void tangent_basis(vec3 n, vec3* b1, vec3* b2) {
+    f32 sign = n.z >= 0.0f ? 1.0f : -1.0f;
+    f32 a = -1.0f / (sign + n.z);
+    f32 b = n.x * n.y * a;
+    *b1 = (vec3){{ 1.0f + sign * n.x * n.x * a, sign * b, -sign * n.x }};
+    *b2 = (vec3){{ b, sign + n.y * n.y * a, -n.y }};
+}
+
+// The tangent is perpendicular to the normal, so the angle from the basis of the normal
+// the shader decodes is enough: 15 bits of angle plus the sign of the bitangent
+static u16 encode_tangent(const i16 normal[2], vec4 tangent) {
+    vec3 b1, b2;
+    tangent_basis(decode_octahedral(normal), &b1, &b2);
+    f32 x = tangent.x * b1.x + tangent.y * b1.y + tangent.z * b1.z;
+    f32 y = tangent.x * b2.x + tangent.y * b2.y + tangent.z * b2.z;
+    f32 angle = atan2f(y, x) / (2.0f * (f32)PI) + 0.5f;
+    u16 encoded = (u16)lroundf(fminf(fmaxf(angle, 0.0f), 1.0f) * 32767.0f);
+    return encoded | (tangent.w < 0.0f ? 0x8000 : 0);
+}
+
+IOStatus model_pack(const Model* m, PackedMesh* out) {
+    *out = (PackedMesh){0};
+    out->vertex_count = m->verts.count;
+    out->index_count = m->indices.count;
+    out->index_size = m->verts.count < 65536 ? sizeof(u16) : sizeof(u32);
+    out->has_tangents = m->tangents.count == m->verts.count && m->verts.count > 0;
+    out->lod_count = m->lod_count;
+    memcpy(out->lods, m->lods, sizeof(out->lods));
+    out->meshlet_count = m->meshlets.count;
+    out->verts = malloc((out->vertex_count + 1) * sizeof(PackedVertex));
+    out->indices = malloc((out->index_count + 1) * out->index_size);
+    out->meshlets = malloc((out->meshlet_count + 1) * sizeof(Meshlet));
+    out->submesh_count = m->submeshes.count;
+    out->submeshes = malloc((out->submesh_count + 1) * sizeof(Submesh));
+    out->material_count = m->materials.count;
+    out->materials = malloc((out->material_count + 1) * sizeof(Material));
+    if (!out->verts || !out->indices || !out->meshlets || !out->submeshes || !out->materials) {
+        packed_mesh_free(out);
+        return IO_ERROR_MEMORY;
+    }
+
+    if (out->meshlet_count) memcpy(out->meshlets, m->meshlets.items, out->meshlet_count * sizeof(Meshlet));
+    if (out->submesh_count) memcpy(out->submeshes, m->submeshes.items, out->submesh_count * sizeof(Submesh));
+    if (out->material_count) memcpy(out->materials, m->materials.items, out->material_count * sizeof(Material));
+
+    // positions are quantized inside the bounding box of the model
+    vec3 min = m->bounds.min;
+    vec3 max = m->bounds.max;
+    out->bounds = m->bounds;
+    out->position_offset = min;
+    vec3 inverse_scale = {{0.0f, 0.0f, 0.0f}};
+    for (int axis = 0; axis < 3; axis++) {
+        f32 extent = max.elements[axis] - min.elements[axis];
+        out->position_scale.elements[axis] = extent;
+        if (extent > 0.0f) inverse_scale.elements[axis] = 1.0f / extent;
+    }
+
+    for (size_t i = 0; i < m->verts.count; i++) {
+        const Vertex* v = &m->verts.items[i];
+        PackedVertex* p = &out->verts[i];
+        for (int axis = 0; axis < 3; axis++) {
+            p->position[axis] = quantize_unorm16((v->position.elements[axis] - min.elements[axis]) * inverse_scale.elements[axis]);
+        }
+        p->uv[0] = f32_to_half(v->uv.x);
+        p->uv[1] = f32_to_half(v->uv.y);
+        encode_octahedral(v->normal, p->normal);
+        p->position[3] = out->has_tangents ? encode_tangent(p->normal, m->tangents.items[i]) : 0;
+    }
+
+    if (out->index_size == sizeof(u16)) {
+        u16* indices = out->indices;
+        for (size_t i = 0; i < m->indices.count; i++) indices[i] = (u16)m->indices.items[i];
+    } else {
+        u32* indices = out->indices;
+        for (size_t i = 0; i < m->indices.count; i++) indices[i] = m->indices.items[i];
+    }
+    return IO_SUCCESS;
+}
+
+void packed_mesh_free(PackedMesh* mesh) {
+    if (mesh->mapping) munmap(mesh->mapping, mesh->mapping_size);
+    if (mesh->view) {
+        *mesh = (PackedMesh){0};
+        return;
+    }
+    free(mesh->verts);
+    free(mesh->indices);
+    free(mesh->meshlets);
+    free(mesh->submeshes);
+    free(mesh->materials);
+    *mesh = (PackedMesh){0};
+}
+
+// =============================================================
+// Cooked meshes
+// =============================================================
+
+int packed_mesh_write_file(FILE* fp, void* context) {
+    const PackedMesh* mesh = context;
+    if (mesh->vertex_count > UINT32_MAX || mesh->index_count > UINT32_MAX) return 0;
+    PackedMeshHeader header = {
+        .magic = PACKED_MESH_MAGIC,
+        .version = PACKED_MESH_VERSION,
+        .vertex_count = (u32)mesh->vertex_count,
+        .index_count = (u32)mesh->index_count,
+        .index_size = mesh->index_size,
+        .has_tangents = (u32)mesh->has_tangents,
+        .bounds_radius = mesh->bounds.radius,
+        .lod_count = mesh->lod_count,
+        .meshlet_count = (u32)mesh->meshlet_count,
+        .submesh_count = (u32)mesh->submesh_count,
+        .material_count = (u32)mesh->material_count,
+    };
+    memcpy(header.position_offset, mesh->position_offset.elements, sizeof(header.position_offset));
+    memcpy(header.position_scale, mesh->position_scale.elements, sizeof(header.position_scale));
+    memcpy(header.bounds_min, mesh->bounds.min.elements, sizeof(header.bounds_min));
+    memcpy(header.bounds_max, mesh->bounds.max.elements, sizeof(header.bounds_max));
+    memcpy(header.bounds_center, mesh->bounds.center.elements, sizeof(header.bounds_center));
+    memcpy(header.lods, mesh->lods, sizeof(header.lods));
+
+    u64 vertex_bytes = (u64)header.vertex_count * sizeof(PackedVertex);
+    u64 index_bytes = (u64)header.index_count * header.index_size;
+    u64 meshlet_bytes = (u64)header.meshlet_count * sizeof(Meshlet);
+    u64 submesh_bytes = (u64)header.submesh_count * sizeof(Submesh);
+    u64 material_bytes = (u64)header.material_count * sizeof(Material);
+    header.vertex_offset = align_up(sizeof(PackedMeshHeader), PACKED_MESH_ALIGNMENT);
+    header.index_offset = align_up(header.vertex_offset + vertex_bytes, PACKED_MESH_ALIGNMENT);
+    header.meshlet_offset = align_up(header.index_offset + index_bytes, PACKED_MESH_ALIGNMENT);
+    header.submesh_offset = align_up(header.meshlet_offset + meshlet_bytes, PACKED_MESH_ALIGNMENT);
+    header.material_offset = align_up(header.submesh_offset + submesh_bytes, PACKED_MESH_ALIGNMENT);
+
+    // the offsets are relative to the start of the mesh, which doesn't have to be the start of the file
+    off_t start = ftello(fp);
+    if (start < 0 || start % PACKED_MESH_ALIGNMENT != 0) return 0;
+    u64 base = (u64)start;
+    return file_write_at(fp, base, &header, sizeof(header)) &&
+           file_write_at(fp, base + header.vertex_offset, mesh->verts, vertex_bytes) &&
+           file_write_at(fp, base + header.index_offset, mesh->indices, index_bytes) &&
+           file_write_at(fp, base + header.meshlet_offset, mesh->meshlets, meshlet_bytes) &&
+           file_write_at(fp, base + header.submesh_offset, mesh->submeshes, submesh_bytes) &&
+           file_write_at(fp, base + header.material_offset, mesh->materials, material_bytes);
+}
+
+IOStatus packed_mesh_write(const PackedMesh* mesh, const char* path) {
+    return file_write_atomic(path, packed_mesh_write_file, (void*)mesh);
+}
+
+// Every blob in the file and in order, every range in its blob
+static int packed_mesh_validate(const PackedMeshHeader* header, u64 size) {
+    if (header->magic != PACKED_MESH_MAGIC || header->version != PACKED_MESH_VERSION) return 0;
+    if (header->index_size != sizeof(u16) && header->index_size != sizeof(u32)) return 0;
+    u64 vertex_bytes = (u64)header->vertex_count * sizeof(PackedVertex);
+    u64 index_bytes = (u64)header->index_count * header->index_size;
+    u64 meshlet_bytes = (u64)header->meshlet_count * sizeof(Meshlet);
+    u64 submesh_bytes = (u64)header->submesh_count * sizeof(Submesh);
+    u64 material_bytes = (u64)header->material_count * sizeof(Material);
+    if (header->vertex_offset % PACKED_MESH_ALIGNMENT != 0 || header->index_offset % PACKED_MESH_ALIGNMENT != 0 ||
+        header->meshlet_offset % PACKED_MESH_ALIGNMENT != 0 || header->submesh_offset % PACKED_MESH_ALIGNMENT != 0 ||
+        header->material_offset % PACKED_MESH_ALIGNMENT != 0 ||
+        header->vertex_offset < sizeof(PackedMeshHeader) || header->vertex_offset + vertex_bytes > size ||
+        header->index_offset < header->vertex_offset + vertex_bytes || header->index_offset + index_bytes > size ||
+        header->meshlet_offset < header->index_offset + index_bytes || header->meshlet_offset + meshlet_bytes > size ||
+        header->submesh_offset < header->meshlet_offset + meshlet_bytes || header->submesh_offset + submesh_bytes > size ||
+        header->material_offset < header->submesh_offset + submesh_bytes || header->material_offset + material_bytes > size) {
+        return 0;
+    }
+    if (header->lod_count == 0 || header->lod_count > MODEL_MAX_LODS) return 0;
+    for (u32 i = 0; i < header->lod_count; i++) {
+        if ((u64)header->lods[i].index_offset + header->lods[i].index_count > header->index_count) return 0;
+    }
+    const u8* base = (const u8*)header;
+    const Meshlet* meshlets = (const Meshlet*)(base + header->meshlet_offset);
+    for (u32 i = 0; i < header->meshlet_count; i++) {
+        if ((u64)meshlets[i].index_offset + (u64)meshlets[i].triangle_count * 3 > header->index_count) return 0;
+    }
+    if (header->submesh_count == 0) return 0;
+    const Submesh* submeshes = (const Submesh*)(base + header->submesh_offset);
+    for (u32 i = 0; i < header->submesh_count; i++) {
+        const Submesh* submesh = &submeshes[i];
+        if (submesh->name[MODEL_NAME_SIZE - 1] != '\0') return 0;
+        if (submesh->material != MODEL_NO_MATERIAL && submesh->material >= header->material_count) return 0;
+        if ((u64)submesh->meshlet_offset + submesh->meshlet_count > header->meshlet_count) return 0;
+        for (u32 l = 0; l < header->lod_count; l++) {
+            if ((u64)submesh->lods[l].index_offset + submesh->lods[l].index_count > header->index_count) return 0;
+        }
+    }
+    const Material* materials = (const Material*)(base + header->material_offset);
+    for (u32 i = 0; i < header->material_count; i++) {
+        if (materials[i].name[MODEL_NAME_SIZE - 1] != '\0' || materials[i].diffuse_map[MODEL_PATH_SIZE - 1] != '\0') return 0;
+    }
+    return 1;
+}
+
+IOStatus packed_mesh_from_memory(const void* data, size_t size, PackedMesh* out) {
+    *out = (PackedMesh){0};
+    const PackedMeshHeader* header = data;
+    if (!data || size < sizeof(PackedMeshHeader) || (uintptr_t)data % PACKED_MESH_ALIGNMENT != 0 ||
+        !packed_mesh_validate(header, size)) {
+        return IO_ERROR_PARSE;
+    }
+
+    // the arrays are only read, the casts drop the const of the view
+    u8* base = (u8*)data;
+    out->verts = (PackedVertex*)(base + header->vertex_offset);
+    out->vertex_count = header->vertex_count;
+    out->indices = base + header->index_offset;
+    out->index_count = header->index_count;
+    out->index_size = header->index_size;
+    memcpy(out->position_offset.elements, header->position_offset, sizeof(header->position_offset));
+    memcpy(out->position_scale.elements, header->position_scale, sizeof(header->position_scale));
+    out->has_tangents = header->has_tangents != 0;
+    out->lod_count = header->lod_count;
+    memcpy(out->lods, header->lods, sizeof(out->lods));
+    memcpy(out->bounds.min.elements, header->bounds_min, sizeof(header->bounds_min));
+    memcpy(out->bounds.max.elements, header->bounds_max, sizeof(header->bounds_max));
+    memcpy(out->bounds.center.elements, header->bounds_center, sizeof(header->bounds_center));
+    out->bounds.radius = header->bounds_radius;
+    out->meshlets = (Meshlet*)(base + header->meshlet_offset);
+    out->meshlet_count = header->meshlet_count;
+    out->submeshes = (Submesh*)(base + header->submesh_offset);
+    out->submesh_count = header->submesh_count;
+    out->materials = (Material*)(base + header->material_offset);
+    out->material_count = header->material_count;
+    out->view = data;
+    return IO_SUCCESS;
+}
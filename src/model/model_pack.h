@@ -0,0 +1,137 @@
+#pragma once
+#include "common/files.h"
+#include "common/defines.h"
+#include "math/math_types.h"
+#include "model/model.h"
+
+// =============================================================
+// Vertex compression
+// =============================================================
+// A Model keeps full precision vertices (32 bytes each), model_pack turns it into the
+// compact format that is uploaded to the GPU (16 bytes per vertex, 16-bit indices when
+// they fit). The matching vertex attributes are:
+//   location 0: position, 3 x GL_UNSIGNED_SHORT normalized, decoded with position_offset/scale
+//   location 1: uv,       2 x GL_HALF_FLOAT
+//   location 2: normal,   2 x GL_SHORT normalized, octahedral encoding
+//   location 3: tangent,  1 x GL_UNSIGNED_SHORT integer (glVertexAttribIPointer), the 4th
+//               position component: the angle around the decoded normal from the basis
+//               of Duff et al. in the low 15 bits, the bitangent sign in the top bit
+
+typedef struct {
+    u16 position[4];    // unorm16 inside the bounds of the mesh, the 4th is the encoded tangent
+    u16 uv[2];          // half floats
+    i16 normal[2];      // snorm16 octahedral encoding of the unit normal
+} PackedVertex;
+
+typedef struct {
+    PackedVertex* verts;
+    size_t vertex_count;
+    void* indices;          // u16 or u32, see index_size
+    size_t index_count;
+    u32 index_size;         // 2 or 4 bytes per index
+    vec3 position_offset;   // position = position_offset + decoded position * position_scale
+    vec3 position_scale;
+    int has_tangents;       // 0 if the model had none, the encoded tangents are then all 0
+    u32 lod_count;          // index ranges of the levels of detail, same as the model's
+    ModelLod lods[MODEL_MAX_LODS];
+    ModelBounds bounds;     // in model space, like the meshlets
+    Meshlet* meshlets;      // clusters of level 0, in model space (before quantization)
+    size_t meshlet_count;
+    Submesh* submeshes;     // draw ranges and materials, same as the model's
+    size_t submesh_count;
+    Material* materials;
+    size_t material_count;
+    const void* view;       // cooked file the arrays point into (packed_mesh_from_memory), NULL if they are owned
+    void* mapping;          // mapped file view is in, owned by the mesh (model_cache_load), NULL otherwise
+    size_t mapping_size;
+} PackedMesh;
+
+// =============================================================
+// Cooked meshes (.mesh)
+// =============================================================
+// A packed mesh as tiro-cook writes it (see tools/tiro_cook.c): a header followed by the
+// vertex, index, meshlet, submesh and material blobs, each aligned to PACKED_MESH_ALIGNMENT
+// bytes. It holds what is uploaded, so loading one does no processing at all and the
+// buffers are filled straight from the file. The .tmesh cache of a model holds one too
+// (see model/model_cache.h).
+
+#define PACKED_MESH_MAGIC     0x4D4B5054u   // "TPKM"
+#define PACKED_MESH_VERSION   1
+#define PACKED_MESH_ALIGNMENT 64
+#define PACKED_MESH_EXTENSION ".mesh"
+
+typedef struct {
+    u32 magic;
+    u32 version;
+    u32 vertex_count;
+    u32 index_count;
+    u32 index_size;
+    u32 has_tangents;
+    f32 position_offset[3];
+    f32 position_scale[3];
+    f32 bounds_min[3];
+    f32 bounds_max[3];
+    f32 bounds_center[3];
+    f32 bounds_radius;
+    u32 lod_count;
+    ModelLod lods[MODEL_MAX_LODS];
+    u32 meshlet_count;
+    u32 submesh_count;
+    u32 material_count;
+    // blobs, offsets are relative to the start of the file
+    u64 vertex_offset;
+    u64 index_offset;
+    u64 meshlet_offset;
+    u64 submesh_offset;
+    u64 material_offset;
+} PackedMeshHeader;
+
+/*
+* @brief Quantize the vertices and indices of a model.
+*
+* @param m The model to compress, it is not modified.
+* @param out The packed mesh, release it with packed_mesh_free.
+* @return IO_SUCCESS or IO_ERROR_MEMORY.
+*/
+IOStatus model_pack(const Model* m, PackedMesh* out);
+
+/*
+* @brief Write a packed mesh at the current position of a file, a FileWriter (see
+*   common/files.h). The offsets of the mesh are relative to that position, which must be
+*   aligned on PACKED_MESH_ALIGNMENT.
+*
+* @param fp The file.
+* @param context The PackedMesh to write.
+* @return 1, or 0 if it couldn't be written.
+*/
+int packed_mesh_write_file(FILE* fp, void* context);
+
+/*
+* @brief Release the memory owned by a packed mesh, or the file it was mapped from.
+*
+* @param mesh The mesh to free.
+* @return void
+*/
+void packed_mesh_free(PackedMesh* mesh);
+
+/*
+* @brief Write a packed mesh as a cooked .mesh file, through a temporary file renamed at the end.
+*
+* @param mesh The mesh to write.
+* @param path The file to write.
+* @return IO_SUCCESS, IO_ERROR_OPEN, IO_ERROR_MEMORY or IO_ERROR_WRITE.
+*/
+IOStatus packed_mesh_write(const PackedMesh* mesh, const char* path);
+
+/*
+* @brief Use a cooked .mesh file already in memory (mapped, or in the content archive)
+*   without copying it: the arrays of out point into data, which must outlive the mesh
+*   and stay aligned like the file. packed_mesh_free only clears such a mesh, unless
+*   mapping is set.
+*
+* @param data Content of the file.
+* @param size Its size in bytes.
+* @param out The mesh to fill.
+* @return IO_SUCCESS, or IO_ERROR_PARSE if it is not a complete cooked mesh of this version.
+*/
+IOStatus packed_mesh_from_memory(const void* data, size_t size, PackedMesh* out);
@@ -0,0 +1,713 @@
+#include "model_simplify.h"
+#include "common/arena.h"
+#include "common/hash.h"
+#include "math/linalg.h"
+#include <math.h>
+#include <stdint.h>
+#include <stdlib.h>
+#include <string.h>
+
+// Symmetric 4x4 matrix of the quadric error metric, plus the total area it was built from
+typedef struct {
+    f64 a00, a01, a02, a03;
+    f64      a11, a12, a13;
+    f64           a22, a23;
+    f64                a33;
+    f64 weight;
+} Quadric;
+
+// How a vertex can be collapsed
+typedef enum {
+    VERTEX_MANIFOLD = 0,    // interior vertex, can collapse onto any neighbour
+    VERTEX_BORDER   = 1,    // on an open edge, can only slide along it
+    VERTEX_SEAM     = 2,    // on a uv/normal seam (two wedges), both slide along the seam together
+    VERTEX_LOCKED   = 3,    // corner, end of a seam or non-manifold: never moves
+} VertexKind;
+
+typedef struct {
+    u32 from;
+    u32 to;
+    f32 error;
+} Collapse;
+
+typedef DARRAY(Collapse) collapse_darray;
+
+// Undirected edge and the number of triangles using it
+typedef struct {
+    u64 key;
+    u32 count;
+} EdgeEntry;
+
+// Open addressing set of undirected edges
+typedef struct {
+    EdgeEntry* entries;
+    size_t capacity;
+} EdgeTable;
+
+// Scratch of one collapse pass: the vertex -> triangles adjacency and what changed.
+// Only the entries of the vertices of the current triangles are written and cleared,
+// so a pass costs as much as the triangles that are left, not as the whole range.
+typedef struct {
+    const u32* position_id;
+    const u32* wedge_next;
+    u32* first;         // first triangle of the vertex in adjacency
+    u32* count;         // triangles of the vertex in adjacency, 0 between passes
+    u32* adjacency;
+    u32* remap;         // identity between passes
+    u32* changed;       // the vertices remapped by this pass
+    u32 changed_count;
+    u8* touched;        // by position, set for the neighbourhood of every collapse
+    u32* touched_list;  // the positions set in touched
+    u32 touched_count;
+    u32* mark;          // by position, scratch of collapse_link_check
+    u32 stamp;
+    f32* deviation;     // by position, how far the vertices collapsed onto it are from the surface (all the passes)
+} CollapsePass;
+
+static void quadric_add(Quadric* q, const Quadric* other) {
+    q->a00 += other->a00; q->a01 += other->a01; q->a02 += other->a02; q->a03 += other->a03;
+    q->a11 += other->a11; q->a12 += other->a12; q->a13 += other->a13;
+    q->a22 += other->a22; q->a23 += other->a23;
+    q->a33 += other->a33;
+    q->weight += other->weight;
+}
+
+// Quadric of the plane n.p + d = 0 (n unit length), scaled by weight
+static Quadric quadric_from_plane(vec3 n, f32 d, f64 weight) {
+    return (Quadric){
+        n.x * n.x * weight, n.x * n.y * weight, n.x * n.z * weight, n.x * d * weight,
+        n.y * n.y * weight, n.y * n.z * weight, n.y * d * weight,
+        n.z * n.z * weight, n.z * d * weight,
+        (f64)d * d * weight,
+        weight,
+    };
+}
+
+// Squared distance from the planes of the quadric, averaged over its area
+static f64 quadric_error(const Quadric* q, vec3 p) {
+    f64 x = p.x, y = p.y, z = p.z;
+    f64 error = q->a00 * x * x + 2.0 * q->a01 * x * y + 2.0 * q->a02 * x * z + 2.0 * q->a03 * x
+              + q->a11 * y * y + 2.0 * q->a12 * y * z + 2.0 * q->a13 * y
+              + q->a22 * z * z + 2.0 * q->a23 * z
+              + q->a33;
+    if (error < 0.0) error = 0.0;
+    return q->weight > 0.0 ? error / q->weight : 0.0;
+}
+
+static u64 edge_key(u32 a, u32 b) {
+    return a < b ? ((u64)a << 32) | b : ((u64)b << 32) | a;
+}
+
+static EdgeEntry* edge_find(const EdgeTable* table, u32 a, u32 b) {
+    u64 key = edge_key(a, b);
+    size_t slot = (size_t)((key * 0x9E3779B97F4A7C15ull) >> 17) & (table->capacity - 1);
+    while (table->entries[slot].count != 0 && table->entries[slot].key != key) slot = (slot + 1) & (table->capacity - 1);
+    table->entries[slot].key = key;
+    return &table->entries[slot];
+}
+
+static u32 edge_count(const EdgeTable* table, u32 a, u32 b) {
+    return edge_find(table, a, b)->count;
+}
+
+// Binary min-heap of the candidate collapses of a pass, by error: a pass only takes the
+// cheapest ones, so sorting all of them would be wasted
+static void collapse_sift_down(Collapse* heap, size_t count, size_t i) {
+    Collapse item = heap[i];
+    for (;;) {
+        size_t child = i * 2 + 1;
+        if (child >= count) break;
+        if (child + 1 < count && heap[child + 1].error < heap[child].error) child++;
+        if (heap[child].error >= item.error) break;
+        heap[i] = heap[child];
+        i = child;
+    }
+    heap[i] = item;
+}
+
+static void collapse_heapify(Collapse* heap, size_t count) {
+    for (size_t i = count / 2; i-- > 0;) collapse_sift_down(heap, count, i);
+}
+
+static Collapse collapse_pop(Collapse* heap, size_t* count) {
+    Collapse top = heap[0];
+    heap[0] = heap[--*count];
+    collapse_sift_down(heap, *count, 0);
+    return top;
+}
+
+// Vertices at the same position share a position id (the first of them), this is what
+// tells a seam (same position, different attributes) apart from a real border. The
+// vertices at a position are linked in a ring by wedge_next.
+static void build_position_ids(const Vertex* verts, size_t vertex_count, u32* position_id, u32* wedge_next, u32* table, size_t table_capacity) {
+    memset(table, 0xFF, table_capacity * sizeof(u32));
+    for (size_t i = 0; i < vertex_count; i++) {
+        // the low bits of round coordinates are all zero, they need a real mix
+        size_t slot = (size_t)hash_bytes(verts[i].position.elements, sizeof(vec3), 0) & (table_capacity - 1);
+        while (table[slot] != 0xFFFFFFFFu &&
+               memcmp(verts[table[slot]].position.elements, verts[i].position.elements, sizeof(vec3)) != 0) {
+            slot = (slot + 1) & (table_capacity - 1);
+        }
+        if (table[slot] == 0xFFFFFFFFu) table[slot] = (u32)i;
+        u32 p = table[slot];
+        position_id[i] = p;
+        wedge_next[i] = (u32)i;
+        if (p != i) {
+            wedge_next[i] = wedge_next[p];
+            wedge_next[p] = (u32)i;
+        }
+    }
+}
+
+// Distance from p to the closest point of the triangle abc (Ericson, Real-Time Collision
+// Detection 5.1.5): the closest feature is found from the barycentric coordinates.
+static f32 point_triangle_distance(vec3 p, vec3 a, vec3 b, vec3 c) {
+    vec3 ab = vec3_sub(b, a), ac = vec3_sub(c, a), ap = vec3_sub(p, a);
+    f32 d1 = vec3_dot_prod(ab, ap), d2 = vec3_dot_prod(ac, ap);
+    if (d1 <= 0.0f && d2 <= 0.0f) return vec3_length(ap);
+    vec3 bp = vec3_sub(p, b);
+    f32 d3 = vec3_dot_prod(ab, bp), d4 = vec3_dot_prod(ac, bp);
+    if (d3 >= 0.0f && d4 <= d3) return vec3_length(bp);
+    vec3 cp = vec3_sub(p, c);
+    f32 d5 = vec3_dot_prod(ab, cp), d6 = vec3_dot_prod(ac, cp);
+    if (d6 >= 0.0f && d5 <= d6) return vec3_length(cp);
+
+    vec3 closest;
+    f32 va = d3 * d6 - d5 * d4, vb = d5 * d2 - d1 * d6, vc = d1 * d4 - d3 * d2;
+    if (vc <= 0.0f && d1 >= 0.0f && d3 <= 0.0f) {
+        closest = vec3_sum(a, vec3_mul_scalar(ab, d1 / (d1 - d3)));
+    } else if (vb <= 0.0f && d2 >= 0.0f && d6 <= 0.0f) {
+        closest = vec3_sum(a, vec3_mul_scalar(ac, d2 / (d2 - d6)));
+    } else if (va <= 0.0f && d4 - d3 >= 0.0f && d5 - d6 >= 0.0f) {
+        closest = vec3_sum(b, vec3_mul_scalar(vec3_sub(c, b), (d4 - d3) / ((d4 - d3) + (d5 - d6))));
+    } else {
+        f32 sum = va + vb + vc;
+        if (sum <= 0.0f) return vec3_length(ap);   // degenerate
+        closest = vec3_sum(a, vec3_sum(vec3_mul_scalar(ab, vb / sum), vec3_mul_scalar(ac, vc / sum)));
+    }
+    return vec3_length(vec3_sub(p, closest));
+}
+
+// Collapsing from onto the position of to must not flip or squash a triangle that stays.
+// Returns how many triangles the collapse removes, 0 if it isn't allowed. distance is set
+// to how far from is from the triangles that replace its own.
+static size_t collapse_check(const Vertex* verts, const u32* indices, const CollapsePass* pass, u32 from, u32 to, f32* distance) {
+    vec3 source = verts[from].position;
+    vec3 target = verts[to].position;
+    size_t removed = 0;
+    *distance = vec3_length(vec3_sub(target, source));
+    for (u32 a = pass->first[from], end = a + pass->count[from]; a < end; a++) {
+        const u32* t = &indices[pass->adjacency[a] * 3];
+        if (t[0] == to || t[1] == to || t[2] == to) {
+            removed++;
+            continue;
+        }
+        vec3 p[3], q[3];
+        for (int k = 0; k < 3; k++) {
+            p[k] = verts[t[k]].position;
+            q[k] = t[k] == from ? target : p[k];
+        }
+        vec3 before = vec3_cross_prod(vec3_sub(p[1], p[0]), vec3_sub(p[2], p[0]));
+        vec3 after = vec3_cross_prod(vec3_sub(q[1], q[0]), vec3_sub(q[2], q[0]));
+        f32 before_length = vec3_length(before);
+        f32 after_length = vec3_length(after);
+        if (after_length <= 1e-12f || vec3_dot_prod(before, after) < 0.25f * before_length * after_length) return 0;
+        *distance = fminf(*distance, point_triangle_distance(source, q[0], q[1], q[2]));
+    }
+    return removed;
+}
+
+// Collapsing an edge must not glue two parts of the surface together: the positions
+// around both ends can only have in common the third corners of the triangles of the edge.
+static int collapse_link_check(const u32* indices, CollapsePass* pass, u32 from, u32 to) {
+    u32 from_position = pass->position_id[from];
+    u32 to_position = pass->position_id[to];
+    u32 around_to = ++pass->stamp;
+    u32 counted = ++pass->stamp;
+    u32 w = to;
+    do {
+        for (u32 a = pass->first[w], end = a + pass->count[w]; a < end; a++) {
+            const u32* t = &indices[pass->adjacency[a] * 3];
+            for (int k = 0; k < 3; k++) pass->mark[pass->position_id[t[k]]] = around_to;
+        }
+        w = pass->wedge_next[w];
+    } while (w != to);
+
+    u32 shared_triangles = 0, shared_positions = 0;
+    w = from;
+    do {
+        for (u32 a = pass->first[w], end = a + pass->count[w]; a < end; a++) {
+            const u32* t = &indices[pass->adjacency[a] * 3];
+            int has_to = 0;
+            for (int k = 0; k < 3; k++) {
+                u32 p = pass->position_id[t[k]];
+                has_to |= p == to_position;
+                if (p == from_position || p == to_position || pass->mark[p] != around_to) continue;
+                pass->mark[p] = counted;
+                shared_positions++;
+            }
+            shared_triangles += has_to;
+        }
+        w = pass->wedge_next[w];
+    } while (w != from);
+    return shared_positions == shared_triangles;
+}
+
+// The vertex next to from's sibling wedge that sits at the same position as to
+static u32 seam_sibling(const u32* indices, const CollapsePass* pass, u32 from, u32 to) {
+    for (u32 a = pass->first[from], end = a + pass->count[from]; a < end; a++) {
+        const u32* t = &indices[pass->adjacency[a] * 3];
+        for (int k = 0; k < 3; k++) {
+            if (pass->position_id[t[k]] == pass->position_id[to]) return t[k];
+        }
+    }
+    return 0xFFFFFFFFu;
+}
+
+static void collapse_touch(const u32* indices, CollapsePass* pass, u32 v) {
+    for (u32 a = pass->first[v], end = a + pass->count[v]; a < end; a++) {
+        const u32* t = &indices[pass->adjacency[a] * 3];
+        for (int k = 0; k < 3; k++) {
+            u32 p = pass->position_id[t[k]];
+            if (pass->touched[p]) continue;
+            pass->touched[p] = 1;
+            pass->touched_list[pass->touched_count++] = p;
+        }
+    }
+}
+
+// model_simplify, where the vertices set in locked (can be NULL) never move
+static IOStatus simplify(const Vertex* verts, size_t vertex_count, const u32* indices, size_t index_count, const u8* locked,
+                         size_t target_index_count, u32_darray* out, f32* out_error) {
+    size_t table_capacity = 16;
+    while (table_capacity < vertex_count * 2) table_capacity *= 2;
+    size_t edge_capacity = 16;
+    while (edge_capacity < index_count * 2) edge_capacity *= 2;
+
+    u32* work = malloc((index_count + 1) * sizeof(u32));
+    u32* position_id = malloc((vertex_count + 1) * sizeof(u32));
+    u32* wedge_next = malloc((vertex_count + 1) * sizeof(u32));
+    u32* table = malloc(table_capacity * sizeof(u32));
+    u8* kind = calloc(vertex_count + 1, sizeof(u8));
+    u8* open_edges = calloc(vertex_count + 1, sizeof(u8));
+    u8* border_edges = calloc(vertex_count + 1, sizeof(u8));
+    Quadric* quadrics = calloc(vertex_count + 1, sizeof(Quadric));
+    EdgeTable position_edges = { calloc(edge_capacity, sizeof(EdgeEntry)), edge_capacity };
+    EdgeTable index_edges = { calloc(edge_capacity, sizeof(EdgeEntry)), edge_capacity };
+    CollapsePass pass = {
+        .position_id = position_id,
+        .wedge_next = wedge_next,
+        .first = malloc((vertex_count + 1) * sizeof(u32)),
+        .count = calloc(vertex_count + 1, sizeof(u32)),
+        .adjacency = malloc((index_count + 1) * sizeof(u32)),
+        .remap = malloc((vertex_count + 1) * sizeof(u32)),
+        .changed = malloc((vertex_count + 1) * sizeof(u32)),
+        .touched = calloc(vertex_count + 1, sizeof(u8)),
+        .touched_list = malloc((vertex_count + 1) * sizeof(u32)),
+        .mark = calloc(vertex_count + 1, sizeof(u32)),
+        .deviation = calloc(vertex_count + 1, sizeof(f32)),
+    };
+    collapse_darray collapses = {0};
+    IOStatus status = IO_SUCCESS;
+    if (!work || !position_id || !wedge_next || !table || !kind || !open_edges || !border_edges || !quadrics ||
+        !position_edges.entries || !index_edges.entries || !pass.first || !pass.count || !pass.adjacency ||
+        !pass.remap || !pass.changed || !pass.touched || !pass.touched_list || !pass.mark || !pass.deviation ||
+        !da_reserve(collapses, index_count * 2 + 1)) {
+        status = IO_ERROR_MEMORY;
+        goto cleanup;
+    }
+    memcpy(work, indices, index_count * sizeof(u32));
+    memset(pass.first, 0xFF, vertex_count * sizeof(u32));
+    for (size_t v = 0; v < vertex_count; v++) pass.remap[v] = (u32)v;
+    build_position_ids(verts, vertex_count, position_id, wedge_next, table, table_capacity);
+
+    // An edge used by one triangle is open: in position space that's a border, between
+    // vertices it's a border or a seam. More than two triangles is non-manifold.
+    for (size_t i = 0; i < index_count; i += 3) {
+        for (int k = 0; k < 3; k++) {
+            u32 a = work[i + k];
+            u32 b = work[i + (k + 1) % 3];
+            edge_find(&position_edges, position_id[a], position_id[b])->count++;
+            edge_find(&index_edges, a, b)->count++;
+        }
+    }
+    for (size_t i = 0; i < index_count; i += 3) {
+        for (int k = 0; k < 3; k++) {
+            u32 pa = position_id[work[i + k]];
+            u32 pb = position_id[work[i + (k + 1) % 3]];
+            u32 count = edge_count(&position_edges, pa, pb);
+            if (count > 2) kind[pa] = kind[pb] = VERTEX_LOCKED;
+            if (count == 1) {
+                if (border_edges[pa] < 255) border_edges[pa]++;
+                if (border_edges[pb] < 255) border_edges[pb]++;
+            }
+            if (edge_count(&index_edges, work[i + k], work[i + (k + 1) % 3]) == 1) {
+                if (open_edges[pa] < 255) open_edges[pa]++;
+                if (open_edges[pb] < 255) open_edges[pb]++;
+            }
+        }
+    }
+    for (size_t v = 0; v < vertex_count; v++) {
+        u32 p = position_id[v];
+        if (p != v || kind[p] == VERTEX_LOCKED) continue;
+        u32 wedges = 1;
+        for (u32 w = wedge_next[p]; w != p && wedges < 3; w = wedge_next[w]) wedges++;
+        if (wedges == 1 && open_edges[p] == 0) kind[p] = VERTEX_MANIFOLD;
+        else if (wedges == 1 && open_edges[p] == 2 && border_edges[p] == 2) kind[p] = VERTEX_BORDER;
+        else if (wedges == 2 && open_edges[p] == 4 && border_edges[p] == 0) kind[p] = VERTEX_SEAM;
+        else kind[p] = VERTEX_LOCKED;
+    }
+    for (size_t v = 0; v < vertex_count && locked; v++) {
+        if (locked[v]) kind[position_id[v]] = VERTEX_LOCKED;
+    }
+    for (size_t v = 0; v < vertex_count; v++) kind[v] = kind[position_id[v]];
+
+    // Quadrics, shared by the wedges of a position: the area weighted planes of the
+    // triangles around it, plus a plane perpendicular to each border or seam edge so
+    // that they keep their outline.
+    for (size_t i = 0; i < index_count; i += 3) {
+        vec3 p[3];
+        for (int k = 0; k < 3; k++) p[k] = verts[work[i + k]].position;
+        vec3 normal = vec3_cross_prod(vec3_sub(p[1], p[0]), vec3_sub(p[2], p[0]));
+        f32 length = vec3_length(normal);
+        if (length == 0.0f) continue;
+        normal = vec3_mul_scalar(normal, 1.0f / length);
+        Quadric q = quadric_from_plane(normal, -vec3_dot_prod(normal, p[0]), length * 0.5f);
+        for (int k = 0; k < 3; k++) quadric_add(&quadrics[position_id[work[i + k]]], &q);
+
+        for (int k = 0; k < 3; k++) {
+            u32 a = work[i + k];
+            u32 b = work[i + (k + 1) % 3];
+            if (edge_count(&index_edges, a, b) != 1) continue;
+            vec3 edge = vec3_sub(p[(k + 1) % 3], p[k]);
+            vec3 side = vec3_cross_prod(edge, normal);
+            f32 side_length = vec3_length(side);
+            if (side_length == 0.0f) continue;
+            side = vec3_mul_scalar(side, 1.0f / side_length);
+            f32 edge_length = vec3_length(edge);
+            Quadric border = quadric_from_plane(side, -vec3_dot_prod(side, p[k]), edge_length * edge_length * 10.0f);
+            border.weight = 0.0;    // constraint only, it doesn't count as surface area
+            quadric_add(&quadrics[position_id[a]], &border);
+            quadric_add(&quadrics[position_id[b]], &border);
+        }
+    }
+
+    // Collapse the cheapest edges in passes, every vertex changes at most once per pass
+    f32 max_error = 0.0f;
+    size_t current_count = index_count;
+    while (current_count > target_index_count) {
+        collapses.count = 0;
+        for (size_t i = 0; i < current_count; i += 3) {
+            for (int k = 0; k < 3; k++) {
+                u32 a = work[i + k];
+                u32 b = work[i + (k + 1) % 3];
+                u32 pa = position_id[a], pb = position_id[b];
+                for (int direction = 0; direction < 2; direction++) {
+                    u32 from = direction ? b : a;
+                    u32 to = direction ? a : b;
+                    if (kind[from] == VERTEX_LOCKED) continue;
+                    // border and seam vertices only move along their own kind of edge
+                    if (kind[from] == VERTEX_BORDER &&
+                        (kind[to] == VERTEX_MANIFOLD || edge_count(&position_edges, pa, pb) != 1)) continue;
+                    if (kind[from] == VERTEX_SEAM &&
+                        (kind[to] == VERTEX_MANIFOLD || kind[to] == VERTEX_BORDER ||
+                         edge_count(&index_edges, a, b) != 1 || edge_count(&position_edges, pa, pb) != 2)) continue;
+                    Quadric q = quadrics[position_id[from]];
+                    quadric_add(&q, &quadrics[position_id[to]]);
+                    Collapse collapse = { from, to, (f32)sqrt(quadric_error(&q, verts[to].position)) };
+                    // reserved for both directions of every edge
+                    collapses.items[collapses.count++] = collapse;
+                }
+            }
+        }
+        if (collapses.count == 0) break;
+        collapse_heapify(collapses.items, collapses.count);
+
+        // vertex -> triangles adjacency of the current triangles, the vertices get their
+        // range of adjacency in the order they are first used
+        for (size_t i = 0; i < current_count; i++) pass.first[work[i]] = 0xFFFFFFFFu;
+        for (size_t i = 0; i < current_count; i++) pass.count[work[i]]++;
+        u32 next = 0;
+        for (size_t i = 0; i < current_count; i++) {
+            u32 v = work[i];
+            if (pass.first[v] == 0xFFFFFFFFu) {
+                pass.first[v] = next;
+                next += pass.count[v];
+                pass.count[v] = 0;
+            }
+            pass.adjacency[pass.first[v] + pass.count[v]++] = (u32)(i / 3);
+        }
+
+        size_t triangles_left = current_count / 3;
+        size_t target_triangles = target_index_count / 3;
+
+        // a collapse removes about two triangles, anything much more expensive than the
+        // collapse that would reach the target waits for the next pass to be reevaluated.
+        // They come out of the heap cheapest first, so that's known once goal came out.
+        size_t goal = (triangles_left - target_triangles) / 2;
+        f32 error_limit = INFINITY;
+
+        size_t collapsed = 0;
+        for (size_t c = 0; collapses.count > 0 && triangles_left > target_triangles; c++) {
+            Collapse collapse = collapse_pop(collapses.items, &collapses.count);
+            if (c == goal) error_limit = collapse.error * 1.5f;
+            if (collapse.error > error_limit) break;
+            if (pass.touched[position_id[collapse.from]] || pass.touched[position_id[collapse.to]]) continue;
+
+            f32 distance = 0.0f;
+            size_t removed = collapse_check(verts, work, &pass, collapse.from, collapse.to, &distance);
+            if (removed == 0 || !collapse_link_check(work, &pass, collapse.from, collapse.to)) continue;
+
+            // on a seam the wedge on the other side goes to the matching wedge of to
+            u32 sibling = wedge_next[collapse.from];
+            u32 sibling_to = 0xFFFFFFFFu;
+            if (kind[collapse.from] == VERTEX_SEAM) {
+                sibling_to = seam_sibling(work, &pass, sibling, collapse.to);
+                if (sibling_to == 0xFFFFFFFFu) continue;
+                f32 sibling_distance = 0.0f;
+                size_t sibling_removed = collapse_check(verts, work, &pass, sibling, sibling_to, &sibling_distance);
+                if (sibling_removed == 0) continue;
+                removed += sibling_removed;
+                distance = fmaxf(distance, sibling_distance);
+            }
+
+            pass.remap[collapse.from] = collapse.to;
+            pass.changed[pass.changed_count++] = collapse.from;
+            collapse_touch(work, &pass, collapse.from);
+            if (sibling_to != 0xFFFFFFFFu) {
+                pass.remap[sibling] = sibling_to;
+                pass.changed[pass.changed_count++] = sibling;
+                collapse_touch(work, &pass, sibling);
+            }
+            quadric_add(&quadrics[position_id[collapse.to]], &quadrics[position_id[collapse.from]]);
+            triangles_left -= removed;
+            // the vertices collapsed onto from before now follow to
+            f32 deviation = pass.deviation[position_id[collapse.from]] + distance;
+            f32* to_deviation = &pass.deviation[position_id[collapse.to]];
+            *to_deviation = fmaxf(*to_deviation, deviation);
+            if (deviation > max_error) max_error = deviation;
+            collapsed++;
+        }
+        for (u32 i = 0; i < pass.touched_count; i++) pass.touched[pass.touched_list[i]] = 0;
+        pass.touched_count = 0;
+        if (collapsed == 0) break;
+
+        // apply the collapses and drop the triangles that became degenerate
+        size_t write = 0;
+        for (size_t i = 0; i < current_count; i += 3) {
+            for (int k = 0; k < 3; k++) pass.count[work[i + k]] = 0;
+            u32 a = pass.remap[work[i]], b = pass.remap[work[i + 1]], c = pass.remap[work[i + 2]];
+            if (a == b || b == c || a == c) continue;
+            work[write++] = a;
+            work[write++] = b;
+            work[write++] = c;
+        }
+        current_count = write;
+        for (u32 i = 0; i < pass.changed_count; i++) pass.remap[pass.changed[i]] = pass.changed[i];
+        pass.changed_count = 0;
+    }
+
+    if (!da_append_n(*out, work, current_count)) {
+        status = IO_ERROR_MEMORY;
+        goto cleanup;
+    }
+    if (out_error) *out_error = max_error;
+
+cleanup:
+    free(work);
+    free(position_id);
+    free(wedge_next);
+    free(table);
+    free(kind);
+    free(open_edges);
+    free(border_edges);
+    free(quadrics);
+    free(position_edges.entries);
+    free(index_edges.entries);
+    free(pass.first);
+    free(pass.count);
+    free(pass.adjacency);
+    free(pass.remap);
+    free(pass.changed);
+    free(pass.touched);
+    free(pass.touched_list);
+    free(pass.mark);
+    free(pass.deviation);
+    da_free(collapses);
+    return status;
+}
+
+IOStatus model_simplify(const Vertex* verts, size_t vertex_count, const u32* indices, size_t index_count,
+                        size_t target_index_count, u32_darray* out, f32* out_error) {
+    return simplify(verts, vertex_count, indices, index_count, NULL, target_index_count, out, out_error);
+}
+
+// Buffers of the LOD chain of a model, shared by all its submeshes. Each submesh is
+// simplified on a copy of the vertices it uses, numbered from 0, so that the cost of a
+// submesh doesn't depend on the size of the whole model.
+typedef struct {
+    u8* shared;         // model vertex -> its position is used by more than one submesh
+    u32* local;         // model vertex -> vertex of the submesh, UINT32_MAX outside of it (restored after every level)
+    u32* global;        // vertex of the submesh -> model vertex
+    Vertex* verts;      // the vertices of the submesh
+    u8* locked;         // shared, by vertex of the submesh
+    u32* indices;       // the previous level of the submesh with its own vertex numbers
+} LodScratch;
+
+// The edges between submeshes are simplified by neither of them, so that they still
+// match on both sides and no crack opens: every position used by two submeshes is locked.
+static IOStatus lod_scratch_init(LodScratch* scratch, Arena* arena, const Model* m) {
+    size_t vertex_count = m->verts.count;
+    size_t max_index_count = 0;
+    for (size_t s = 0; s < m->submeshes.count; s++) {
+        size_t index_count = m->submeshes.items[s].lods[0].index_count;
+        if (index_count > max_index_count) max_index_count = index_count;
+    }
+    size_t max_vertices = max_index_count < vertex_count ? max_index_count : vertex_count;
+    size_t table_capacity = 16;
+    while (table_capacity < vertex_count * 2) table_capacity *= 2;
+
+    scratch->shared = arena_push_zero(arena, u8, vertex_count + 1);
+    scratch->local = arena_push(arena, u32, vertex_count + 1);
+    scratch->global = arena_push(arena, u32, max_vertices + 1);
+    scratch->verts = arena_push(arena, Vertex, max_vertices + 1);
+    scratch->locked = arena_push(arena, u8, max_vertices + 1);
+    scratch->indices = arena_push(arena, u32, max_index_count + 1);
+    // only needed to find the shared positions, they go when the arena is reset
+    u32* position_id = arena_push(arena, u32, vertex_count + 1);
+    u32* wedge_next = arena_push(arena, u32, vertex_count + 1);
+    u32* table = arena_push(arena, u32, table_capacity);
+    if (!scratch->shared || !scratch->local || !scratch->global || !scratch->verts || !scratch->locked ||
+        !scratch->indices || !position_id || !wedge_next || !table) {
+        return IO_ERROR_MEMORY;
+    }
+    memset(scratch->local, 0xFF, vertex_count * sizeof(u32));
+
+    // owner of each position (the local array is borrowed for it): its submesh, or
+    // UINT32_MAX - 1 once a second one uses it
+    u32* owner = scratch->local;
+    build_position_ids(m->verts.items, vertex_count, position_id, wedge_next, table, table_capacity);
+    for (size_t s = 0; s < m->submeshes.count; s++) {
+        const ModelLod* lod = &m->submeshes.items[s].lods[0];
+        for (u32 i = 0; i < lod->index_count; i++) {
+            u32 p = position_id[m->indices.items[lod->index_offset + i]];
+            if (owner[p] == UINT32_MAX) owner[p] = (u32)s;
+            else if (owner[p] != (u32)s) owner[p] = UINT32_MAX - 1;
+        }
+    }
+    for (size_t v = 0; v < vertex_count; v++) scratch->shared[v] = owner[position_id[v]] == UINT32_MAX - 1;
+    memset(scratch->local, 0xFF, vertex_count * sizeof(u32));
+    return IO_SUCCESS;
+}
+
+// Append level of a submesh, simplified from its previous level towards target indices.
+// The previous level is copied as it is when it can't get any simpler.
+static IOStatus simplify_submesh_level(Model* m, LodScratch* scratch, Submesh* submesh, u32 level, size_t target) {
+    const ModelLod* previous = &submesh->lods[level - 1];
+    size_t previous_count = previous->index_count;
+    size_t offset = m->indices.count;
+    f32 error = 0.0f;
+
+    if (target < previous_count) {
+        // the vertices of the submesh, copied since appending to m->indices can move them
+        const u32* source = m->indices.items + previous->index_offset;
+        size_t vertex_count = 0;
+        for (size_t i = 0; i < previous_count; i++) {
+            u32 v = source[i];
+            if (scratch->local[v] == UINT32_MAX) {
+                scratch->local[v] = (u32)vertex_count;
+                scratch->global[vertex_count] = v;
+                scratch->verts[vertex_count] = m->verts.items[v];
+                scratch->locked[vertex_count] = scratch->shared[v];
+                vertex_count++;
+            }
+            scratch->indices[i] = scratch->local[v];
+        }
+        for (size_t v = 0; v < vertex_count; v++) scratch->local[scratch->global[v]] = UINT32_MAX;
+
+        IOStatus status = simplify(scratch->verts, vertex_count, scratch->indices, previous_count, scratch->locked,
+                                   target, &m->indices, &error);
+        if (status != IO_SUCCESS) return status;
+        for (size_t i = offset; i < m->indices.count; i++) m->indices.items[i] = scratch->global[m->indices.items[i]];
+    }
+    size_t count = m->indices.count - offset;
+    if (count == 0 || count >= previous_count) {
+        m->indices.count = offset;
+        if (!da_reserve(m->indices, offset + previous_count)) return IO_ERROR_MEMORY;
+        memcpy(m->indices.items + offset, m->indices.items + previous->index_offset, previous_count * sizeof(u32));
+        m->indices.count = offset + previous_count;
+        count = previous_count;
+        error = 0.0f;
+    }
+    // the error of a level is measured from the previous one, so they add up
+    submesh->lods[level] = (ModelLod){
+        .index_offset = (u32)offset,
+        .index_count = (u32)count,
+        .error = previous->error + error,
+    };
+    return IO_SUCCESS;
+}
+
+IOStatus model_generate_lods(Model* m, const f32* ratios, u32 ratio_count) {
+    if (m->lod_count > 1) {
+        // a chain that is there already is replaced, its levels are after level 0
+        m->indices.count = m->lods[0].index_offset + m->lods[0].index_count;
+        memset(m->lods + 1, 0, (MODEL_MAX_LODS - 1) * sizeof(ModelLod));
+        for (size_t s = 0; s < m->submeshes.count; s++) {
+            memset(m->submeshes.items[s].lods + 1, 0, (MODEL_MAX_LODS - 1) * sizeof(ModelLod));
+        }
+        m->lod_count = 1;
+    }
+    Arena* arena = arena_scratch();
+    if (!arena) return IO_ERROR_MEMORY;
+    ArenaMark mark = arena_mark(arena);
+    LodScratch scratch;
+    IOStatus status = lod_scratch_init(&scratch, arena, m);
+
+    for (u32 i = 0; i < ratio_count && m->lod_count < MODEL_MAX_LODS && status == IO_SUCCESS; i++) {
+        // every submesh is simplified on its own so that they stay separate ranges,
+        // the level of the model is all of them one after the other
+        u32 level = m->lod_count;
+        size_t level_offset = m->indices.count;
+        size_t previous_count = m->lods[level - 1].index_count;
+        size_t target = (size_t)((f64)(m->lods[0].index_count / 3) * ratios[i]) * 3;
+        if (target >= previous_count) continue;
+
+        f32 level_error = 0.0f;
+        for (size_t s = 0; s < m->submeshes.count && status == IO_SUCCESS; s++) {
+            Submesh* submesh = &m->submeshes.items[s];
+            size_t submesh_target = (size_t)((f64)(submesh->lods[0].index_count / 3) * ratios[i]) * 3;
+            status = simplify_submesh_level(m, &scratch, submesh, level, submesh_target);
+            if (status == IO_SUCCESS) level_error = fmaxf(level_error, submesh->lods[level].error);
+        }
+        if (status != IO_SUCCESS) {
+            m->indices.count = level_offset;
+            break;
+        }
+
+        size_t count = m->indices.count - level_offset;
+        if (count >= previous_count) {
+            // couldn't get any simpler, the following levels wouldn't either
+            m->indices.count = level_offset;
+            break;
+        }
+        m->lods[m->lod_count++] = (ModelLod){
+            .index_offset = (u32)level_offset,
+            .index_count = (u32)count,
+            .error = level_error,
+        };
+    }
+    arena_reset_to(arena, mark);
+    return status;
+}
+
+u32 model_select_lod(const ModelLod* lods, u32 lod_count, f32 distance, f32 fov_y, f32 screen_height, f32 pixel_error) {
+    // model units -> pixels at that distance
+    f32 pixels_per_unit = screen_height / (2.0f * tanf(fov_y * 0.5f) * fmaxf(distance, 1e-4f));
+    u32 selected = 0;
+    for (u32 i = 1; i < lod_count; i++) {
+        if (lods[i].error * pixels_per_unit > pixel_error) break;
+        selected = i;
+    }
+    return selected;
+}
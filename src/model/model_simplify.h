@@ -0,0 +1,59 @@
+#pragma once
+#include "common/files.h"
+#include "common/defines.h"
+#include "model/model.h"
+
+// =============================================================
+// Mesh simplification and LOD chains
+// =============================================================
+// Simplification collapses edges onto one of their existing vertices (quadric error
+// metric, Garland and Heckbert), so every LOD is just another index list over the same
+// vertex buffer. Vertices on a UV/normal seam are never moved and border vertices only
+// slide along the border, so seams and open edges keep their shape.
+
+// Largest on-screen error (in pixels) model_select_lod accepts
+#define MODEL_LOD_PIXEL_ERROR 1.0f
+
+/*
+* @brief Simplify a triangle list down to (at most) target_index_count indices,
+*   stopping earlier if no edge can be collapsed without breaking the mesh.
+*
+* @param verts The vertices the indices refer to.
+* @param vertex_count Number of vertices.
+* @param indices The triangle list to simplify.
+* @param index_count Number of indices.
+* @param target_index_count How many indices the result should have.
+* @param out Where to append the simplified triangle list.
+* @param out_error Where to store how far the removed vertices can be from the result (model
+*   units): the largest distance of a collapsed vertex from the triangles that replace its own,
+*   plus the distances of the vertices collapsed onto it before.
+* @return IO_SUCCESS or IO_ERROR_MEMORY.
+*/
+IOStatus model_simplify(const Vertex* verts, size_t vertex_count, const u32* indices, size_t index_count,
+                        size_t target_index_count, u32_darray* out, f32* out_error);
+
+/*
+* @brief Append a LOD chain to a model: level i + 1 has about ratios[i] of the
+*   triangles of level 0. Levels that can't get simpler than the previous one are skipped.
+*   Every submesh is simplified on its own and keeps its own range in each level, the
+*   positions it shares with other submeshes never move so that no crack opens between them.
+*
+* @param m The model, the levels it has already are replaced.
+* @param ratios Triangle ratio of each level, decreasing.
+* @param ratio_count Number of levels to add (at most MODEL_MAX_LODS - 1).
+* @return IO_SUCCESS or IO_ERROR_MEMORY (the model keeps the levels done so far).
+*/
+IOStatus model_generate_lods(Model* m, const f32* ratios, u32 ratio_count);
+
+/*
+* @brief Pick the coarsest level whose error, projected on screen, stays under pixel_error.
+*
+* @param lods The levels of the model, level 0 first.
+* @param lod_count Number of levels.
+* @param distance Distance from the camera to the model (model units).
+* @param fov_y Vertical field of view of the camera, in radians.
+* @param screen_height Height of the viewport in pixels.
+* @param pixel_error Largest accepted error in pixels.
+* @return The index of the level to draw.
+*/
+u32 model_select_lod(const ModelLod* lods, u32 lod_count, f32 distance, f32 fov_y, f32 screen_height, f32 pixel_error);
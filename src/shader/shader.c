@@ -1,43 +1,65 @@
 #include "shader/shader.h"
 #include <GL/glext.h>
+#include <stdlib.h>
 #include <string.h>
 
 u32 shader_new(const char* vertex_src, const char* fragment_src) {
-    const u32 maxbufferlen = MAXSHADERBUFLEN + 1;
-    char vertex_code[maxbufferlen];
-    char fragment_code[maxbufferlen];
-    
-    file_read_buffer(vertex_code, vertex_src, maxbufferlen);
-    file_read_buffer(fragment_code, fragment_src, maxbufferlen);
+    return shader_new_with_includes(vertex_src, fragment_src, NULL);
+}
+
+u32 shader_new_with_includes(const char* vertex_src, const char* fragment_src, path_darray* includes) {
+    // the #include lines are resolved here, the driver gets the complete sources
+    string_t vertex_code, fragment_code;
+    if (shader_source_load(vertex_src, &vertex_code, includes) != IO_SUCCESS) {
+        printf("ERROR::SHADER_FILE_NOT_READ %s\n", vertex_src);
+        return 0;
+    }
+    if (shader_source_load(fragment_src, &fragment_code, includes) != IO_SUCCESS) {
+        printf("ERROR::SHADER_FILE_NOT_READ %s\n", fragment_src);
+        free(vertex_code.data);
+        return 0;
+    }
+    u32 programID = shader_new_from_source(vertex_code.data, vertex_code.size, fragment_code.data, fragment_code.size);
+    free(vertex_code.data);
+    free(fragment_code.data);
+    return programID;
+}
 
-    const char* vertex_code_ptr = vertex_code;
-    const char* fragment_code_ptr = fragment_code;
+u32 shader_new_from_source(const char* vertex_code, size_t vertex_len, const char* fragment_code, size_t fragment_len) {
+    GLint vertex_code_len = (GLint)vertex_len;
+    GLint fragment_code_len = (GLint)fragment_len;
 
     u32 programID, vertex, fragment;
     
     //VERTEX SHADERS
     vertex = glCreateShader(GL_VERTEX_SHADER);
-    glShaderSource(vertex, 1, &vertex_code_ptr, NULL);
+    glShaderSource(vertex, 1, &vertex_code, &vertex_code_len);
     glCompileShader(vertex);
-    shader_check_compile_error(vertex, "VERTEX");
+    int compiled = shader_check_compile_error(vertex, "VERTEX");
 
     //FRAGMENT SHADERS
     fragment= glCreateShader(GL_FRAGMENT_SHADER);
-    glShaderSource(fragment, 1, &fragment_code_ptr, NULL);
+    glShaderSource(fragment, 1, &fragment_code, &fragment_code_len);
     glCompileShader(fragment);
-    shader_check_compile_error(fragment, "FRAGMENT");
+    compiled = shader_check_compile_error(fragment, "FRAGMENT") && compiled;
+    // the driver has its own copy of the sources once glShaderSource returns
     //link shaders
     //shader program
     programID = glCreateProgram();
     glAttachShader(programID, vertex);
     glAttachShader(programID, fragment);
     glLinkProgram(programID);
-    shader_check_compile_error(programID, "PROGRAM");
+    int linked = compiled && shader_check_compile_error(programID, "PROGRAM");
 
     //delete shaders after linking, they are no longer needed
     glDeleteShader(vertex);
     glDeleteShader(fragment);
 
+    // a broken program is never returned, hot reloading keeps the previous one instead
+    if (!linked) {
+        glDeleteProgram(programID);
+        return 0;
+    }
     return programID;
 }
 
@@ -46,7 +68,7 @@ void shader_use(u32 shaderID) {
     glUseProgram(shaderID);
 }
 
-void shader_check_compile_error(u32 shaderID, const char* type) {
+int shader_check_compile_error(u32 shaderID, const char* type) {
     int success;
     char infoLog[1024];
 
@@ -65,9 +87,18 @@ void shader_check_compile_error(u32 shaderID, const char* type) {
             printf("%s\n-- --------------------------------------------------- --\n", infoLog);
         }
     }
+    return success;
 }
 
 
 void shader_set_mat4(u32 shaderID, const char* name, const mat4 mat) {
     glUniformMatrix4fv(glGetUniformLocation(shaderID, name), 1, GL_FALSE, mat.data);
 }
+
+void shader_set_vec3(u32 shaderID, const char* name, const vec3 value) {
+    glUniform3fv(glGetUniformLocation(shaderID, name), 1, value.elements);
+}
+
+void shader_set_int(u32 shaderID, const char* name, i32 value) {
+    glUniform1i(glGetUniformLocation(shaderID, name), value);
+}
@@ -5,15 +5,26 @@
 #include <GL/glext.h>
 #include "common/defines.h"
 #include "common/files.h"
+#include "shader/shader_source.h"
 #include "math/math_types.h"
 
-#define MAXSHADERBUFLEN 1000000
-
+// returns 0 if a file can't be read or the program doesn't compile or link.
+// #include "file" lines are resolved (see shader/shader_source.h)
 u32 shader_new(const char* vertex_src, const char* fragment_src);
 
+// same as shader_new, and appends the files the shaders include to includes (to watch
+// them for example), even when it fails
+u32 shader_new_with_includes(const char* vertex_src, const char* fragment_src, path_darray* includes);
+
+// same as shader_new with sources already in memory (read asynchronously for example),
+// they don't have to be NUL-terminated
+u32 shader_new_from_source(const char* vertex_code, size_t vertex_len, const char* fragment_code, size_t fragment_len);
+
 void shader_use(u32 shaderID);
 
-void shader_check_compile_error(u32 shaderID, const char* type);
+// print the log of a failed compilation ("VERTEX", "FRAGMENT") or link ("PROGRAM"),
+// returns 1 if it succeeded
+int shader_check_compile_error(u32 shaderID, const char* type);
 
 
 //void setBool(const std::string &, bool) const;
@@ -34,3 +45,7 @@ void shader_check_compile_error(u32 shaderID, const char* type);
 //void setMat3(const std::string &name, const glm::mat3 &mat) const;
 //// ------------------------------------------------------------------------
 void shader_set_mat4(u32 shaderID, const char* name, const mat4 mat);
+
+void shader_set_vec3(u32 shaderID, const char* name, const vec3 value);
+
+void shader_set_int(u32 shaderID, const char* name, i32 value);
@@ -0,0 +1,154 @@
+#define _DEFAULT_SOURCE
+#include "shader_source.h"
+#include "common/parse.h"
+#include "common/scan.h"
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+#define SHADER_PATH_SIZE 4096
+
+typedef DARRAY(char) char_darray;
+
+// Room is always left for the NUL that ends the source
+static int source_append(char_darray* out, const char* data, size_t size) {
+    return da_grow(*out, out->count + size + 1) && da_append_n(*out, data, size);
+}
+
+static int source_append_line(char_darray* out, u32 line, size_t file) {
+    char directive[64];
+    int length = snprintf(directive, sizeof(directive), "#line %u %zu\n", line, file);
+    return source_append(out, directive, (size_t)length);
+}
+
+// Name of an `#include "name"` line, 0 if the line is something else
+static size_t source_include_name(const char* cursor, const char* end, const char** name) {
+    cursor = parse_skip_spaces(cursor, end);
+    if (cursor == end || *cursor != '#') return 0;
+    cursor = parse_skip_spaces(cursor + 1, end);
+    size_t keyword = sizeof("include") - 1;
+    if ((size_t)(end - cursor) < keyword || memcmp(cursor, "include", keyword) != 0) return 0;
+    cursor = parse_skip_spaces(cursor + keyword, end);
+    if (cursor == end || *cursor != '"') return 0;
+    const char* start = ++cursor;
+    while (cursor < end && *cursor != '"') cursor++;
+    if (cursor == end || cursor == start) return 0;
+    *name = start;
+    return (size_t)(cursor - start);
+}
+
+// Resolve the "." and ".." of a path in place, so that a file reached from two directories
+// has one name. The ".." that go above the start of a relative path are kept.
+static void source_normalize(char* path) {
+    size_t length = path[0] == '/';     // of the result, written over the path as it is read
+    size_t kept = length;               // what ".." can't remove: the root, or leading ".."
+    const char* p = path;
+    while (*p) {
+        while (*p == '/') p++;
+        const char* part = p;
+        while (*p && *p != '/') p++;
+        size_t part_length = (size_t)(p - part);
+        int parent = part_length == 2 && part[0] == '.' && part[1] == '.';
+        if (part_length == 0 || (part_length == 1 && part[0] == '.')) continue;
+        if (parent && length > kept) {
+            while (length > kept && path[length - 1] != '/') length--;
+            if (length > kept) length--;
+            continue;
+        }
+        // above the root is the root
+        if (parent && kept == 1 && path[0] == '/') continue;
+        if (length > 0 && path[length - 1] != '/') path[length++] = '/';
+        memmove(path + length, part, part_length);
+        length += part_length;
+        if (parent) kept = length;
+    }
+    if (length == 0) path[length++] = '.';
+    path[length] = '\0';
+}
+
+// Index of path in includes plus 1, 0 if it isn't there
+static size_t source_find(const path_darray* includes, const char* path) {
+    for (size_t i = 0; i < includes->count; i++) {
+        if (strcmp(includes->items[i], path) == 0) return i + 1;
+    }
+    return 0;
+}
+
+// Append the file number `file` of the shader to out, its includes pasted in
+static IOStatus source_expand(const char* path, size_t file, char_darray* out, path_darray* includes, u32 depth) {
+    if (depth > SHADER_INCLUDE_DEPTH) {
+        fprintf(stderr, "[SHADER] Includes nested too deep in %s\n", path);
+        return IO_ERROR_PARSE;
+    }
+    string_t source;
+    IOStatus status = file_map(&source, path, 0);
+    if (status == IO_ERROR_EMPTY) return IO_SUCCESS;
+    if (status != IO_SUCCESS) return status;
+
+    const char* cursor = source.data;
+    const char* end = source.data + source.size;
+    u32 line = 1;
+    while (cursor < end && status == IO_SUCCESS) {
+        const char* line_end = scan_line_end(cursor, end);
+        const char* next = line_end < end ? line_end + 1 : end;
+        const char* name;
+        size_t name_length = source_include_name(cursor, line_end, &name);
+        if (name_length == 0) {
+            if (!source_append(out, cursor, (size_t)(next - cursor)) ||
+                (next == end && line_end == end && !source_append(out, "\n", 1))) {
+                status = IO_ERROR_MEMORY;
+            }
+        } else {
+            char name_copy[SHADER_PATH_SIZE];
+            char include_path[SHADER_PATH_SIZE];
+            snprintf(name_copy, sizeof(name_copy), "%.*s", (int)name_length, name);
+            status = file_sibling_path(include_path, sizeof(include_path), path, name_copy);
+            if (status == IO_SUCCESS) source_normalize(include_path);
+            if (status == IO_SUCCESS && !source_find(includes, include_path)) {
+                char* copy = strdup(include_path);
+                if (!copy || !da_grow(*includes, includes->count + 1)) {
+                    free(copy);
+                    status = IO_ERROR_MEMORY;
+                } else {
+                    includes->items[includes->count++] = copy;
+                    size_t included = includes->count;
+                    status = source_append_line(out, 1, included) ? IO_SUCCESS : IO_ERROR_MEMORY;
+                    if (status == IO_SUCCESS) status = source_expand(copy, included, out, includes, depth + 1);
+                    if (status != IO_SUCCESS && status != IO_ERROR_MEMORY && status != IO_ERROR_PARSE) {
+                        fprintf(stderr, "[SHADER] %s:%u: Could not include %s (code %d)\n", path, line, copy, status);
+                    }
+                }
+            }
+            // back to the line after the #include
+            if (status == IO_SUCCESS && !source_append_line(out, line + 1, file)) status = IO_ERROR_MEMORY;
+        }
+        cursor = next;
+        line++;
+    }
+    file_unmap(&source);
+    return status;
+}
+
+IOStatus shader_source_load(const char* path, string_t* out, path_darray* includes) {
+    *out = (string_t){0};
+    // numbered and pasted per shader, whatever the caller's list already has
+    path_darray own = {0};
+    char_darray text = {0};
+    IOStatus status = source_expand(path, 0, &text, &own, 0);
+    if (status == IO_SUCCESS && !source_append(&text, "", 0)) status = IO_ERROR_MEMORY;
+    if (status != IO_SUCCESS) {
+        da_free(text);
+    } else {
+        text.items[text.count] = '\0';
+        out->data = text.items;
+        out->size = text.count;
+    }
+
+    for (size_t i = 0; includes && i < own.count; i++) {
+        if (source_find(includes, own.items[i])) continue;
+        if (!da_append(*includes, own.items[i])) break;
+        own.items[i] = NULL;
+    }
+    path_darray_free(&own);
+    return status;
+}
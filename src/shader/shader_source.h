@@ -0,0 +1,30 @@
+#pragma once
+#include "common/defines.h"
+#include "common/files.h"
+
+// =============================================================
+// Shader source preprocessing
+// =============================================================
+// Resolves the #include "file" lines of a GLSL source, which OpenGL doesn't do, by pasting
+// the included files in place. Names are relative to the including file, every file is
+// pasted once at most (so headers don't need guards) and #line directives keep the
+// compiler messages pointing at the right file and line: the source string number of a
+// #line is 0 for the main file, i + 1 for includes->items[i].
+// Files are read with file_map, so this works on the content archive, and it doesn't use
+// OpenGL: tiro-cook flattens the shaders with it ahead of time.
+
+// How deep includes can nest, deeper is taken for a cycle
+#define SHADER_INCLUDE_DEPTH 32
+
+/*
+* @brief Read a shader source and resolve its includes.
+*
+* @param path Path of the source.
+* @param out Set to the complete source, NUL-terminated, free out->data when done.
+* @param includes If not NULL, the paths of the included files that it doesn't have yet are
+*   appended to it, release them with path_darray_free. It is also appended to when loading
+*   fails, so that a broken include can still be watched.
+* @return IO_SUCCESS, the file_map error of a file that can't be read, IO_ERROR_PARSE if
+*   the includes nest too deep, or IO_ERROR_MEMORY.
+*/
+IOStatus shader_source_load(const char* path, string_t* out, path_darray* includes);
@@ -0,0 +1,109 @@
+#include "common/defines.h"
+#include "model/model.h"
+#include "model/model_material.h"
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+// =============================================================
+// OBJ import tests
+// =============================================================
+// Small .obj files written in the working directory, for the corner cases the synthetic
+// files of bench_obj don't have. Every file is imported on several threads and through
+// the streaming reader, both have to give the same model. `meson test -C build` runs them.
+
+static int failures = 0;
+
+#define TEST_CHECK(condition) do {\
+    if (!(condition)) {\
+        fprintf(stderr, "FAILED %s:%d: %s\n", __FILE__, __LINE__, #condition);\
+        failures++;\
+    }\
+} while (0)
+
+static int test_write(const char* path, const char* text, size_t repeat) {
+    FILE* fp = fopen(path, "wb");
+    if (!fp) return 0;
+    for (size_t i = 0; i < repeat; i++) fputs(text, fp);
+    return fclose(fp) == 0;
+}
+
+// Import path both ways, m is the threaded import. Returns 0 if either failed.
+static int test_import(const char* path, Model* m) {
+    Model streamed = {0};
+    *m = (Model){0};
+    IOStatus threaded = model_from_obj_threaded(path, m, 4);
+    IOStatus stream = model_from_obj_stream(path, &streamed);
+    TEST_CHECK(threaded == IO_SUCCESS);
+    TEST_CHECK(stream == IO_SUCCESS);
+    if (threaded != IO_SUCCESS || stream != IO_SUCCESS) {
+        model_free(m);
+        model_free(&streamed);
+        return 0;
+    }
+    TEST_CHECK(streamed.indices.count == m->indices.count);
+    TEST_CHECK(streamed.verts.count == m->verts.count);
+    model_free(&streamed);
+    return 1;
+}
+
+// "1-2" is read as two corners, the second one relative: the counting pass has to
+// reserve them. The file is big enough to be split in several chunks.
+static void test_signs_inside_a_corner(void) {
+    const char* path = "test_signs.obj";
+    size_t faces = 200000;
+    if (!test_write(path, "v 1 0 0\nv 2 0 0\nv 3 0 0\nv 4 0 0\n", 1)) return;
+    FILE* fp = fopen(path, "ab");
+    if (!fp) return;
+    for (size_t i = 0; i < faces; i++) fputs("f 1-2 3 4\n", fp);
+    fclose(fp);
+
+    Model m;
+    if (!test_import(path, &m)) return;
+    // a fan of 4 corners: (1, 3, 3) and (1, 3, 4)
+    TEST_CHECK(m.lods[0].index_count == faces * 6);
+    TEST_CHECK(m.verts.items[m.indices.items[0]].position.x == 1.0f);
+    TEST_CHECK(m.verts.items[m.indices.items[1]].position.x == 3.0f);
+    TEST_CHECK(m.verts.items[m.indices.items[5]].position.x == 4.0f);
+    model_free(&m);
+    remove(path);
+}
+
+// "mtllib a.mtl b.mtl" is two libraries, the materials of both are found
+static void test_several_libraries(void) {
+    if (!test_write("test_a.mtl", "newmtl red\nKd 1 0 0\n", 1) ||
+        !test_write("test_b.mtl", "newmtl blue\nKd 0 0 1\n", 1) ||
+        !test_write("test_libraries.obj", "mtllib test_a.mtl  test_b.mtl \r\nv 0 0 0\nv 1 0 0\nv 0 1 0\n"
+                                          "usemtl blue\nf 1 2 3\nusemtl red\nf 1 3 2\n", 1)) return;
+
+    Model m;
+    if (test_import("test_libraries.obj", &m)) {
+        TEST_CHECK(m.materials.count == 2);
+        TEST_CHECK(m.submeshes.count == 2);
+        for (size_t i = 0; i < m.submeshes.count; i++) TEST_CHECK(m.submeshes.items[i].material != MODEL_NO_MATERIAL);
+        model_free(&m);
+    }
+
+    path_darray paths = {0};
+    TEST_CHECK(material_library_paths("test_libraries.obj", &paths) == IO_SUCCESS);
+    TEST_CHECK(paths.count == 2);
+    if (paths.count == 2) {
+        TEST_CHECK(strcmp(paths.items[0], "test_a.mtl") == 0);
+        TEST_CHECK(strcmp(paths.items[1], "test_b.mtl") == 0);
+    }
+    path_darray_free(&paths);
+    remove("test_libraries.obj");
+    remove("test_a.mtl");
+    remove("test_b.mtl");
+}
+
+int main(void) {
+    test_signs_inside_a_corner();
+    test_several_libraries();
+    if (failures) {
+        fprintf(stderr, "%d checks failed\n", failures);
+        return 1;
+    }
+    printf("All tests passed\n");
+    return 0;
+}
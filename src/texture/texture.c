@@ -1,9 +1,19 @@
 #include "texture.h"
+#include "common/files.h"
 
-#define STB_IMAGE_IMPLEMENTATION
+#include "texture/texture_cooked.h"
 #include "common/stb_image.h"
 
 u32 texture_generate(const char* image_path){
+    string_t file = {0};
+    // decoded straight from the mapped file, stb doesn't have to read it in a buffer first
+    if (file_map(&file, image_path, 0) != IO_SUCCESS) file = (string_t){0};
+    u32 texture = texture_generate_from_memory((const u8*)file.data, file.size);
+    file_unmap(&file);
+    return texture;
+}
+
+u32 texture_generate_from_memory(const u8* image_data, size_t size){
     u32 texture;
     glGenTextures(1, &texture);
     glBindTexture(GL_TEXTURE_2D, texture);
@@ -12,9 +22,24 @@ u32 texture_generate(const char* image_path){
     glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_WRAP_T, GL_REPEAT);
     glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MIN_FILTER, GL_LINEAR_MIPMAP_LINEAR);
     glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MAG_FILTER, GL_LINEAR);
+    // a cooked texture already has its whole mip chain, every level is uploaded as it is
+    const TextureCookedHeader* cooked;
+    if (texture_cooked_parse(image_data, size, &cooked) == IO_SUCCESS) {
+        glPixelStorei(GL_UNPACK_ALIGNMENT, 4);
+        glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MAX_LEVEL, (GLint)cooked->level_count - 1);
+        for (u32 i = 0; i < cooked->level_count; i++) {
+            const TextureLevel* level = &cooked->levels[i];
+            glTexImage2D(GL_TEXTURE_2D, (GLint)i, GL_RGBA8, (GLsizei)level->width, (GLsizei)level->height, 0,
+                         GL_RGBA, GL_UNSIGNED_BYTE, image_data + level->offset);
+        }
+        return texture;
+    }
     // load and generate the texture
     i32 width, height, nrChannels;
-    unsigned char *data = stbi_load(image_path, &width, &height, &nrChannels, 0);
+    unsigned char *data = NULL;
+    if (image_data && size > 0) {
+        data = stbi_load_from_memory(image_data, (int)size, &width, &height, &nrChannels, 0);
+    }
     if (data)
     {
         glTexImage2D(GL_TEXTURE_2D, 0, GL_RGB, width, height, 0, GL_RGB, GL_UNSIGNED_BYTE, data);
@@ -23,6 +48,8 @@ u32 texture_generate(const char* image_path){
     else
     {
         printf("Failed to load texture\n");
+        glDeleteTextures(1, &texture);
+        texture = 0;
     }
     stbi_image_free(data);
     return texture;
@@ -14,10 +14,21 @@
 * @brief load a texture from an image and generate the opengl texture id
 *
 * @param image_path The path were to fing the texture to load
-* @return A u32 texture id
+* @return A u32 texture id, 0 if the image couldn't be loaded
 */
 u32 texture_generate(const char* image_path);
 
+/*
+* @brief decode an image already in memory (an encoded png, jpg, ... file, read
+*   asynchronously for example) and generate the opengl texture id. A cooked texture
+*   (see texture/texture_cooked.h) is uploaded with its mip chain, without decoding
+*
+* @param image_data The content of the image file
+* @param size The size of image_data in bytes
+* @return A u32 texture id, 0 if the image couldn't be decoded
+*/
+u32 texture_generate_from_memory(const u8* image_data, size_t size);
+
 /*
 * @brief bind the given texture to be used for rendering
 *
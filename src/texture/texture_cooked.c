@@ -0,0 +1,128 @@
+#include "texture_cooked.h"
+#include "common/stb_image.h"
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+#define TEXTURE_COOKED_CHANNELS 4
+
+// Texels of the previous level averaged along an axis for texel i of the next one: 2, or 1
+// when the axis is already 1 texel wide. Odd sizes round down, so the last texel takes 3
+// and the last row/column is folded in instead of being dropped.
+static u32 texture_footprint(u32 i, u32 src_size, u32 size) {
+    if (src_size == 1) return 1;
+    return i + 1 == size && src_size % 2 == 1 ? 3 : 2;
+}
+
+// Next level of the chain: box filter over the footprint of every texel, 2 x 2 texels
+// almost everywhere and up to 3 x 3 in the corner of an odd sized level.
+static void texture_downsample(const u8* src, u32 src_width, u32 src_height, u8* dst, u32 width, u32 height) {
+    for (u32 y = 0; y < height; y++) {
+        u32 y0 = src_height > 1 ? y * 2 : 0;
+        u32 rows = texture_footprint(y, src_height, height);
+        for (u32 x = 0; x < width; x++) {
+            u32 x0 = src_width > 1 ? x * 2 : 0;
+            u32 columns = texture_footprint(x, src_width, width);
+            u32 sum[TEXTURE_COOKED_CHANNELS] = {0};
+            for (u32 dy = 0; dy < rows; dy++) {
+                const u8* row = src + ((size_t)(y0 + dy) * src_width + x0) * TEXTURE_COOKED_CHANNELS;
+                for (u32 i = 0; i < columns * TEXTURE_COOKED_CHANNELS; i++) sum[i % TEXTURE_COOKED_CHANNELS] += row[i];
+            }
+            u32 count = rows * columns;
+            u8* out = dst + ((size_t)y * width + x) * TEXTURE_COOKED_CHANNELS;
+            for (u32 k = 0; k < TEXTURE_COOKED_CHANNELS; k++) out[k] = (u8)((sum[k] + count / 2) / count);
+        }
+    }
+}
+
+// The levels of a cooked texture, made one from the other as they are written
+typedef struct {
+    const TextureCookedHeader* header;
+    u8* buffers[2];     // level 0 then room for level 1, they take turns
+} TextureCookedLevels;
+
+static int texture_write_levels(FILE* fp, void* context) {
+    TextureCookedLevels* levels = context;
+    const TextureCookedHeader* header = levels->header;
+    int ok = file_write_at(fp, 0, header, sizeof(*header));
+    for (u32 i = 0; i < header->level_count && ok; i++) {
+        const TextureLevel* level = &header->levels[i];
+        u8* current = levels->buffers[i % 2];
+        if (i > 0) {
+            const TextureLevel* previous = &header->levels[i - 1];
+            texture_downsample(levels->buffers[(i - 1) % 2], previous->width, previous->height, current, level->width, level->height);
+        }
+        ok = file_write_at(fp, level->offset, current, level->size);
+    }
+    return ok;
+}
+
+IOStatus texture_cook(const char* image_path, const char* out_path) {
+    string_t file;
+    IO_CHECK(file_map(&file, image_path, 0));
+    i32 width, height, channels;
+    u8* pixels = stbi_load_from_memory((const u8*)file.data, (int)file.size, &width, &height, &channels, TEXTURE_COOKED_CHANNELS);
+    file_unmap(&file);
+    if (!pixels) return IO_ERROR_PARSE;
+
+    TextureCookedHeader header = {
+        .magic = TEXTURE_COOKED_MAGIC,
+        .version = TEXTURE_COOKED_VERSION,
+        .width = (u32)width,
+        .height = (u32)height,
+        .channels = TEXTURE_COOKED_CHANNELS,
+    };
+    u64 offset = align_up(sizeof(header), TEXTURE_COOKED_ALIGNMENT);
+    u32 w = (u32)width, h = (u32)height;
+    for (;;) {
+        if (header.level_count == TEXTURE_MAX_LEVELS) {
+            stbi_image_free(pixels);
+            return IO_ERROR_PARSE;
+        }
+        TextureLevel* level = &header.levels[header.level_count++];
+        *level = (TextureLevel){ .width = w, .height = h, .offset = offset, .size = (u64)w * h * TEXTURE_COOKED_CHANNELS };
+        offset = align_up(offset + level->size, TEXTURE_COOKED_ALIGNMENT);
+        if (w == 1 && h == 1) break;
+        w = w > 1 ? w / 2 : 1;
+        h = h > 1 ? h / 2 : 1;
+    }
+
+    // each level is made from the previous one, the two of them are all there is in memory
+    TextureCookedLevels levels = {
+        .header = &header,
+        .buffers = { malloc(header.levels[0].size), header.level_count > 1 ? malloc(header.levels[1].size) : NULL },
+    };
+    if (!levels.buffers[0] || (header.level_count > 1 && !levels.buffers[1])) {
+        stbi_image_free(pixels);
+        free(levels.buffers[0]);
+        free(levels.buffers[1]);
+        return IO_ERROR_MEMORY;
+    }
+    memcpy(levels.buffers[0], pixels, header.levels[0].size);
+    stbi_image_free(pixels);
+
+    IOStatus status = file_write_atomic(out_path, texture_write_levels, &levels);
+    free(levels.buffers[0]);
+    free(levels.buffers[1]);
+    return status;
+}
+
+IOStatus texture_cooked_parse(const void* data, size_t size, const TextureCookedHeader** header) {
+    const TextureCookedHeader* h = data;
+    if (!data || size < sizeof(TextureCookedHeader) || h->magic != TEXTURE_COOKED_MAGIC ||
+        h->version != TEXTURE_COOKED_VERSION || h->channels != TEXTURE_COOKED_CHANNELS ||
+        h->level_count == 0 || h->level_count > TEXTURE_MAX_LEVELS ||
+        h->levels[0].width != h->width || h->levels[0].height != h->height) {
+        return IO_ERROR_PARSE;
+    }
+    for (u32 i = 0; i < h->level_count; i++) {
+        const TextureLevel* level = &h->levels[i];
+        if (level->width == 0 || level->height == 0 ||
+            level->size != (u64)level->width * level->height * TEXTURE_COOKED_CHANNELS ||
+            level->offset < sizeof(TextureCookedHeader) || level->size > size || level->offset > size - level->size) {
+            return IO_ERROR_PARSE;
+        }
+    }
+    *header = h;
+    return IO_SUCCESS;
+}
@@ -0,0 +1,57 @@
+#pragma once
+#include "common/defines.h"
+#include "common/files.h"
+
+// =============================================================
+// Cooked textures (.tex)
+// =============================================================
+// Images decoded and mip mapped ahead of time by tiro-cook (see tools/tiro_cook.c), so
+// loading one is a single upload per level: no image decoding and no glGenerateMipmap at
+// run time. The file is a header followed by every level of the chain, level 0 first,
+// each one RGBA8 rows top to bottom at a TEXTURE_COOKED_ALIGNMENT offset.
+// This file doesn't depend on OpenGL, the tools use it.
+
+#define TEXTURE_COOKED_MAGIC     0x58455454u   // "TTEX"
+#define TEXTURE_COOKED_VERSION   2
+#define TEXTURE_COOKED_ALIGNMENT 64
+#define TEXTURE_COOKED_EXTENSION ".tex"
+// A full chain of a 32768 x 32768 image
+#define TEXTURE_MAX_LEVELS 16
+
+typedef struct {
+    u32 width;
+    u32 height;
+    u64 offset;         // from the start of the file
+    u64 size;           // width * height * channels bytes
+} TextureLevel;
+
+typedef struct {
+    u32 magic;
+    u32 version;
+    u32 width;
+    u32 height;
+    u32 channels;       // always 4
+    u32 level_count;    // down to 1 x 1
+    TextureLevel levels[TEXTURE_MAX_LEVELS];
+} TextureCookedHeader;
+
+/*
+* @brief Decode an image and write it as a cooked texture with its full mip chain, through
+*   a temporary file renamed at the end.
+*
+* @param image_path The image to cook (any format stb_image reads).
+* @param out_path The .tex file to write.
+* @return IO_SUCCESS, IO_ERROR_OPEN/READ/EMPTY if the image can't be read, IO_ERROR_PARSE if
+*   it can't be decoded, IO_ERROR_MEMORY or IO_ERROR_WRITE.
+*/
+IOStatus texture_cook(const char* image_path, const char* out_path);
+
+/*
+* @brief Check whether memory holds a complete cooked texture.
+*
+* @param data Content of the file.
+* @param size Its size in bytes.
+* @param header Set to the header, inside data, if it is one.
+* @return IO_SUCCESS, or IO_ERROR_PARSE if it is not a cooked texture of this version.
+*/
+IOStatus texture_cooked_parse(const void* data, size_t size, const TextureCookedHeader** header);
@@ -0,0 +1,631 @@
+#define _DEFAULT_SOURCE
+#include "common/defines.h"
+#include "common/files.h"
+#include "common/hash.h"
+#include "common/jobs.h"
+#include "common/pak.h"
+#include "model/model.h"
+#include "model/model_material.h"
+#include "model/model_optimize.h"
+#include "model/model_pack.h"
+#include "shader/shader_source.h"
+#include "texture/texture_cooked.h"
+#include <errno.h>
+#include <inttypes.h>
+#include <limits.h>
+#include <stdatomic.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <strings.h>
+#include <sys/stat.h>
+
+// =============================================================
+// Asset cooker
+// =============================================================
+// Turns the sources of src/content into what the engine loads at run time and packs the
+// result in content.pak (see common/pak.h). Meson runs it:
+//   tiro-cook --root <dir> --cache <dir> --output <pak> [--depfile <file>] [--stats] <file>...
+//
+//   .obj .ply .stl          "<name>.mesh", imported, processed and quantized (see model/model_pack.h)
+//   .png .jpg .tga .bmp     "<name>.tex", decoded with its mip chain (see texture/texture_cooked.h)
+//   .glsl                   "<name>", with its includes pasted in (see shader/shader_source.h)
+//   anything else           "<name>", as it is
+//
+// Every asset is named by its path relative to the root. The cooked files are kept in the
+// cache directory with a manifest of what each one was made from: every file it read (the
+// .mtl of a mesh, the includes of a shader...) with its size, modification time and content
+// hash. An asset is cooked again only if one of them really changed: the same size and
+// mtime are trusted, otherwise the content hash decides, so a touched or checked out again
+// file costs a hash and no cooking. The assets to cook are spread over all the cores.
+// The textures of the materials of a mesh are cooked too, listed or not, and the depfile
+// gives ninja every file that was read, so that editing any of them runs the cooker again.
+
+// Bumped when the cooking of an asset changes, everything is cooked again
+#define COOK_VERSION 2
+#define COOK_MANIFEST "manifest"
+// The processing the engine expects, same as SCENE_MODEL_FLAGS in main.c
+#define COOK_MESH_FLAGS (MODEL_LOAD_OPTIMIZE | MODEL_LOAD_LODS | MODEL_LOAD_MESHLETS | MODEL_LOAD_TANGENTS)
+// Dependency.mtime_ns of a file that doesn't exist, it is a dependency until it appears
+#define COOK_MISSING (-1)
+
+typedef enum {
+    ASSET_COPY,
+    ASSET_MESH,
+    ASSET_TEXTURE,
+    ASSET_SHADER,
+} AssetKind;
+
+// A file an asset was made from, as it was then
+typedef struct {
+    char* path;
+    u64 size;
+    i64 mtime_ns;
+    u64 hash;
+} Dependency;
+
+typedef DARRAY(Dependency) dependency_darray;
+
+typedef struct {
+    char* name;                 // relative to the root
+    char* output;               // the cooked file, the source itself for copies
+    AssetKind kind;
+    dependency_darray deps;     // the source first
+    path_darray refs;           // names of the assets it uses
+    IOStatus status;
+} Asset;
+
+typedef DARRAY(Asset) asset_darray;
+
+typedef struct {
+    char root[PATH_MAX];
+    size_t root_length;
+    const char* cache;
+    asset_darray assets;
+    asset_darray previous;      // from the manifest of the last run
+    u32* dirty;                 // indices of the assets to cook
+    u32 dirty_count;
+    atomic_uint next;           // next entry of dirty a worker takes
+    u32 cooked_count;           // over all the rounds
+    int stats;                  // --stats: print how well the meshes it cooks use the vertex cache
+} Cooker;
+
+// =============================================================
+// Helpers
+// =============================================================
+
+// a + b + c in a new string, NULL if out of memory
+static char* cook_concat(const char* a, const char* b, const char* c) {
+    size_t la = strlen(a), lb = strlen(b), lc = strlen(c);
+    char* out = malloc(la + lb + lc + 1);
+    if (!out) return NULL;
+    memcpy(out, a, la);
+    memcpy(out + la, b, lb);
+    memcpy(out + la + lb, c, lc + 1);
+    return out;
+}
+
+static AssetKind asset_kind(const char* name) {
+    const char* dot = strrchr(name, '.');
+    if (!dot || strchr(dot, '/')) return ASSET_COPY;
+    static const char* meshes[] = { ".obj", ".ply", ".stl" };
+    static const char* images[] = { ".png", ".jpg", ".jpeg", ".tga", ".bmp" };
+    for (size_t i = 0; i < sizeof(meshes) / sizeof(meshes[0]); i++) {
+        if (strcasecmp(dot, meshes[i]) == 0) return ASSET_MESH;
+    }
+    for (size_t i = 0; i < sizeof(images) / sizeof(images[0]); i++) {
+        if (strcasecmp(dot, images[i]) == 0) return ASSET_TEXTURE;
+    }
+    return strcasecmp(dot, ".glsl") == 0 ? ASSET_SHADER : ASSET_COPY;
+}
+
+// Appended to the name of an asset to get its name in the archive
+static const char* asset_extension(AssetKind kind) {
+    if (kind == ASSET_MESH) return PACKED_MESH_EXTENSION;
+    if (kind == ASSET_TEXTURE) return TEXTURE_COOKED_EXTENSION;
+    return "";
+}
+
+// Name of a file relative to the root, inside resolved, NULL if it isn't a file under the root
+static const char* cook_relative_name(const Cooker* cooker, const char* path, char resolved[PATH_MAX]) {
+    if (!realpath(path, resolved)) return NULL;
+    if (strncmp(resolved, cooker->root, cooker->root_length) != 0 || resolved[cooker->root_length] != '/') return NULL;
+    const char* name = resolved + cooker->root_length + 1;
+    // the manifest is split on them
+    if (strpbrk(name, "\t\n")) return NULL;
+    return name;
+}
+
+// Create the directories of path that don't exist yet
+static IOStatus cook_make_parents(const char* path) {
+    char* copy = strdup(path);
+    if (!copy) return IO_ERROR_MEMORY;
+    IOStatus status = IO_SUCCESS;
+    for (char* slash = strchr(copy + 1, '/'); slash && status == IO_SUCCESS; slash = strchr(slash + 1, '/')) {
+        *slash = '\0';
+        if (mkdir(copy, 0755) != 0 && errno != EEXIST) status = IO_ERROR_WRITE;
+        *slash = '/';
+    }
+    free(copy);
+    return status;
+}
+
+static int cook_write_bytes(FILE* fp, void* context) {
+    const string_t* bytes = context;
+    return bytes->size == 0 || fwrite(bytes->data, 1, bytes->size, fp) == bytes->size;
+}
+
+static IOStatus cook_write_file(const char* path, const void* data, size_t size) {
+    string_t bytes = { (char*)data, size };
+    return file_write_atomic(path, cook_write_bytes, &bytes);
+}
+
+// =============================================================
+// Dependencies
+// =============================================================
+
+static void dependency_stat(Dependency* dep) {
+    struct stat st;
+    if (stat(dep->path, &st) != 0) {
+        dep->size = 0;
+        dep->mtime_ns = COOK_MISSING;
+        return;
+    }
+    dep->size = (u64)st.st_size;
+    dep->mtime_ns = (i64)st.st_mtim.tv_sec * 1000000000 + st.st_mtim.tv_nsec;
+}
+
+static u64 dependency_hash(const char* path) {
+    string_t content;
+    if (file_map(&content, path, 0) != IO_SUCCESS) return 0;
+    u64 hash = hash_bytes(content.data, content.size, 0);
+    file_unmap(&content);
+    return hash;
+}
+
+// Record the current state of a file the asset is made from
+static IOStatus asset_add_dependency(Asset* asset, const char* path) {
+    for (size_t i = 0; i < asset->deps.count; i++) {
+        if (strcmp(asset->deps.items[i].path, path) == 0) return IO_SUCCESS;
+    }
+    Dependency dep = { .path = strdup(path) };
+    if (!dep.path) return IO_ERROR_MEMORY;
+    dependency_stat(&dep);
+    dep.hash = dep.mtime_ns != COOK_MISSING ? dependency_hash(path) : 0;
+    if (!da_append(asset->deps, dep)) {
+        free(dep.path);
+        return IO_ERROR_MEMORY;
+    }
+    return IO_SUCCESS;
+}
+
+// Whether the files an asset was made from are still the same, their stat is refreshed
+static int dependencies_unchanged(dependency_darray* deps) {
+    for (size_t i = 0; i < deps->count; i++) {
+        Dependency* dep = &deps->items[i];
+        Dependency now = { .path = dep->path };
+        dependency_stat(&now);
+        if (now.size == dep->size && now.mtime_ns == dep->mtime_ns) continue;
+        if (now.mtime_ns == COOK_MISSING || dep->mtime_ns == COOK_MISSING || now.size != dep->size) return 0;
+        if (dependency_hash(dep->path) != dep->hash) return 0;
+        // same content, only touched: the next run doesn't have to hash it again
+        dep->mtime_ns = now.mtime_ns;
+    }
+    return 1;
+}
+
+static void asset_free(Asset* asset) {
+    free(asset->name);
+    free(asset->output);
+    for (size_t i = 0; i < asset->deps.count; i++) free(asset->deps.items[i].path);
+    da_free(asset->deps);
+    path_darray_free(&asset->refs);
+}
+
+static void assets_free(asset_darray* assets) {
+    for (size_t i = 0; i < assets->count; i++) asset_free(&assets->items[i]);
+    da_free(*assets);
+}
+
+static Asset* assets_find(asset_darray* assets, const char* name) {
+    for (size_t i = 0; i < assets->count; i++) {
+        if (strcmp(assets->items[i].name, name) == 0) return &assets->items[i];
+    }
+    return NULL;
+}
+
+// Add the asset named name (relative to the root), nothing if it is already there
+static IOStatus cooker_add_asset(Cooker* cooker, const char* name) {
+    if (assets_find(&cooker->assets, name)) return IO_SUCCESS;
+    if (!da_grow(cooker->assets, cooker->assets.count + 1)) return IO_ERROR_MEMORY;
+    Asset asset = { .kind = asset_kind(name), .name = strdup(name) };
+    if (asset.kind == ASSET_COPY) asset.output = cook_concat(cooker->root, "/", name);
+    else asset.output = cook_concat(cooker->cache, "/", name);
+    if (asset.output && asset.kind != ASSET_COPY) {
+        char* output = cook_concat(asset.output, asset_extension(asset.kind), "");
+        free(asset.output);
+        asset.output = output;
+    }
+    if (!asset.name || !asset.output) {
+        asset_free(&asset);
+        return IO_ERROR_MEMORY;
+    }
+    cooker->assets.items[cooker->assets.count++] = asset;
+    return IO_SUCCESS;
+}
+
+// =============================================================
+// Cooking
+// =============================================================
+
+// Material libraries of the mesh, as the importer finds them. They are dependencies
+// even when they don't exist, creating one changes the mesh.
+static IOStatus mesh_add_libraries(Asset* asset, const char* source) {
+    path_darray libraries = {0};
+    IOStatus status = material_library_paths(source, &libraries);
+    for (size_t i = 0; i < libraries.count && status == IO_SUCCESS; i++) {
+        status = asset_add_dependency(asset, libraries.items[i]);
+    }
+    path_darray_free(&libraries);
+    return status;
+}
+
+static IOStatus cook_mesh(const Cooker* cooker, Asset* asset, const char* source) {
+    IO_CHECK(mesh_add_libraries(asset, source));
+    Model model = {0};
+    ModelOptimizeStats stats;
+    IO_CHECK(model_load(source, &model, COOK_MESH_FLAGS, cooker->stats ? &stats : NULL));
+    if (cooker->stats) {
+        printf("[COOK] %s: ACMR %.3f -> %.3f, ATVR %.3f -> %.3f\n", asset->name,
+               stats.acmr_before, stats.acmr_after, stats.atvr_before, stats.atvr_after);
+    }
+    PackedMesh mesh;
+    IOStatus status = model_pack(&model, &mesh);
+    model_free(&model);
+    IO_CHECK(status);
+
+    // the materials name their textures by path, in the archive they go by their name
+    for (size_t i = 0; i < mesh.material_count && status == IO_SUCCESS; i++) {
+        char* map = mesh.materials[i].diffuse_map;
+        if (!map[0]) continue;
+        char resolved[PATH_MAX];
+        const char* name = cook_relative_name(cooker, map, resolved);
+        if (name) {
+            status = path_darray_add(&asset->refs, name);
+            if (status == IO_SUCCESS) snprintf(map, MODEL_PATH_SIZE, "%s", name);
+        } else {
+            // drawn without it, until it appears
+            fprintf(stderr, "[COOK] %s: texture %s is not a file under %s\n", asset->name, map, cooker->root);
+            status = asset_add_dependency(asset, map);
+            map[0] = '\0';
+        }
+    }
+    if (status == IO_SUCCESS) status = packed_mesh_write(&mesh, asset->output);
+    packed_mesh_free(&mesh);
+    return status;
+}
+
+static IOStatus cook_shader(Asset* asset, const char* source) {
+    string_t text;
+    path_darray includes = {0};
+    IOStatus status = shader_source_load(source, &text, &includes);
+    // the includes are dependencies even if one is broken, fixing it cooks the shader again
+    for (size_t i = 0; i < includes.count; i++) {
+        IOStatus added = asset_add_dependency(asset, includes.items[i]);
+        if (added != IO_SUCCESS && status == IO_SUCCESS) status = added;
+    }
+    path_darray_free(&includes);
+    if (status == IO_SUCCESS) status = cook_write_file(asset->output, text.data, text.size);
+    free(text.data);
+    return status;
+}
+
+static void cook_asset(const Cooker* cooker, Asset* asset) {
+    char* source = cook_concat(cooker->root, "/", asset->name);
+    if (!source) {
+        asset->status = IO_ERROR_MEMORY;
+        return;
+    }
+    // the state of the source before it is read, a change while cooking is seen next time
+    IOStatus status = asset_add_dependency(asset, source);
+    if (status == IO_SUCCESS && asset->deps.items[0].mtime_ns == COOK_MISSING) status = IO_ERROR_OPEN;
+    if (status == IO_SUCCESS && asset->kind != ASSET_COPY) status = cook_make_parents(asset->output);
+    if (status == IO_SUCCESS) {
+        if (asset->kind == ASSET_MESH) status = cook_mesh(cooker, asset, source);
+        else if (asset->kind == ASSET_TEXTURE) status = texture_cook(source, asset->output);
+        else if (asset->kind == ASSET_SHADER) status = cook_shader(asset, source);
+    }
+    if (status == IO_SUCCESS) printf("[COOK] %s\n", asset->name);
+    else fprintf(stderr, "[COOK] Could not cook %s (code %d)\n", asset->name, status);
+    asset->status = status;
+    free(source);
+}
+
+// Takes the next asset to cook until there is none left, the big ones don't hold the others back
+static void cook_job(void* data) {
+    Cooker* cooker = *(Cooker**)data;
+    for (;;) {
+        u32 i = atomic_fetch_add(&cooker->next, 1);
+        if (i >= cooker->dirty_count) break;
+        cook_asset(cooker, &cooker->assets.items[cooker->dirty[i]]);
+    }
+}
+
+// Cook the assets from first on that changed since the last run, the others keep what the
+// manifest has about them
+static IOStatus cooker_update(Cooker* cooker, size_t first) {
+    cooker->dirty_count = 0;
+    free(cooker->dirty);
+    cooker->dirty = malloc((cooker->assets.count - first + 1) * sizeof(u32));
+    if (!cooker->dirty) return IO_ERROR_MEMORY;
+    for (size_t i = first; i < cooker->assets.count; i++) {
+        Asset* asset = &cooker->assets.items[i];
+        Asset* previous = assets_find(&cooker->previous, asset->name);
+        struct stat st;
+        if (previous && previous->kind == asset->kind && stat(asset->output, &st) == 0 &&
+            dependencies_unchanged(&previous->deps)) {
+            // taken over from the manifest
+            asset->deps = previous->deps;
+            asset->refs = previous->refs;
+            previous->deps = (dependency_darray){0};
+            previous->refs = (path_darray){0};
+            asset->status = IO_SUCCESS;
+            continue;
+        }
+        cooker->dirty[cooker->dirty_count++] = (u32)i;
+    }
+    if (cooker->dirty_count == 0) return IO_SUCCESS;
+    cooker->cooked_count += cooker->dirty_count;
+
+    u32 worker_count = jobs_core_count();
+    if (worker_count > cooker->dirty_count) worker_count = cooker->dirty_count;
+    Cooker** workers = malloc(worker_count * sizeof(Cooker*));
+    if (!workers) return IO_ERROR_MEMORY;
+    for (u32 i = 0; i < worker_count; i++) workers[i] = cooker;
+    atomic_store(&cooker->next, 0);
+    jobs_run(cook_job, workers, sizeof(Cooker*), worker_count);
+    free(workers);
+    return IO_SUCCESS;
+}
+
+// =============================================================
+// Manifest
+// =============================================================
+// One record per line, fields separated by tabs, paths last:
+//   tiro-cook <COOK_VERSION> <PACKED_MESH_VERSION> <TEXTURE_COOKED_VERSION>
+//   A <kind> <name>                        an asset, followed by its records
+//   D <size> <mtime_ns> <hash> <path>      a file it was made from
+//   R <name>                               an asset it uses
+
+static void manifest_header(char* out, size_t size) {
+    snprintf(out, size, "tiro-cook %d %d %d", COOK_VERSION, PACKED_MESH_VERSION, TEXTURE_COOKED_VERSION);
+}
+
+// Assets of the last run, none if the manifest is missing, of another version or damaged
+static IOStatus manifest_read(Cooker* cooker, const char* path) {
+    string_t text;
+    if (file_read_all(&text, path) != IO_SUCCESS) return IO_SUCCESS;
+    char header[64];
+    manifest_header(header, sizeof(header));
+    IOStatus status = IO_SUCCESS;
+    char* cursor = text.data;
+    char* line = strsep(&cursor, "\n");
+    if (strcmp(line, header) != 0) cursor = NULL;
+
+    Asset* asset = NULL;
+    while (cursor && status == IO_SUCCESS) {
+        line = strsep(&cursor, "\n");
+        if (!line[0]) continue;
+        // the last field is whole, paths can have tabs
+        char* fields[5] = {0};
+        u32 field_count = 0;
+        u32 expected = line[0] == 'A' ? 3 : line[0] == 'D' ? 5 : 2;
+        char* rest = line;
+        while (rest && field_count + 1 < expected) fields[field_count++] = strsep(&rest, "\t");
+        if (rest) fields[field_count++] = rest;
+        if (field_count != expected) {
+            status = IO_ERROR_PARSE;
+        } else if (line[0] == 'A') {
+            if (!da_grow(cooker->previous, cooker->previous.count + 1)) {
+                status = IO_ERROR_MEMORY;
+                break;
+            }
+            asset = &cooker->previous.items[cooker->previous.count++];
+            *asset = (Asset){ .kind = (AssetKind)strtoul(fields[1], NULL, 10), .name = strdup(fields[2]) };
+            if (!asset->name) status = IO_ERROR_MEMORY;
+        } else if (line[0] == 'D' && asset) {
+            Dependency dep = {
+                .size = strtoull(fields[1], NULL, 10),
+                .mtime_ns = strtoll(fields[2], NULL, 10),
+                .hash = strtoull(fields[3], NULL, 16),
+                .path = strdup(fields[4]),
+            };
+            if (!dep.path || !da_append(asset->deps, dep)) {
+                free(dep.path);
+                status = IO_ERROR_MEMORY;
+            }
+        } else if (line[0] == 'R' && asset) {
+            status = path_darray_add(&asset->refs, fields[1]);
+        } else {
+            status = IO_ERROR_PARSE;
+        }
+    }
+    free(text.data);
+    // without it everything is cooked, which is always right
+    if (status != IO_SUCCESS) {
+        fprintf(stderr, "[COOK] Ignoring the damaged manifest %s\n", path);
+        assets_free(&cooker->previous);
+    }
+    return status == IO_ERROR_MEMORY ? status : IO_SUCCESS;
+}
+
+static int manifest_write_file(FILE* fp, void* context) {
+    const Cooker* cooker = context;
+    char header[64];
+    manifest_header(header, sizeof(header));
+    fprintf(fp, "%s\n", header);
+    for (size_t i = 0; i < cooker->assets.count; i++) {
+        const Asset* asset = &cooker->assets.items[i];
+        if (asset->status != IO_SUCCESS) continue;
+        fprintf(fp, "A\t%d\t%s\n", (int)asset->kind, asset->name);
+        for (size_t d = 0; d < asset->deps.count; d++) {
+            const Dependency* dep = &asset->deps.items[d];
+            fprintf(fp, "D\t%" PRIu64 "\t%" PRId64 "\t%016" PRIx64 "\t%s\n", dep->size, dep->mtime_ns, dep->hash, dep->path);
+        }
+        for (size_t r = 0; r < asset->refs.count; r++) fprintf(fp, "R\t%s\n", asset->refs.items[r]);
+    }
+    return !ferror(fp);
+}
+
+// The assets that were cooked, the failed ones are left out so that they are tried again
+static IOStatus manifest_write(const Cooker* cooker, const char* path) {
+    return file_write_atomic(path, manifest_write_file, (void*)cooker);
+}
+
+// =============================================================
+// Outputs
+// =============================================================
+
+// Paths in a Makefile rule, as ninja reads them
+static void depfile_put_path(FILE* fp, const char* path) {
+    fputc(' ', fp);
+    for (const char* c = path; *c; c++) {
+        if (*c == ' ' || *c == '#') fputc('\\', fp);
+        if (*c == '$') fputc('$', fp);
+        fputc(*c, fp);
+    }
+}
+
+// Every file that was read, so that ninja runs the cooker again when one of them changes
+static IOStatus depfile_write(const Cooker* cooker, const char* path, const char* target) {
+    FILE* fp = fopen(path, "w");
+    if (!fp) return IO_ERROR_OPEN;
+    fputs(target, fp);
+    fputc(':', fp);
+    for (size_t i = 0; i < cooker->assets.count; i++) {
+        const Asset* asset = &cooker->assets.items[i];
+        for (size_t d = 0; d < asset->deps.count; d++) {
+            if (asset->deps.items[d].mtime_ns != COOK_MISSING) depfile_put_path(fp, asset->deps.items[d].path);
+        }
+    }
+    fputc('\n', fp);
+    int ok = !ferror(fp);
+    if (fclose(fp) != 0) ok = 0;
+    return ok ? IO_SUCCESS : IO_ERROR_WRITE;
+}
+
+static IOStatus cooker_write_pak(const Cooker* cooker, const char* pak_path) {
+    u32 count = (u32)cooker->assets.count;
+    PakSource* sources = calloc(count + 1, sizeof(PakSource));
+    char** names = calloc(count + 1, sizeof(char*));
+    IOStatus status = sources && names ? IO_SUCCESS : IO_ERROR_MEMORY;
+    for (u32 i = 0; i < count && status == IO_SUCCESS; i++) {
+        const Asset* asset = &cooker->assets.items[i];
+        names[i] = cook_concat(asset->name, asset_extension(asset->kind), "");
+        if (!names[i]) status = IO_ERROR_MEMORY;
+        sources[i] = (PakSource){ .name = names[i], .path = asset->output };
+    }
+    if (status == IO_SUCCESS) status = pak_write(pak_path, sources, count);
+    for (u32 i = 0; names && i < count; i++) free(names[i]);
+    free(names);
+    free(sources);
+    return status;
+}
+
+// Cooked files of the assets that are gone
+static void cooker_remove_stale(const Cooker* cooker) {
+    for (size_t i = 0; i < cooker->previous.count; i++) {
+        const Asset* previous = &cooker->previous.items[i];
+        if (previous->kind == ASSET_COPY || assets_find((asset_darray*)&cooker->assets, previous->name)) continue;
+        char* output = cook_concat(cooker->cache, "/", previous->name);
+        char* cooked = output ? cook_concat(output, asset_extension(previous->kind), "") : NULL;
+        if (cooked) remove(cooked);
+        free(output);
+        free(cooked);
+    }
+}
+
+static int usage(const char* program) {
+    fprintf(stderr, "usage: %s --root <dir> --cache <dir> --output <pak> [--depfile <file>] [--stats] <file>...\n", program);
+    return 1;
+}
+
+int main(int argc, char** argv) {
+    const char* root = NULL;
+    const char* output = NULL;
+    const char* depfile = NULL;
+    Cooker cooker = {0};
+    int first_input = argc;
+    for (int i = 1; i < argc; i++) {
+        if (strcmp(argv[i], "--stats") == 0) {
+            cooker.stats = 1;
+            continue;
+        }
+        const char** option = strcmp(argv[i], "--root") == 0 ? &root :
+                              strcmp(argv[i], "--cache") == 0 ? &cooker.cache :
+                              strcmp(argv[i], "--output") == 0 ? &output :
+                              strcmp(argv[i], "--depfile") == 0 ? &depfile : NULL;
+        if (!option) {
+            first_input = i;
+            break;
+        }
+        if (i + 1 == argc) return usage(argv[0]);
+        *option = argv[++i];
+    }
+    if (!root || !cooker.cache || !output) return usage(argv[0]);
+    if (!realpath(root, cooker.root)) {
+        fprintf(stderr, "[COOK] No directory %s\n", root);
+        return 1;
+    }
+    cooker.root_length = strlen(cooker.root);
+
+    char* manifest = cook_concat(cooker.cache, "/", COOK_MANIFEST);
+    IOStatus status = manifest ? cook_make_parents(manifest) : IO_ERROR_MEMORY;
+    if (status == IO_SUCCESS) status = manifest_read(&cooker, manifest);
+    for (int i = first_input; i < argc && status == IO_SUCCESS; i++) {
+        char resolved[PATH_MAX];
+        const char* name = cook_relative_name(&cooker, argv[i], resolved);
+        if (!name) {
+            fprintf(stderr, "[COOK] %s is not a file under %s\n", argv[i], cooker.root);
+            status = IO_ERROR_OPEN;
+            break;
+        }
+        status = cooker_add_asset(&cooker, name);
+    }
+
+    // the assets used by the ones just cooked are added and cooked in turn, until there are no new ones
+    size_t first = 0;
+    while (status == IO_SUCCESS && first < cooker.assets.count) {
+        size_t count = cooker.assets.count;
+        status = cooker_update(&cooker, first);
+        for (size_t i = first; i < count && status == IO_SUCCESS; i++) {
+            const path_darray* refs = &cooker.assets.items[i].refs;
+            for (size_t r = 0; r < refs->count && status == IO_SUCCESS; r++) {
+                status = cooker_add_asset(&cooker, refs->items[r]);
+            }
+        }
+        first = count;
+    }
+
+    int failed = 0;
+    for (size_t i = 0; i < cooker.assets.count; i++) failed = failed || cooker.assets.items[i].status != IO_SUCCESS;
+    if (status == IO_SUCCESS) {
+        IOStatus written = manifest_write(&cooker, manifest);
+        if (written != IO_SUCCESS) fprintf(stderr, "[COOK] Could not write %s (code %d)\n", manifest, written);
+        cooker_remove_stale(&cooker);
+    }
+    if (status == IO_SUCCESS && depfile) {
+        status = depfile_write(&cooker, depfile, output);
+        if (status != IO_SUCCESS) fprintf(stderr, "[COOK] Could not write %s (code %d)\n", depfile, status);
+    }
+    if (status == IO_SUCCESS && !failed) {
+        status = cooker_write_pak(&cooker, output);
+        if (status == IO_SUCCESS) printf("[COOK] %zu assets in %s, %u cooked\n", cooker.assets.count, output, cooker.cooked_count);
+        else fprintf(stderr, "[COOK] Could not write %s (code %d)\n", output, status);
+    }
+    free(manifest);
+    free(cooker.dirty);
+    assets_free(&cooker.assets);
+    assets_free(&cooker.previous);
+    return status == IO_SUCCESS && !failed ? 0 : 1;
+}